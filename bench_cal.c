@@ -0,0 +1,192 @@
+/*
+ * Pending event set benchmarks: the classic hold model and up/down.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Hold: the queue holds N events, one operation is a dequeue followed by
+ * an enqueue at (dequeued time + increment).  Up/down: N enqueues and
+ * then N dequeues.  Increments are drawn from the distributions used by
+ * Ronngren & Ayani: exponential, uniform and bimodal.  Sizes grow by a
+ * factor of four until the next measurement would take too long.
+ *
+ * The program is built once per calendar (bench_cal_heap, ...).
+ */
+
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "cal.h"
+#include "system.h"
+
+#define HOLD_OPS	(1U << 18)	/* Hold operations per measurement */
+#define TIME_LIMIT	5.0		/* Seconds a measurement may take */
+
+/* Our own generator, so that the benchmark measures the calendar */
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static inline double rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double incr_exp(void)
+{
+	return -log(1.0 - rnd());
+}
+
+static double incr_unif(void)
+{
+	return 2.0 * rnd();
+}
+
+static double incr_bimodal(void)
+{
+	return rnd() < 0.9 ? 0.1 * rnd() : 95.0 + 10.0 * rnd();
+}
+
+static const struct {
+	const char *name;
+	double (*fn)(void);
+} dists[] = {
+	{ "exp", incr_exp },
+	{ "unif", incr_unif },
+	{ "bimodal", incr_bimodal },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Fill a fresh queue with N events */
+static struct calq *prefill(size_t n, double (*incr)(void))
+{
+	struct calq *q = calq_new();
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		calq_insert(q, i, incr(), 0);
+
+	return q;
+}
+
+/*
+ * Returns nanoseconds per hold operation, *MALLOCS is set to the number
+ * of malloc() calls done during the measurement.
+ */
+static double hold(size_t n, double (*incr)(void), size_t *mallocs)
+{
+	struct calq *q = prefill(n, incr);
+	struct alloc_stats before, after;
+	double t0, t1;
+	size_t i;
+
+	alloc_stats_get(&before);
+	t0 = now();
+	for (i = 0; i < HOLD_OPS; i++) {
+		const double t = calq_head_key(q)->atime;
+		const size_t idx = (size_t) calq_head(q);
+
+		calq_del_head(q);
+		calq_insert(q, idx, t + incr(), 0);
+	}
+	t1 = now();
+	alloc_stats_get(&after);
+
+	*mallocs = after.mallocs + after.reallocs - before.mallocs
+	    - before.reallocs;
+
+	calq_free(q);
+
+	return (t1 - t0) * 1e9 / HOLD_OPS;
+}
+
+/* Returns nanoseconds per operation of N enqueues and N dequeues */
+static double updown(size_t n, double (*incr)(void))
+{
+	struct calq *q = calq_new();
+	double t0, t1, t = 0.0;
+	size_t i;
+
+	t0 = now();
+	for (i = 0; i < n; i++)
+		calq_insert(q, i, t += incr(), 0);
+	while (calq_size(q))
+		calq_del_head(q);
+	t1 = now();
+
+	calq_free(q);
+
+	return (t1 - t0) * 1e9 / (2 * n);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n max_events]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_n = 1U << 22;
+	size_t d, n;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			max_n = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	printf("calendar: %s\n", calq_name);
+	printf("%-8s %10s %12s %12s %12s\n", "dist", "events", "hold ns/op",
+	       "updown ns/op", "hold mallocs");
+
+	for (d = 0; d < sizeof(dists) / sizeof(dists[0]); d++) {
+		for (n = 16; n <= max_n; n *= 4) {
+			const double t0 = now();
+			size_t m;
+			const double h = hold(n, dists[d].fn, &m);
+			const double u = updown(n, dists[d].fn);
+
+			printf("%-8s %10zu %12.1f %12.1f %12zu\n",
+			       dists[d].name, n, h, u, m);
+			fflush(stdout);
+
+			/* Would the next size (4x) take too long? */
+			if (4.0 * (now() - t0) > TIME_LIMIT)
+				break;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/*
+ * Distribution benchmark.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Samples every distribution of dist.c N times and prints how fast that
+ * went, then the mean of another N samples next to the mean the
+ * parameters give, as a sanity check.  The discrete distribution has
+ * -k outcomes of Zipf-like weights.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "dist.h"
+#include "rng.h"
+#include "system.h"
+
+static size_t nsamples = 10000000;
+static size_t noutcomes = 4096;
+
+static void bench(struct dist *d, struct rng *r)
+{
+	double rate, sum = 0.0;
+	size_t i;
+
+	if (!d) {
+		fprintf(stderr, "bad parameters\n");
+		exit(EXIT_FAILURE);
+	}
+
+	rate = dist_rate(d, r, nsamples);
+	for (i = 0; i < nsamples; i++)
+		sum += dist_sample(d, r);
+
+	printf("%-12s %7.1f M/s  %5.2f ns  (mean %.4f, expected %.4f)\n",
+	       dist_name(d), rate * 1e-6, 1e9 / rate, sum / nsamples,
+	       dist_mean(d));
+	dist_free(d);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n samples] [-k outcomes]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	double *values, *weights, *data;
+	struct rng r;
+	size_t i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:k:")) != -1) {
+		switch (c) {
+		case 'n':
+			nsamples = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			noutcomes = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!nsamples || !noutcomes)
+		usage(argv[0]);
+
+	rng_seed(&r, 1);
+
+	values = xmalloc(noutcomes * sizeof(*values));
+	weights = xmalloc(noutcomes * sizeof(*weights));
+	for (i = 0; i < noutcomes; i++) {
+		values[i] = i;
+		weights[i] = 1.0 / (i + 1);
+	}
+	data = xmalloc(noutcomes * sizeof(*data));
+	for (i = 0; i < noutcomes; i++)
+		data[i] = floor(10.0 * rng_double(&r));
+
+	bench(dist_normal(0.0, 1.0), &r);
+	bench(dist_exponential(1.0), &r);
+	bench(dist_erlang(3, 3.0), &r);
+	bench(dist_erlang(40, 4.0), &r);
+	bench(dist_gamma(0.5, 2.0), &r);
+	bench(dist_gamma(2.5, 2.0), &r);
+	bench(dist_weibull(1.5, 2.0), &r);
+	bench(dist_lognormal(0.0, 0.5), &r);
+	bench(dist_triangular(1.0, 2.0, 4.0), &r);
+	bench(dist_discrete(values, weights, noutcomes), &r);
+	bench(dist_empirical(data, noutcomes), &r);
+
+	free(values);
+	free(weights);
+	free(data);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+/*
+ * Process switching benchmark.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * N processes are alive at once, every one of them calls Wait() K times
+ * (with -f it also seizes and releases one facility each time), so Run()
+ * makes about N * (K + 1) dispatches.  With -o the network is open: a
+ * generator creates the N processes one after another, so only a few of
+ * them live at a time.  The time per dispatch covers the calendar and two
+ * switches, to the process and back.  With -H the processes are handlers
+ * (see create_handler()) doing the same, dispatched without any switch.  The program is built for the
+ * process backend chosen by PROCESS= in the Makefile.
+ */
+
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "cal.h"
+#include "error.h"
+#include "facility.h"
+#include "process.h"
+#include "system.h"
+
+static size_t nprocs = 100000;
+static unsigned int nwaits = 10;
+static bool use_fac;
+static bool open_net;
+static bool handlers;
+static struct facility_t fac;
+
+/* Our own generator, so that the benchmark measures the processes */
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static inline double rnd(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return ((rng_state >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static void *behaviour(void *arg __unused__)
+{
+	unsigned int k;
+
+	for (k = 0; k < nwaits; k++) {
+		if (use_fac) {
+			Seize(&fac);
+			Wait(0.0);
+			Release(&fac);
+		}
+		Wait(-log(rnd()));
+	}
+	Quit();
+}
+
+/* The same as behaviour(), K counts down in DATA */
+static struct activation handler(size_t idx __unused__, void *data)
+{
+	unsigned int *k = data;
+
+	switch (*k % 3) {
+	case 0:
+		if (*k == 3 * nwaits)
+			return act_quit();
+		if (use_fac) {
+			++*k;
+			return act_seize(&fac);
+		}
+		*k += 3;
+		return act_wait(-log(rnd()));
+	case 1:
+		++*k;
+		return act_wait(0.0);
+	default:
+		Release(&fac);
+		++*k;
+		return act_wait(-log(rnd()));
+	}
+}
+
+/* Creates the processes of an open network */
+static void *generator(void *arg __unused__)
+{
+	size_t i;
+
+	for (i = 0; i < nprocs; i++) {
+		if (handlers ? create_handler(handler, xcalloc(1, sizeof(int)),
+					      0) == -1
+		    : create_process(behaviour, 0) == -1)
+			psimerr("create_process");
+		Wait(-log(rnd()) * (nwaits + 1));
+	}
+	Quit();
+}
+
+static double start_time_of(size_t i __unused__)
+{
+	return rnd();
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n processes] [-k waits] [-f] [-o] [-H] "
+		"[-S stack_size]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	struct stack_stats ss;
+	struct rusage ru;
+	double t0, t1, dispatches;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:k:foHS:")) != -1) {
+		switch (c) {
+		case 'n':
+			nprocs = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			nwaits = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			use_fac = true;
+			break;
+		case 'o':
+			open_net = true;
+			break;
+		case 'H':
+			handlers = true;
+			break;
+		case 'S':
+			if (process_set_stack_size(strtoul(optarg, NULL, 0)))
+				psimerr("stack size");
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	fac_constructor(&fac);
+
+	if (Init(0.0, INFINITY) == -1)
+		psimerr("init");
+
+	if (open_net) {
+		if (create_process(generator, 0) == -1)
+			psimerr("create_process");
+	} else if (handlers) {
+		for (size_t i = 0; i < nprocs; i++)
+			if (create_handler(handler, xcalloc(1, sizeof(int)),
+					   0) == -1)
+				psimerr("create_handler");
+	} else {
+		t0 = now();
+		if (create_processes(behaviour, nprocs, NULL,
+				     start_time_of) == -1)
+			psimerr("create_processes");
+		t1 = now();
+		printf("created %zu processes in %.3f s\n", nprocs, t1 - t0);
+	}
+
+	t0 = now();
+	Run();
+	t1 = now();
+
+	dispatches = (double) nprocs * (nwaits * (use_fac ? 2 : 1) + 1
+					 + open_net);
+	getrusage(RUSAGE_SELF, &ru);
+	printf("%s: %.0f dispatches in %.3f s, %.1f ns each, "
+	       "max RSS %ld MiB\n", handlers ? "handler" :
+#ifdef PROCESS_coro
+	       "coro",
+#else
+	       "thread",
+#endif
+	       dispatches, t1 - t0, (t1 - t0) * 1e9 / dispatches,
+	       ru.ru_maxrss / 1024);
+	printf("process table: %zu slots\n", process_slots());
+	process_stack_stats(&ss, stdout);
+	printf("stacks: %zu MiB mapped, %zu KiB resident, %s\n",
+	       ss.mapped >> 20, ss.resident >> 10,
+	       ss.guarded ? "guarded" : "not all guarded");
+
+#ifdef PROCESS_thread
+	struct pool_stats ps;
+
+	process_pool_stats(&ps);
+	printf("thread pool: %zu hits, %zu misses, %zu threads, peak %zu\n",
+	       ps.hits, ps.misses, ps.threads, ps.peak);
+#endif
+
+	fac_destructor(&fac);
+
+	return EXIT_SUCCESS;
+}
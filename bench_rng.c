@@ -0,0 +1,160 @@
+/*
+ * Random variate benchmark.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Draws N uniforms, exponentials and normals through the variates of
+ * stats.c, first from a stream without buffers, so one by one with
+ * the C library, then from a buffered stream (see rng_batch.c), and
+ * last straight into an array with rng_fill_*().  Uniforms are never
+ * buffered, the second line of them is only there to compare.  The
+ * mean and the variance of what was drawn are printed as a sanity
+ * check.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "rng.h"
+#include "stats.h"
+#include "system.h"
+
+static size_t ndraws = 10000000;
+
+enum kind {
+	UNIFORM,
+	EXPONENTIAL,
+	NORMAL,
+	KINDS,
+};
+
+static const char *const names[KINDS] = {
+	"uniform", "exponential", "normal",
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *what, const char *how, double t,
+		   double sum, double sum2)
+{
+	const double mean = sum / ndraws;
+
+	printf("%-12s %-8s %7.1f M/s  %5.2f ns  (mean %.4f, var %.4f)\n",
+	       what, how, ndraws / t * 1e-6, t * 1e9 / ndraws, mean,
+	       sum2 / ndraws - mean * mean);
+}
+
+/* Draw with the variate of kind K from R */
+static void draw(struct rng *r, enum kind k, const char *how)
+{
+	double sum = 0.0, sum2 = 0.0, t0, x = 0.0;
+	size_t i;
+
+	t0 = now();
+	for (i = 0; i < ndraws; i++) {
+		switch (k) {
+		case UNIFORM:
+			x = rng_random(r);
+			break;
+		case EXPONENTIAL:
+			x = rng_exponential(r, 1.0);
+			break;
+		default:
+			x = rng_normal(r, 0.0, 1.0);
+		}
+		sum += x;
+		sum2 += x * x;
+	}
+	report(names[k], how, now() - t0, sum, sum2);
+}
+
+/* Fill an array with variates of kind K from R */
+static void fill(struct rng *r, enum kind k)
+{
+	double *v = xmalloc(ndraws * sizeof(*v));
+	double sum = 0.0, sum2 = 0.0, t;
+	size_t i;
+
+	t = now();
+	switch (k) {
+	case UNIFORM:
+		rng_fill_uniform(r, v, ndraws);
+		break;
+	case EXPONENTIAL:
+		rng_fill_exponential(r, v, ndraws);
+		break;
+	default:
+		rng_fill_normal(r, v, ndraws);
+	}
+	t = now() - t;
+
+	for (i = 0; i < ndraws; i++) {
+		sum += v[i];
+		sum2 += v[i] * v[i];
+	}
+	report(names[k], "array", t, sum, sum2);
+	free(v);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n draws]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	struct rng plain, buffered;
+	enum kind k;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			ndraws = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!ndraws)
+		usage(argv[0]);
+
+	rng_seed(&plain, 1);
+	rng_seed(&buffered, 1);
+	rng_buffer(&buffered);
+
+	for (k = 0; k < KINDS; k++) {
+		draw(&plain, k, "single");
+		draw(&buffered, k, "buffered");
+		fill(&plain, k);
+	}
+
+	rng_unbuffer(&buffered);
+
+	return EXIT_SUCCESS;
+}
@@ -39,126 +39,188 @@
 #include "cal.h"
 #include "error.h"
 #include "system.h"
-
-#define debug(fmt, ...) fprintf(stderr, fmt "\n", ## __VA_ARGS__)
-//#define debug(fmt, ...) (void) 0
+#include "trace.h"
 
 #define INTERNAL_ERROR(errstr)	\
 	errx(EXIT_FAILURE, _("%s(): INTERNAL ERROR at line %d (%s-%s): %s"),	\
 	__func__, __LINE__, VERSION, __DATE__, errstr)
 
-/* Calendar times */
-#pragma GCC visibility push(hidden)
-double start_time;
-double end_time;
-double cur_time;
-#pragma GCC visibility pop
-
-/* State of the simulation */
-static enum {
-	SIM_START,
-	SIM_INITIALIZED,
-	SIM_IN_PROGRESS,
-	SIM_TERMINATED,
-} state;
-
-/* This is the calendar itself */
-static struct cal *cal;
-
-static bool new_element_added;
-
-/* Mutex protecting the calendar */
-static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
-
-/* Iterate over a calendar with prefetching */
-#define cal_for_each(pos) \
-	for (pos = cal; pos != NULL; prefetch(pos->next), pos = pos->next)
-
-/* Remove head of the calendar */
-#define cal_remove_head()			\
-do {						\
-	pthread_mutex_lock(&lock);		\
-	if (cal) {				\
-		struct cal *__tmp = cal;	\
-		cal = cal->next;		\
-		free(__tmp);			\
-	}					\
-	pthread_mutex_unlock(&lock);		\
-} while (0)
-
 size_t get_head(void)
 {
-	return cal->idx;
+	struct sim *const s = sim_self();
+	ssize_t idx;
+
+	pthread_mutex_lock(&s->cal_lock);
+	idx = calq_head(s->cal);
+	pthread_mutex_unlock(&s->cal_lock);
+
+	if (unlikely(idx < 0))
+		INTERNAL_ERROR("calendar is empty");
+
+	return (size_t) idx;
 }
 
 void del_head(void)
 {
-	cal_remove_head();
-}
+	struct sim *const s = sim_self();
 
-/* Compare two processes according to time and priority */
-static bool process_compare(size_t new, size_t old)
-{
-	/* new process is later than old
-	 * or thay are in the same time but old process has
-	 * higher priority */
-	if (isgreater(process_list[new].atime, process_list[old].atime)
-	    || (!islessgreater(process_list[new].atime, process_list[old].atime)
-		&& process_list[new].prio <= process_list[old].prio))
-		return true;
-
-	return false;
+	pthread_mutex_lock(&s->cal_lock);
+	calq_del_head(s->cal);
+	pthread_mutex_unlock(&s->cal_lock);
 }
 
-/* Add new element into calendar */
-int add_elem(size_t idx)
+/*
+ * Add new element into calendar.  The process is activated at its
+ * atime; if it is already scheduled, the old activation is replaced.
+ * Returns handle usable with cal_cancel() and cal_reschedule().
+ */
+cal_handle_t add_elem(size_t idx)
 {
+	struct sim *const s = sim_self();
+
 	/* Get the mutex */
-	pthread_mutex_lock(&lock);
+	pthread_mutex_lock(&s->cal_lock);
 
-#define this process_list[idx]
+	if (unlikely(!s->cal))
+		s->cal = calq_new();
 
-	new_element_added = true;
+#define this PROC(idx)
+	calq_insert(s->cal, idx, this.atime, this.prio);
+#undef this
 
-	/* Create a new cal entry */
-	struct cal *new = xcalloc(1, sizeof(*new));
+	/* Release the mutex */
+	pthread_mutex_unlock(&s->cal_lock);
 
-	/* Set up index of the process */
-	new->idx = idx;
+	return process_handle(idx);
+}
 
-	struct cal *prev = NULL;
-	struct cal *act = cal;
+/*
+ * Add N processes starting with FIRST into calendar under one lock.
+ * The calendar builds itself from the whole batch, which is a lot
+ * cheaper than N separate insertions.
+ */
+void add_elems(size_t first, size_t n)
+{
+	struct sim *const s = sim_self();
+	double *atime = xmalloc(n * sizeof(double));
+	int *prio = xmalloc(n * sizeof(int));
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		atime[i] = PROC(first + i).atime;
+		prio[i] = PROC(first + i).prio;
+	}
 
-	/* while act is in cal and new process should be after act */
-	while (act != NULL && process_compare(new->idx, act->idx)) {
-		prev = act;
-		act = act->next;
-		/* skip process with same PID */
-		if (act && new->idx == act->idx)
-			act = act->next;
+	pthread_mutex_lock(&s->cal_lock);
+	if (unlikely(!s->cal))
+		s->cal = calq_new();
+	calq_insert_range(s->cal, first, n, atime, prio);
+	pthread_mutex_unlock(&s->cal_lock);
+
+	free(atime);
+	free(prio);
+}
+
+/*
+ * Remove scheduled activation, returns -1 if H isn't scheduled or its
+ * process is gone.
+ */
+int cal_cancel(cal_handle_t h)
+{
+	struct sim *const s = sim_self();
+	ssize_t i;
+	bool found;
+
+	pthread_mutex_lock(&s->cal_lock);
+	i = process_lookup(h);
+	found = i >= 0 && s->cal && calq_cancel(s->cal, (size_t) i);
+	pthread_mutex_unlock(&s->cal_lock);
+
+	if (!found) {
+		simerr = GLOB_INVAL;
+		return -1;
 	}
 
-	if (prev == NULL) {
-		/* cal is empty, create new head */
-		new->next = act;
-		cal = new;
+	return 0;
+}
+
+/* Move scheduled activation H to time T, the same checks as above */
+int cal_reschedule(cal_handle_t h, double t)
+{
+	struct sim *const s = sim_self();
+	ssize_t i;
+	int ret = 0;
+
+	pthread_mutex_lock(&s->cal_lock);
+	i = process_lookup(h);
+	if (i >= 0 && s->cal && calq_pending(s->cal, (size_t) i)
+	    && t >= s->now) {
+		PROC(i).atime = t;
+		calq_insert(s->cal, (size_t) i, t, PROC(i).prio);
 	} else {
-		/* insert item between prev and act */
-		prev->next = new;
-		new->next = act;
+		simerr = GLOB_INVAL;
+		ret = -1;
 	}
+	pthread_mutex_unlock(&s->cal_lock);
 
-#undef this
+	return ret;
+}
 
-	/* Release the mutex */
-	pthread_mutex_unlock(&lock);
+/* Calendar entries copied out to be traced in activation order */
+struct cal_entry {
+	size_t idx;
+	struct cal_key key;
+};
 
-	return 0;
+struct pending {
+	struct cal_entry *ent;
+	size_t n;
+};
+
+static void copy_entry(size_t idx, const struct cal_key *key, void *arg)
+{
+	struct pending *p = arg;
+
+	p->ent[p->n].idx = idx;
+	p->ent[p->n].key = *key;
+	p->n++;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	const struct cal_entry *x = a, *y = b;
+
+	return cal_key_before(&x->key, &y->key) ? -1 : 1;
+}
+
+/*
+ * Trace the calendar of S.  The calendars walk their entries in storage
+ * order, so they are sorted first.
+ */
+static void trace_pending(struct sim *s)
+{
+	struct pending p = { NULL, 0 };
+	size_t i;
+
+	if (!calq_size(s->cal))
+		return;
+
+	p.ent = xmalloc(calq_size(s->cal) * sizeof(*p.ent));
+	calq_walk(s->cal, copy_entry, &p);
+	qsort(p.ent, p.n, sizeof(*p.ent), compare_entries);
+
+	for (i = 0; i < p.n; i++)
+		trace(TRACE_EVENT, TR_PENDING, p.ent[i].key.atime,
+		      p.ent[i].idx, PROC_OF(s, p.ent[i].idx).state, 0,
+		      p.ent[i].key.prio);
+	free(p.ent);
 }
 
 /* Initialize the simulation */
 int Init(double t0, double t1)
 {
+	struct sim *const s = sim_self();
+
 	if (t0 > t1 || t0 < 0.0 || t1 < 0.0) {
 		/* Invalid arguments */
 		simerr = GLOB_INVAL;
@@ -166,11 +228,23 @@ int Init(double t0, double t1)
 	}
 
 	/* Initialize times */
-	start_time = cur_time = t0;
-	end_time = t1;
+	s->start = s->now = t0;
+	s->end = t1;
+	s->stop = 0;
+
+	/* DSIM_TRACE=file [DSIM_TRACE_LEVEL=n] traces the run */
+	const char *path = getenv("DSIM_TRACE");
+	if (path && !s->traced) {
+		const char *lvl = getenv("DSIM_TRACE_LEVEL");
+
+		if (trace_open(path, lvl ? atoi(lvl) : TRACE_LEVEL))
+			warn("cannot open trace %s", path);
+		else
+			s->traced = 1;
+	}
 
 	/* Now the initialization's over */
-	state = SIM_INITIALIZED;
+	s->state = SIM_INITIALIZED;
 
 	return 0;
 }
@@ -178,99 +252,80 @@ int Init(double t0, double t1)
 /* Run the simulation until finished */
 int Run(void)
 {
+	struct sim *const s = sim_self();
+
 	/* Sanity check */
-	if (state != SIM_INITIALIZED) {
+	if (s->state != SIM_INITIALIZED) {
 		simerr = GLOB_NOTINIT;
 		return -1;
 	}
-#define this process_list[cp->idx]
-	struct cal *cp = cal;
-
-	puts("Initial state of the calendar");
-	printf("top ->\n");
-	cal_for_each(cp) {
-		printf("        [ idx:%d atime:%g prio:%d state:%c ]\n", cp->idx,
-		       this.atime, this.prio, TASK_STATE_TO_CHAR_STR[this.state]);
-	}
-	fputc_unlocked('\n', stdout);
 
-	puts("<< START OF SIMULATION >>");
+	if (TRACE_LEVEL >= TRACE_EVENT && trace_level >= TRACE_EVENT && s->cal)
+		trace_pending(s);
 
-	cp = cal;
+	if (!s->quiet)
+		puts("<< START OF SIMULATION >>");
+
+	s->state = SIM_IN_PROGRESS;
 
 	/* The main loop */
-	while (cp) {
-		int res;
+	for (;;) {
+		struct cal_key key;
+		ssize_t i;
+
+		/* Take the next activation off the calendar */
+		pthread_mutex_lock(&s->cal_lock);
+		i = s->cal ? calq_head(s->cal) : -1;
+		if (i >= 0) {
+			key = *calq_head_key(s->cal);
+			calq_del_head(s->cal);
+		}
+		pthread_mutex_unlock(&s->cal_lock);
 
-		printf("        [ idx:%d atime:%f prio:%d state:%c ]\n", cp->idx,
-		       this.atime, this.prio, TASK_STATE_TO_CHAR_STR[this.state]);
+		if (i < 0)
+			break;
 
-		/* Get the mutex */
-		res = pthread_mutex_lock(&this.lock);
-		if (unlikely(res))
-			printf("pthread_mutex_lock: %s\n", strerror(res));
+#define this PROC_OF(s, i)
+		trace(TRACE_EVENT, TR_DISPATCH, key.atime, i, this.state, 0,
+		      key.prio);
 
 		/* Update current simulation time */
-		cur_time = this.atime;
+		s->now = key.atime;
 
 		/* Did we reach end time? */
-		if (cur_time >= end_time)
-			/* Yes, end simulation */
-			goto out;
-
-		if (this.state == TASK_WAKING) {;
-			/* Mark thread as running */
-			this.state = TASK_RUNNING;
-
-			/* This thread wasn't created, create it now */
-			res =
-			    pthread_create(&this.th, NULL, this.behaviour,
-					   NULL);
-			if (unlikely(res))
-				printf("pthread_create: %s\n", strerror(res));
-		} else if (this.state == TASK_STOPPED) {
-			/* Mark thread as running */
-			this.state = TASK_RUNNING;
-
-			/* Thread is sleeping, wake it up now */
-			res = pthread_cond_signal(&this.cond);
-			if (unlikely(res))
-				printf("pthread_cond_signal: %s\n",
-				       strerror(res));
-		} else if (this.state == TASK_DEAD)
-			goto out;
-
-		/* Wait for signal from child */
-		do
-			pthread_cond_wait(&this.cond, &this.lock);
-		while (0 && this.state == TASK_RUNNING);
-
-		/* Only join if the state is TASK_DEAD */
-		if (this.state == TASK_DEAD) {
-			res = pthread_join(this.th, NULL);
-			if (unlikely(res))
-				printf("pthread_join: %s\n", strerror(res));
-		}
+		if (s->now >= s->end || this.state == TASK_DEAD)
+			break;
 
-		/* Release the mutex */
-		res = pthread_mutex_unlock(&this.lock);
-		if (unlikely(res))
-			printf("pthread_mutex_unlock: %s\n", strerror(res));
+		/* Run the process until it waits, stops or quits */
+		if (this.handler)
+			handler_dispatch((size_t) i);
+		else
+			process_switch((size_t) i);
 
 		if (this.state == TASK_DEAD)
-			/* Invalidate data in process_list */
-			destroy_process(cp->idx);
+			/* Free its slot in the process table */
+			destroy_process(i);
+#undef this
 
-		/* Move to next entry */
-		if (new_element_added || this.state == TASK_DEAD) {
-			cp = cp->next;
+		/* Are the watched stats precise enough? See runlen.c */
+		if (unlikely(s->stop))
+			break;
+	}
 
-			/* Remove processed element */
-			cal_remove_head();
-		}
+	s->state = SIM_TERMINATED;
+	if (!s->quiet)
+		puts("<< END OF SIMULATION >>\n");
+
+	/* The trace belongs to this run */
+	if (s->traced) {
+		trace_close();
+		s->traced = 0;
 	}
- out:
-	puts("<< END OF SIMULATION >>\n");
 
 	return 0;
 }
+
+static void __attribute__((destructor)) cal_cleanup(void)
+{
+	calq_free(sim_default.cal);
+}
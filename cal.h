@@ -18,23 +18,87 @@
 #ifndef _CAL_H_
 #define _CAL_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include "process.h"
+#include "sim.h"
 
-extern double start_time;
-extern double end_time;
-extern double cur_time;
+/* Times of the simulation bound to the calling thread */
+#define start_time	(sim_self()->start)
+#define end_time	(sim_self()->end)
+#define cur_time	(sim_self()->now)
 
+/*
+ * Ordering key of a calendar entry.  It is copied into the entry when
+ * the process is scheduled, so the calendar never has to look into
+ * the process table while comparing.
+ */
+struct cal_key {
+	double atime;		/* Activation time */
+	int prio;		/* Priority, higher goes first */
+	uint64_t seq;		/* Insertion order, FIFO among equals */
+};
+
+/* Entry of the sorted-list calendar (CALENDAR=list) */
 struct cal {
 	/* Next element */
 	struct cal *next;
 
+	/* Key the entry is sorted by */
+	struct cal_key key;
+
 	/*Index of the process in the process list */
 	size_t idx;
 };
 
+/*
+ * Handle of a scheduled entry.  A process has at most one pending
+ * activation, so the handle is that of the process (see proc_handle_t):
+ * once the process is gone, the handle is refused even if a new process
+ * took its slot.
+ */
+typedef proc_handle_t cal_handle_t;
+
+/* True if entry with key A is to be activated before entry with key B */
+static inline bool cal_key_before(const struct cal_key *a,
+				  const struct cal_key *b)
+{
+	if (a->atime != b->atime)
+		return a->atime < b->atime;
+	if (a->prio != b->prio)
+		return a->prio > b->prio;
+	return a->seq < b->seq;
+}
+
+/*
+ * Pending event set.  The implementation is selected at build time
+ * (see CALENDAR in the Makefile); all of them provide the calq_*
+ * interface below.  None of these functions lock.
+ */
+struct calq;
+
+extern const char calq_name[];
+extern struct calq *calq_new(void);
+extern void calq_free(struct calq *);
+extern size_t calq_size(struct calq *);
+extern void calq_insert(struct calq *, size_t, double, int);
+extern void calq_insert_range(struct calq *, size_t, size_t, const double *,
+			      const int *);
+extern bool calq_cancel(struct calq *, size_t);
+extern bool calq_pending(struct calq *, size_t);
+extern ssize_t calq_head(struct calq *);
+extern const struct cal_key *calq_head_key(struct calq *);
+extern void calq_del_head(struct calq *);
+extern void calq_walk(struct calq *,
+		      void (*)(size_t, const struct cal_key *, void *), void *);
+
 extern int Init(double, double);
 extern int Run(void);
-extern int add_elem(size_t);
+extern cal_handle_t add_elem(size_t);
+extern void add_elems(size_t, size_t);
+extern int cal_cancel(cal_handle_t);
+extern int cal_reschedule(cal_handle_t, double);
 size_t get_head(void);
 void del_head(void);
 
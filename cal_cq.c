@@ -0,0 +1,460 @@
+/*
+ * Calendar queue (R. Brown, CACM 31(10), 1988).
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Events are hashed by time into an array of "days" (buckets), each one
+ * `width' long; the array covers one "year".  A bucket is a short sorted
+ * list, so both enqueue and dequeue are O(1) on average as long as the
+ * width matches the spacing of the events near the head.
+ *
+ * The number of buckets doubles or halves with the number of events and
+ * every resize re-estimates the width from the separation of the
+ * earliest events.  On top of that the queue watches its own cost: if
+ * enqueues walk long bucket lists or dequeues skip many empty days, the
+ * width no longer fits the inter-event distribution and it is
+ * recomputed, even when the size didn't change.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cal.h"
+#include "system.h"
+
+#define MIN_BUCKETS	16	/* Never shrink below this */
+#define NSAMPLE		25	/* Events sampled to estimate the width */
+#define MAX_COST	4	/* Average steps per operation before re-tuning */
+
+struct cq_node {
+	struct cq_node *next;
+	struct cq_node *prev;
+	struct cal_key key;
+	size_t idx;
+};
+
+/* One day, a sorted doubly linked list */
+struct cq_day {
+	struct cq_node *head;
+	struct cq_node *tail;
+};
+
+struct calq {
+	struct cq_day *bucket;		/* Array of days */
+	size_t nbuckets;		/* Always a power of two */
+	double width;			/* Length of a day */
+	size_t n;			/* Number of entries */
+
+	uint64_t day;			/* Day of the last dequeue */
+	double last_time;		/* Time of the last dequeue */
+	struct cq_node *head;		/* Cached minimum or NULL */
+
+	size_t cost;			/* Steps since the last check */
+	size_t nops;			/* Operations since the last check */
+
+	struct cq_node **node;		/* Entry of each idx or NULL */
+	size_t nnode;			/* Number of elements in node[] */
+	uint64_t seq;			/* Next sequence number */
+	struct arena arena;		/* The entries */
+};
+
+const char calq_name[] = "cq";
+
+/*
+ * Days are numbered from time zero.  Both hashing and the dequeue scan
+ * use this, so rounding can't put an event into a day it isn't looked
+ * for in.
+ */
+static inline uint64_t day_of(const struct calq *q, double t)
+{
+	return (uint64_t) (t / q->width);
+}
+
+static inline size_t bucket_of(const struct calq *q, double t)
+{
+	return (size_t) day_of(q, t) & (q->nbuckets - 1);
+}
+
+/* Point the dequeue cursor at the day containing time T */
+static void set_cursor(struct calq *q, double t)
+{
+	q->last_time = t;
+	q->day = day_of(q, t);
+}
+
+/*
+ * Insert node into its day, keeping the day sorted.  Events usually
+ * come in time order and ties are FIFO, so try the tail first.
+ */
+static void link_node(struct calq *q, struct cq_node *e)
+{
+	struct cq_day *d = &q->bucket[bucket_of(q, e->key.atime)];
+	struct cq_node *next = d->head;
+
+	if (!d->tail || !cal_key_before(&e->key, &d->tail->key)) {
+		next = NULL;
+	} else {
+		while (!cal_key_before(&e->key, &next->key)) {
+			next = next->next;
+			q->cost++;
+		}
+	}
+
+	e->next = next;
+	e->prev = next ? next->prev : d->tail;
+	if (e->prev)
+		e->prev->next = e;
+	else
+		d->head = e;
+	if (next)
+		next->prev = e;
+	else
+		d->tail = e;
+}
+
+static void unlink_node(struct calq *q, struct cq_node *e)
+{
+	struct cq_day *d = &q->bucket[bucket_of(q, e->key.atime)];
+
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		d->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		d->tail = e->prev;
+}
+
+/*
+ * Estimate the day length from the NSAMPLE earliest events: three
+ * times their average separation, ignoring separations more than
+ * twice the average (Brown's heuristic).
+ */
+static double new_width(struct calq *q)
+{
+	double t[NSAMPLE];
+	size_t i, k = 0, cnt;
+	double sum, avg;
+
+	/* Keep the NSAMPLE smallest times, sorted */
+	for (i = 0; i < q->nbuckets; i++) {
+		struct cq_node *e;
+
+		for (e = q->bucket[i].head; e; e = e->next) {
+			size_t j;
+
+			if (k == NSAMPLE && e->key.atime >= t[k - 1])
+				continue;
+			j = k < NSAMPLE ? k++ : k - 1;
+			for (; j > 0 && t[j - 1] > e->key.atime; j--)
+				t[j] = t[j - 1];
+			t[j] = e->key.atime;
+		}
+	}
+
+	if (k < 2)
+		return q->width;
+
+	avg = (t[k - 1] - t[0]) / (k - 1);
+	for (i = 1, sum = 0.0, cnt = 0; i < k; i++) {
+		const double d = t[i] - t[i - 1];
+
+		if (d <= 2.0 * avg) {
+			sum += d;
+			cnt++;
+		}
+	}
+
+	if (!cnt || !(sum > 0.0))
+		return q->width;
+
+	return 3.0 * sum / cnt;
+}
+
+/* Rehash all entries into NB buckets with a freshly estimated width */
+static void resize(struct calq *q, size_t nb)
+{
+	struct cq_day *old = q->bucket;
+	const size_t oldnb = q->nbuckets;
+	size_t i;
+
+	q->width = new_width(q);
+	q->bucket = xcalloc(nb, sizeof(*q->bucket));
+	q->nbuckets = nb;
+
+	for (i = 0; i < oldnb; i++) {
+		struct cq_node *e = old[i].head;
+
+		while (e) {
+			struct cq_node *next = e->next;
+
+			link_node(q, e);
+			e = next;
+		}
+	}
+	free(old);
+
+	set_cursor(q, q->last_time);
+	q->head = NULL;
+	q->cost = q->nops = 0;
+}
+
+/* Count one operation and re-tune the queue if it got too expensive */
+static void account(struct calq *q)
+{
+	if (++q->nops < q->nbuckets)
+		return;
+
+	if (q->cost > MAX_COST * q->nops && q->n > 1)
+		resize(q, q->nbuckets);
+	q->cost = q->nops = 0;
+}
+
+struct calq *calq_new(void)
+{
+	struct calq *q = xcalloc(1, sizeof(*q));
+
+	q->nbuckets = MIN_BUCKETS;
+	q->bucket = xcalloc(q->nbuckets, sizeof(*q->bucket));
+	q->width = 1.0;
+	set_cursor(q, 0.0);
+
+	return q;
+}
+
+/* The entries go with the arena of the calendar */
+void calq_free(struct calq *q)
+{
+	if (!q)
+		return;
+	arena_release(&q->arena);
+
+	free(q->bucket);
+	free(q->node);
+	free(q);
+}
+
+size_t calq_size(struct calq *q)
+{
+	return q->n;
+}
+
+bool calq_pending(struct calq *q, size_t idx)
+{
+	return idx < q->nnode && q->node[idx];
+}
+
+bool calq_cancel(struct calq *q, size_t idx)
+{
+	struct cq_node *e;
+
+	if (!calq_pending(q, idx))
+		return false;
+
+	e = q->node[idx];
+	unlink_node(q, e);
+	if (q->head == e)
+		q->head = NULL;
+	q->node[idx] = NULL;
+	arena_free(&q->arena, e, sizeof(*e));
+
+	if (--q->n < q->nbuckets / 2 && q->nbuckets > MIN_BUCKETS)
+		resize(q, q->nbuckets / 2);
+
+	return true;
+}
+
+void calq_insert(struct calq *q, size_t idx, double atime, int prio)
+{
+	struct cq_node *e;
+
+	if (idx >= q->nnode) {
+		size_t n = q->nnode ?: 64;
+
+		while (n <= idx)
+			n *= 2;
+		q->node = xrealloc(q->node, n * sizeof(*q->node));
+		memset(q->node + q->nnode, 0,
+		       (n - q->nnode) * sizeof(*q->node));
+		q->nnode = n;
+	}
+
+	e = q->node[idx];
+	if (e) {
+		/* Already scheduled, just move it */
+		unlink_node(q, e);
+		if (q->head == e)
+			q->head = NULL;
+	} else {
+		e = arena_alloc(&q->arena, sizeof(*e));
+		e->idx = idx;
+		q->node[idx] = e;
+		q->n++;
+	}
+
+	e->key.atime = atime;
+	e->key.prio = prio;
+	e->key.seq = q->seq++;
+	link_node(q, e);
+
+	/* Scheduled into the past of the cursor, move the cursor back */
+	if (atime < q->last_time)
+		set_cursor(q, atime);
+
+	if (q->head && cal_key_before(&e->key, &q->head->key))
+		q->head = e;
+
+	if (q->n > 2 * q->nbuckets)
+		resize(q, q->nbuckets * 2);
+	else
+		account(q);
+}
+
+static int compare_nodes(const void *a, const void *b)
+{
+	const struct cq_node *x = *(struct cq_node * const *)a;
+	const struct cq_node *y = *(struct cq_node * const *)b;
+
+	return cal_key_before(&x->key, &y->key) ? -1 : 1;
+}
+
+/*
+ * Schedule N consecutive indexes starting with FIRST at once.  The
+ * batch is linked in time order, so every node is appended to the tail
+ * of its day, and then the queue is resized once for the final size.
+ */
+void calq_insert_range(struct calq *q, size_t first, size_t n,
+		       const double *atime, const int *prio)
+{
+	struct cq_node **batch;
+	size_t i, nb;
+
+	if (!n)
+		return;
+
+	if (first + n > q->nnode) {
+		size_t sz = q->nnode ?: 64;
+
+		while (sz < first + n)
+			sz *= 2;
+		q->node = xrealloc(q->node, sz * sizeof(*q->node));
+		memset(q->node + q->nnode, 0,
+		       (sz - q->nnode) * sizeof(*q->node));
+		q->nnode = sz;
+	}
+
+	batch = xmalloc(n * sizeof(*batch));
+	for (i = 0; i < n; i++) {
+		calq_cancel(q, first + i);
+
+		batch[i] = arena_alloc(&q->arena, sizeof(struct cq_node));
+		batch[i]->idx = first + i;
+		batch[i]->key.atime = atime[i];
+		batch[i]->key.prio = prio[i];
+		batch[i]->key.seq = q->seq++;
+		q->node[first + i] = batch[i];
+	}
+	qsort(batch, n, sizeof(*batch), compare_nodes);
+
+	for (i = 0; i < n; i++)
+		link_node(q, batch[i]);
+	q->n += n;
+
+	if (batch[0]->key.atime < q->last_time || q->n == n)
+		set_cursor(q, batch[0]->key.atime);
+	q->head = NULL;
+
+	for (nb = q->nbuckets; q->n > 2 * nb; nb *= 2)
+		;
+	resize(q, nb);
+
+	free(batch);
+}
+
+/* Find the minimum, advancing the cursor day by day */
+static struct cq_node *find_head(struct calq *q)
+{
+	struct cq_node *best = NULL;
+	uint64_t day;
+	size_t i;
+
+	if (q->head || !q->n)
+		return q->head;
+
+	for (day = q->day; day < q->day + q->nbuckets; day++) {
+		struct cq_node *e = q->bucket[day & (q->nbuckets - 1)].head;
+
+		if (e && day_of(q, e->key.atime) == day) {
+			q->cost += day - q->day;
+			q->day = day;
+			q->last_time = e->key.atime;
+			return q->head = e;
+		}
+	}
+
+	/* Nothing in this year, fall back to a direct search */
+	for (i = 0; i < q->nbuckets; i++)
+		if (q->bucket[i].head && (!best
+					  || cal_key_before(&q->bucket[i].head->key,
+							    &best->key)))
+			best = q->bucket[i].head;
+
+	q->cost += 2 * q->nbuckets;
+	set_cursor(q, best->key.atime);
+
+	return q->head = best;
+}
+
+ssize_t calq_head(struct calq *q)
+{
+	struct cq_node *e = find_head(q);
+
+	return e ? (ssize_t) e->idx : -1;
+}
+
+const struct cal_key *calq_head_key(struct calq *q)
+{
+	struct cq_node *e = find_head(q);
+
+	return e ? &e->key : NULL;
+}
+
+void calq_del_head(struct calq *q)
+{
+	struct cq_node *e = find_head(q);
+
+	if (!e)
+		return;
+
+	account(q);
+	calq_cancel(q, e->idx);
+}
+
+/* Visit all entries in storage (not activation) order */
+void calq_walk(struct calq *q,
+	       void (*fn)(size_t, const struct cal_key *, void *), void *arg)
+{
+	size_t i;
+	struct cq_node *e;
+
+	for (i = 0; i < q->nbuckets; i++)
+		for (e = q->bucket[i].head; e; e = e->next)
+			fn(e->idx, &e->key, arg);
+}
@@ -0,0 +1,268 @@
+/*
+ * Implicit d-ary heap calendar.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cal.h"
+#include "system.h"
+
+/*
+ * Arity of the heap.  Four children of 32 bytes each fit into two cache
+ * lines, so a sift-down touches log4(n) lines instead of log2(n).
+ */
+#define HEAP_D		4
+
+/* Position of an idx that isn't in the heap */
+#define NOPOS		SIZE_MAX
+
+#define parent(i)	(((i) - 1) / HEAP_D)
+#define first_child(i)	((i) * HEAP_D + 1)
+
+/* Heap entry, the key is kept inline */
+struct heap_ent {
+	struct cal_key key;
+	size_t idx;
+};
+
+struct calq {
+	struct heap_ent *ent;	/* The heap itself */
+	size_t n;		/* Number of entries */
+	size_t allocated;	/* Allocated entries */
+	size_t *pos;		/* Position of each idx in ent[] or NOPOS */
+	size_t npos;		/* Number of elements in pos[] */
+	uint64_t seq;		/* Next sequence number */
+};
+
+const char calq_name[] = "heap";
+
+struct calq *calq_new(void)
+{
+	return xcalloc(1, sizeof(struct calq));
+}
+
+void calq_free(struct calq *q)
+{
+	if (!q)
+		return;
+	free(q->ent);
+	free(q->pos);
+	free(q);
+}
+
+size_t calq_size(struct calq *q)
+{
+	return q->n;
+}
+
+/* Make sure pos[] can be indexed by IDX */
+static void reserve_pos(struct calq *q, size_t idx)
+{
+	size_t n = q->npos ?: 64;
+
+	if (likely(idx < q->npos))
+		return;
+
+	while (n <= idx)
+		n *= 2;
+	q->pos = xrealloc(q->pos, n * sizeof(*q->pos));
+	memset(q->pos + q->npos, 0xff, (n - q->npos) * sizeof(*q->pos));
+	q->npos = n;
+}
+
+/* Store entry E at position I and keep pos[] in sync */
+static inline void place(struct calq *q, size_t i, const struct heap_ent *e)
+{
+	q->ent[i] = *e;
+	q->pos[e->idx] = i;
+}
+
+static void sift_up(struct calq *q, size_t i)
+{
+	const struct heap_ent e = q->ent[i];
+
+	while (i > 0) {
+		const size_t p = parent(i);
+
+		if (!cal_key_before(&e.key, &q->ent[p].key))
+			break;
+		place(q, i, &q->ent[p]);
+		i = p;
+	}
+	place(q, i, &e);
+}
+
+static void sift_down(struct calq *q, size_t i)
+{
+	const struct heap_ent e = q->ent[i];
+
+	for (;;) {
+		const size_t c = first_child(i);
+		const size_t end = min(c + HEAP_D, q->n);
+		size_t best, j;
+
+		if (c >= q->n)
+			break;
+
+		prefetch(&q->ent[first_child(c)]);
+		for (best = c, j = c + 1; j < end; j++)
+			if (cal_key_before(&q->ent[j].key, &q->ent[best].key))
+				best = j;
+
+		if (!cal_key_before(&q->ent[best].key, &e.key))
+			break;
+		place(q, i, &q->ent[best]);
+		i = best;
+	}
+	place(q, i, &e);
+}
+
+/* Restore the heap property around position I after its key changed */
+static void fix(struct calq *q, size_t i)
+{
+	if (i > 0 && cal_key_before(&q->ent[i].key, &q->ent[parent(i)].key))
+		sift_up(q, i);
+	else
+		sift_down(q, i);
+}
+
+/*
+ * Schedule IDX at time ATIME with priority PRIO.  If IDX is already
+ * pending it is moved, it never gets two entries.
+ */
+void calq_insert(struct calq *q, size_t idx, double atime, int prio)
+{
+	size_t i;
+
+	reserve_pos(q, idx);
+
+	i = q->pos[idx];
+	if (i == NOPOS) {
+		if (q->n == q->allocated) {
+			q->allocated = q->allocated ? q->allocated * 2 : 64;
+			q->ent = xrealloc(q->ent,
+					  q->allocated * sizeof(*q->ent));
+		}
+		i = q->n++;
+	}
+
+	q->ent[i].key.atime = atime;
+	q->ent[i].key.prio = prio;
+	q->ent[i].key.seq = q->seq++;
+	q->ent[i].idx = idx;
+	q->pos[idx] = i;
+	fix(q, i);
+}
+
+/*
+ * Schedule N consecutive indexes starting with FIRST at once.  The
+ * batch is appended and then either sifted up one by one or, when it is
+ * bigger than the heap was, the whole heap is rebuilt bottom-up in O(n).
+ */
+void calq_insert_range(struct calq *q, size_t first, size_t n,
+		       const double *atime, const int *prio)
+{
+	size_t i, old;
+
+	if (!n)
+		return;
+
+	reserve_pos(q, first + n - 1);
+	for (i = 0; i < n; i++)
+		calq_cancel(q, first + i);
+
+	/* Where the new entries start, after the cancelled ones are gone */
+	old = q->n;
+
+	if (q->n + n > q->allocated) {
+		q->allocated = q->allocated ?: 64;
+		while (q->allocated < q->n + n)
+			q->allocated *= 2;
+		q->ent = xrealloc(q->ent, q->allocated * sizeof(*q->ent));
+	}
+
+	for (i = 0; i < n; i++) {
+		struct heap_ent *e = &q->ent[q->n];
+
+		e->key.atime = atime[i];
+		e->key.prio = prio[i];
+		e->key.seq = q->seq++;
+		e->idx = first + i;
+		q->pos[first + i] = q->n++;
+	}
+
+	if (n > old) {
+		for (i = parent(q->n - 1) + 1; i-- > 0;)
+			sift_down(q, i);
+	} else {
+		for (i = old; i < q->n; i++)
+			sift_up(q, i);
+	}
+}
+
+bool calq_pending(struct calq *q, size_t idx)
+{
+	return idx < q->npos && q->pos[idx] != NOPOS;
+}
+
+/* Remove the entry of IDX from the heap */
+bool calq_cancel(struct calq *q, size_t idx)
+{
+	size_t i;
+
+	if (!calq_pending(q, idx))
+		return false;
+
+	i = q->pos[idx];
+	q->pos[idx] = NOPOS;
+	if (i != --q->n) {
+		place(q, i, &q->ent[q->n]);
+		fix(q, i);
+	}
+
+	return true;
+}
+
+ssize_t calq_head(struct calq *q)
+{
+	return q->n ? (ssize_t) q->ent[0].idx : -1;
+}
+
+const struct cal_key *calq_head_key(struct calq *q)
+{
+	return q->n ? &q->ent[0].key : NULL;
+}
+
+void calq_del_head(struct calq *q)
+{
+	if (q->n)
+		calq_cancel(q, q->ent[0].idx);
+}
+
+/* Visit all entries in storage (not activation) order */
+void calq_walk(struct calq *q,
+	       void (*fn)(size_t, const struct cal_key *, void *), void *arg)
+{
+	size_t i;
+
+	for (i = 0; i < q->n; i++)
+		fn(q->ent[i].idx, &q->ent[i].key, arg);
+}
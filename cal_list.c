@@ -0,0 +1,221 @@
+/*
+ * Sorted linked list calendar.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cal.h"
+#include "system.h"
+
+struct calq {
+	struct cal *head;	/* The calendar itself */
+	size_t n;		/* Number of entries */
+	bool *queued;		/* True if idx is in the list */
+	size_t nqueued;		/* Number of elements in queued[] */
+	uint64_t seq;		/* Next sequence number */
+	struct arena arena;	/* The entries */
+};
+
+const char calq_name[] = "list";
+
+/* Iterate over a calendar with prefetching */
+#define cal_for_each(q, pos) \
+	for (pos = (q)->head; pos != NULL; prefetch(pos->next), pos = pos->next)
+
+struct calq *calq_new(void)
+{
+	return xcalloc(1, sizeof(struct calq));
+}
+
+/* The entries go with the arena of the calendar */
+void calq_free(struct calq *q)
+{
+	if (!q)
+		return;
+	arena_release(&q->arena);
+	free(q->queued);
+	free(q);
+}
+
+size_t calq_size(struct calq *q)
+{
+	return q->n;
+}
+
+bool calq_pending(struct calq *q, size_t idx)
+{
+	return idx < q->nqueued && q->queued[idx];
+}
+
+/* Unlink the entry of IDX, O(n) */
+bool calq_cancel(struct calq *q, size_t idx)
+{
+	struct cal **pp = &q->head;
+
+	if (!calq_pending(q, idx))
+		return false;
+
+	while ((*pp)->idx != idx)
+		pp = &(*pp)->next;
+
+	struct cal *tmp = *pp;
+	*pp = tmp->next;
+	arena_free(&q->arena, tmp, sizeof(*tmp));
+	q->queued[idx] = false;
+	q->n--;
+
+	return true;
+}
+
+/* Add new element into calendar */
+void calq_insert(struct calq *q, size_t idx, double atime, int prio)
+{
+	if (idx >= q->nqueued) {
+		size_t n = q->nqueued ?: 64;
+
+		while (n <= idx)
+			n *= 2;
+		q->queued = xrealloc(q->queued, n * sizeof(bool));
+		memset(q->queued + q->nqueued, 0, n - q->nqueued);
+		q->nqueued = n;
+	}
+
+	/* A process has only one activation, drop the old one */
+	calq_cancel(q, idx);
+
+	/* Create a new cal entry */
+	struct cal *new = arena_alloc(&q->arena, sizeof(*new));
+
+	new->idx = idx;
+	new->key.atime = atime;
+	new->key.prio = prio;
+	new->key.seq = q->seq++;
+
+	struct cal *prev = NULL;
+	struct cal *act = q->head;
+
+	/* while act is in cal and new process should be after act */
+	while (act != NULL && !cal_key_before(&new->key, &act->key)) {
+		prev = act;
+		act = act->next;
+	}
+
+	if (prev == NULL) {
+		/* cal is empty, create new head */
+		new->next = act;
+		q->head = new;
+	} else {
+		/* insert item between prev and act */
+		prev->next = new;
+		new->next = act;
+	}
+
+	q->queued[idx] = true;
+	q->n++;
+}
+
+static int compare_nodes(const void *a, const void *b)
+{
+	const struct cal *x = *(struct cal * const *)a;
+	const struct cal *y = *(struct cal * const *)b;
+
+	return cal_key_before(&x->key, &y->key) ? -1 : 1;
+}
+
+/*
+ * Schedule N consecutive indexes starting with FIRST at once: the batch
+ * is sorted and merged into the list in a single pass.
+ */
+void calq_insert_range(struct calq *q, size_t first, size_t n,
+		       const double *atime, const int *prio)
+{
+	struct cal **batch, **pp;
+	size_t i;
+
+	if (!n)
+		return;
+
+	if (first + n > q->nqueued) {
+		size_t sz = q->nqueued ?: 64;
+
+		while (sz < first + n)
+			sz *= 2;
+		q->queued = xrealloc(q->queued, sz * sizeof(bool));
+		memset(q->queued + q->nqueued, 0, sz - q->nqueued);
+		q->nqueued = sz;
+	}
+
+	batch = xmalloc(n * sizeof(*batch));
+	for (i = 0; i < n; i++) {
+		calq_cancel(q, first + i);
+
+		batch[i] = arena_alloc(&q->arena, sizeof(struct cal));
+		batch[i]->idx = first + i;
+		batch[i]->key.atime = atime[i];
+		batch[i]->key.prio = prio[i];
+		batch[i]->key.seq = q->seq++;
+		q->queued[first + i] = true;
+	}
+	qsort(batch, n, sizeof(*batch), compare_nodes);
+
+	/* Merge */
+	for (i = 0, pp = &q->head; i < n; pp = &(*pp)->next) {
+		if (!*pp || cal_key_before(&batch[i]->key, &(*pp)->key)) {
+			batch[i]->next = *pp;
+			*pp = batch[i++];
+		}
+	}
+	q->n += n;
+
+	free(batch);
+}
+
+ssize_t calq_head(struct calq *q)
+{
+	return q->head ? (ssize_t) q->head->idx : -1;
+}
+
+const struct cal_key *calq_head_key(struct calq *q)
+{
+	return q->head ? &q->head->key : NULL;
+}
+
+/* Remove head of the calendar */
+void calq_del_head(struct calq *q)
+{
+	struct cal *tmp = q->head;
+
+	if (tmp) {
+		q->head = tmp->next;
+		q->queued[tmp->idx] = false;
+		q->n--;
+		arena_free(&q->arena, tmp, sizeof(*tmp));
+	}
+}
+
+/* Visit all entries in activation order */
+void calq_walk(struct calq *q,
+	       void (*fn)(size_t, const struct cal_key *, void *), void *arg)
+{
+	struct cal *pos;
+
+	cal_for_each(q, pos)
+		fn(pos->idx, &pos->key, arg);
+}
@@ -0,0 +1,108 @@
+/*
+ * Checks of the statistics.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Run by make check.  Infinite and NaN times must be refused, by the
+ * sketch and by save_time(), without a trace in what was counted.
+ * Exits with failure at the first check that does not hold.
+ */
+
+#include <err.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "error.h"
+#include "sim.h"
+#include "sketch.h"
+#include "stats.h"
+#include "system.h"
+
+static const double bad[] = { INFINITY, -INFINITY, NAN };
+
+#define NBAD	(sizeof(bad) / sizeof(bad[0]))
+
+/* The sketch refuses them and still answers the extreme finite values */
+static void check_sketch(void)
+{
+	struct sketch *sk = sketch_new(0.01), *c;
+	size_t i;
+
+	if (!sk)
+		psimerr("sketch_new");
+	for (i = 0; i < NBAD; i++) {
+		simerr = 0;
+		if (sketch_add(sk, bad[i]) != -1 || simerr != GLOB_INVAL)
+			errx(EXIT_FAILURE, "sketch took %g", bad[i]);
+	}
+	if (sketch_count(sk))
+		errx(EXIT_FAILURE, "sketch counted bad values");
+
+	sketch_add(sk, -DBL_MAX);
+	sketch_add(sk, 0.0);
+	sketch_add(sk, DBL_MAX);
+	c = sketch_copy(sk);
+	if (sketch_count(c) != 3 || !(sketch_quantile(c, 0.0) < -1e300)
+	    || sketch_quantile(c, 0.5) != 0.0
+	    || !(sketch_quantile(c, 1.0) > 1e300))
+		errx(EXIT_FAILURE, "sketch lost the extreme values");
+
+	sketch_free(c);
+	sketch_free(sk);
+}
+
+/* None of the accumulators of the stats sees them */
+static void check_save_time(void)
+{
+	struct stat_t *s = xcalloc(1, sizeof(*s));
+	size_t i;
+
+	stats_keep_times(s, true);
+	if (stats_sketch(s, 0.01) == -1)
+		psimerr("stats_sketch");
+
+	save_time(s, 1.0);
+	for (i = 0; i < NBAD; i++) {
+		simerr = 0;
+		if (save_time(s, bad[i]) != -1 || simerr != GLOB_INVAL)
+			errx(EXIT_FAILURE, "save_time took %g", bad[i]);
+	}
+	save_time(s, 3.0);
+
+	if (times_cnt(s) != 2 || sketch_count(s->sketch) != 2
+	    || s->times.nmemb != 2)
+		errx(EXIT_FAILURE, "save_time counted bad values");
+	if (times_avg(s) != 2.0 || times_max(s) != 3.0
+	    || !isfinite(times_var(s)))
+		errx(EXIT_FAILURE, "bad values got into the moments");
+	if (!(fabs(times_quantile(s, 1.0) - 3.0) < 0.03))
+		errx(EXIT_FAILURE, "bad values got into the quantiles");
+
+	free_times(s);
+	free(s);
+}
+
+int main(void)
+{
+	check_sketch();
+	check_save_time();
+	puts("stats: ok");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,530 @@
+/*
+ * Distributions.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Normals and exponentials come from the ziggurat of Marsaglia and Tsang
+ * (2000): the density is covered by N boxes of equal area, a box is
+ * picked by the low bits of one random number and a point in it by the
+ * rest.  Nearly always the point is under the density and that's all;
+ * only in the wedge of a box a density is evaluated, and the base box
+ * has a tail sampled on its own.
+ *
+ * Gamma is Marsaglia and Tsang's method on top of the normal ziggurat,
+ * Erlang with a small shape is one log() of a product of uniforms.
+ * Discrete and empirical distributions are sampled by the alias method
+ * (Walker, the table built the way of Vose) with one uniform per draw
+ * whatever the number of outcomes.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dist.h"
+#include "error.h"
+#include "rng.h"
+#include "system.h"
+
+/* Boxes of the ziggurats, their right edges and the density there */
+#define ZN	128
+#define ZN_R	3.442619855899
+#define ZN_V	9.91256303526217e-3
+#define ZE	256
+#define ZE_R	7.69711747013104972
+#define ZE_V	3.949659822581572e-3
+
+static double zn_x[ZN + 1], zn_f[ZN + 1];
+static double ze_x[ZE + 1], ze_f[ZE + 1];
+
+/* Erlang of a shape up to this is a product of uniforms */
+#define ERLANG_PRODUCT	16
+
+struct dist {
+	const char *name;
+	double (*sample)(const struct dist *, struct rng *);
+	double p[3];		/* Parameters, as the sampler wants them */
+	double mean;
+
+	/* Alias table of a discrete distribution */
+	size_t n;
+	double *values;
+	double *prob;		/* Take values[i] with this, else the alias */
+	size_t *alias;
+};
+
+static void __attribute__((constructor)) zig_init(void)
+{
+	int i;
+
+	/* Box 0 is the base strip with the tail, it is wider */
+	zn_x[0] = ZN_V / exp(-0.5 * ZN_R * ZN_R);
+	zn_x[1] = ZN_R;
+	for (i = 1; i < ZN; i++) {
+		zn_f[i] = exp(-0.5 * zn_x[i] * zn_x[i]);
+		zn_x[i + 1] = i + 1 < ZN
+		    ? sqrt(-2.0 * log(ZN_V / zn_x[i] + zn_f[i])) : 0.0;
+	}
+	zn_f[0] = 0.0;
+	zn_f[ZN] = 1.0;
+
+	ze_x[0] = ZE_V / exp(-ZE_R);
+	ze_x[1] = ZE_R;
+	for (i = 1; i < ZE; i++) {
+		ze_f[i] = exp(-ze_x[i]);
+		ze_x[i + 1] = i + 1 < ZE
+		    ? -log(ZE_V / ze_x[i] + ze_f[i]) : 0.0;
+	}
+	ze_f[0] = 0.0;
+	ze_f[ZE] = 1.0;
+}
+
+/* Standard normal */
+double zig_normal(struct rng *r)
+{
+	for (;;) {
+		const uint64_t bits = rng_next(r);
+		const unsigned int i = bits & (ZN - 1);
+		/* The top 53 bits make u from <-1; 1) */
+		const double u = (bits >> 11) * 0x1.0p-52 - 1.0;
+		const double x = u * zn_x[i];
+		double a, b;
+
+		if (likely(fabs(x) < zn_x[i + 1]))
+			return x;
+
+		if (i == 0) {
+			/* The tail beyond ZN_R */
+			do {
+				a = -log(1.0 - rng_double(r)) / ZN_R;
+				b = -log(1.0 - rng_double(r));
+			} while (b + b < a * a);
+			return u < 0.0 ? -(ZN_R + a) : ZN_R + a;
+		}
+
+		/* The wedge */
+		if (zn_f[i] + (zn_f[i + 1] - zn_f[i]) * rng_double(r)
+		    < exp(-0.5 * x * x))
+			return x;
+	}
+}
+
+/* Exponential of mean 1 */
+double zig_exponential(struct rng *r)
+{
+	for (;;) {
+		const uint64_t bits = rng_next(r);
+		const unsigned int i = bits & (ZE - 1);
+		const double x = (bits >> 11) * 0x1.0p-53 * ze_x[i];
+
+		if (likely(x < ze_x[i + 1]))
+			return x;
+
+		/* The tail is an exponential again, shifted */
+		if (i == 0)
+			return ZE_R - log(1.0 - rng_double(r));
+
+		if (ze_f[i] + (ze_f[i + 1] - ze_f[i]) * rng_double(r) < exp(-x))
+			return x;
+	}
+}
+
+static struct dist *new_dist(const char *name,
+			     double (*sample)(const struct dist *,
+					      struct rng *), double mean)
+{
+	struct dist *d = xcalloc(1, sizeof(*d));
+
+	d->name = name;
+	d->sample = sample;
+	d->mean = mean;
+
+	return d;
+}
+
+static struct dist *inval(void)
+{
+	simerr = GLOB_INVAL;
+	return NULL;
+}
+
+static double sample_normal(const struct dist *d, struct rng *r)
+{
+	return d->p[0] + d->p[1] * zig_normal(r);
+}
+
+/* Normal of MEAN and standard deviation SD */
+struct dist *dist_normal(double mean, double sd)
+{
+	struct dist *d;
+
+	if (!isfinite(mean) || !(sd > 0.0 && isfinite(sd)))
+		return inval();
+
+	d = new_dist("normal", sample_normal, mean);
+	d->p[0] = mean;
+	d->p[1] = sd;
+	return d;
+}
+
+static double sample_exponential(const struct dist *d, struct rng *r)
+{
+	return d->p[0] * zig_exponential(r);
+}
+
+/* Exponential of MEAN */
+struct dist *dist_exponential(double mean)
+{
+	struct dist *d;
+
+	if (!(mean > 0.0 && isfinite(mean)))
+		return inval();
+
+	d = new_dist("exponential", sample_exponential, mean);
+	d->p[0] = mean;
+	return d;
+}
+
+/* Gamma of shape p[0] >= 1 and scale p[1], Marsaglia and Tsang */
+static double gamma_big(double shape, double scale, struct rng *r)
+{
+	const double dd = shape - 1.0 / 3.0;
+	const double c = 1.0 / sqrt(9.0 * dd);
+
+	for (;;) {
+		double x, v, u;
+
+		do {
+			x = zig_normal(r);
+			v = 1.0 + c * x;
+		} while (v <= 0.0);
+
+		v = v * v * v;
+		u = 1.0 - rng_double(r);
+		if (u < 1.0 - 0.0331 * x * x * x * x
+		    || log(u) < 0.5 * x * x + dd * (1.0 - v + log(v)))
+			return dd * v * scale;
+	}
+}
+
+static double sample_gamma(const struct dist *d, struct rng *r)
+{
+	const double shape = d->p[0];
+
+	if (shape >= 1.0)
+		return gamma_big(shape, d->p[1], r);
+
+	/* Gamma(a) = Gamma(a + 1) U^(1/a) */
+	return gamma_big(shape + 1.0, d->p[1], r)
+	       * pow(1.0 - rng_double(r), 1.0 / shape);
+}
+
+/* Gamma of SHAPE and SCALE, the mean is their product */
+struct dist *dist_gamma(double shape, double scale)
+{
+	struct dist *d;
+
+	if (!(shape > 0.0 && isfinite(shape))
+	    || !(scale > 0.0 && isfinite(scale)))
+		return inval();
+
+	d = new_dist("gamma", sample_gamma, shape * scale);
+	d->p[0] = shape;
+	d->p[1] = scale;
+	return d;
+}
+
+/* Sum of p[0] exponentials of mean p[1] */
+static double sample_erlang(const struct dist *d, struct rng *r)
+{
+	const unsigned int k = (unsigned int) d->p[0];
+	double prod = 1.0;
+	unsigned int i;
+
+	for (i = 0; i < k; i++)
+		prod *= 1.0 - rng_double(r);
+	return -d->p[1] * log(prod);
+}
+
+/* Erlang of K phases with MEAN in total */
+struct dist *dist_erlang(unsigned int k, double mean)
+{
+	struct dist *d;
+
+	if (!k || !(mean > 0.0 && isfinite(mean)))
+		return inval();
+
+	if (k > ERLANG_PRODUCT) {
+		d = dist_gamma(k, mean / k);
+		d->name = "erlang";
+		return d;
+	}
+
+	d = new_dist("erlang", sample_erlang, mean);
+	d->p[0] = k;
+	d->p[1] = mean / k;
+	return d;
+}
+
+static double sample_weibull(const struct dist *d, struct rng *r)
+{
+	return d->p[1] * pow(zig_exponential(r), d->p[0]);
+}
+
+/* Weibull of SHAPE and SCALE */
+struct dist *dist_weibull(double shape, double scale)
+{
+	struct dist *d;
+
+	if (!(shape > 0.0 && isfinite(shape))
+	    || !(scale > 0.0 && isfinite(scale)))
+		return inval();
+
+	d = new_dist("weibull", sample_weibull,
+		     scale * tgamma(1.0 + 1.0 / shape));
+	d->p[0] = 1.0 / shape;
+	d->p[1] = scale;
+	return d;
+}
+
+static double sample_lognormal(const struct dist *d, struct rng *r)
+{
+	return exp(d->p[0] + d->p[1] * zig_normal(r));
+}
+
+/* Lognormal, its log is normal of MU and standard deviation SIGMA */
+struct dist *dist_lognormal(double mu, double sigma)
+{
+	struct dist *d;
+
+	if (!isfinite(mu) || !(sigma > 0.0 && isfinite(sigma)))
+		return inval();
+
+	d = new_dist("lognormal", sample_lognormal,
+		     exp(mu + 0.5 * sigma * sigma));
+	d->p[0] = mu;
+	d->p[1] = sigma;
+	return d;
+}
+
+/* Inverse of the distribution function, p[] is min, mode and max */
+static double sample_triangular(const struct dist *d, struct rng *r)
+{
+	const double a = d->p[0], c = d->p[1], b = d->p[2];
+	const double u = rng_double(r);
+
+	if (u * (b - a) < c - a)
+		return a + sqrt(u * (b - a) * (c - a));
+	return b - sqrt((1.0 - u) * (b - a) * (b - c));
+}
+
+/* Triangular on <MIN; MAX> with its peak at MODE */
+struct dist *dist_triangular(double min, double mode, double max)
+{
+	struct dist *d;
+
+	if (!isfinite(min) || !isfinite(max) || !(min < max)
+	    || !(min <= mode && mode <= max))
+		return inval();
+
+	d = new_dist("triangular", sample_triangular,
+		     (min + mode + max) / 3.0);
+	d->p[0] = min;
+	d->p[1] = mode;
+	d->p[2] = max;
+	return d;
+}
+
+static double sample_alias(const struct dist *d, struct rng *r)
+{
+	const double u = rng_double(r) * d->n;
+	size_t i = (size_t) u;
+
+	/* Rounding may get u up to n */
+	if (unlikely(i >= d->n))
+		i = d->n - 1;
+	return u - i < d->prob[i] ? d->values[i] : d->values[d->alias[i]];
+}
+
+/* Alias table of D from its N values and WEIGHTS summing up to SUM */
+static void build_alias(struct dist *d, const double *weights, double sum)
+{
+	const size_t n = d->n;
+	size_t *small = xmalloc(n * sizeof(*small));
+	size_t *large = xmalloc(n * sizeof(*large));
+	double *p = xmalloc(n * sizeof(*p));
+	size_t ns = 0, nl = 0, i;
+
+	d->prob = xmalloc(n * sizeof(*d->prob));
+	d->alias = xmalloc(n * sizeof(*d->alias));
+
+	for (i = 0; i < n; i++) {
+		p[i] = weights[i] * n / sum;
+		if (p[i] < 1.0)
+			small[ns++] = i;
+		else
+			large[nl++] = i;
+	}
+
+	/* Fill up every small column with a piece of a large one */
+	while (ns && nl) {
+		const size_t s = small[--ns], l = large[nl - 1];
+
+		d->prob[s] = p[s];
+		d->alias[s] = l;
+		p[l] -= 1.0 - p[s];
+		if (p[l] < 1.0) {
+			nl--;
+			small[ns++] = l;
+		}
+	}
+
+	/* What's left is full, up to rounding */
+	while (nl) {
+		i = large[--nl];
+		d->prob[i] = 1.0;
+		d->alias[i] = i;
+	}
+	while (ns) {
+		i = small[--ns];
+		d->prob[i] = 1.0;
+		d->alias[i] = i;
+	}
+
+	free(small);
+	free(large);
+	free(p);
+}
+
+/* N VALUES, VALUES[i] comes with the probability of WEIGHTS[i] */
+struct dist *dist_discrete(const double *values, const double *weights,
+			   size_t n)
+{
+	double sum = 0.0, mean = 0.0;
+	struct dist *d;
+	size_t i;
+
+	if (!n)
+		return inval();
+	for (i = 0; i < n; i++) {
+		if (!isfinite(values[i]) || !(weights[i] >= 0.0)
+		    || !isfinite(weights[i]))
+			return inval();
+		sum += weights[i];
+		mean += values[i] * weights[i];
+	}
+	if (!(sum > 0.0) || !isfinite(sum))
+		return inval();
+
+	d = new_dist("discrete", sample_alias, mean / sum);
+	d->n = n;
+	d->values = xmalloc(n * sizeof(*d->values));
+	memcpy(d->values, values, n * sizeof(*values));
+	build_alias(d, weights, sum);
+
+	return d;
+}
+
+static int compare(const void *a1, const void *b1)
+{
+	const double a = *(const double *) a1;
+	const double b = *(const double *) b1;
+
+	return a < b ? -1 : a > b;
+}
+
+/* The N observed values of DATA, every one of them equally likely */
+struct dist *dist_empirical(const double *data, size_t n)
+{
+	double *v, *w;
+	struct dist *d;
+	size_t i, k;
+
+	if (!n)
+		return inval();
+
+	v = xmalloc(n * sizeof(*v));
+	w = xmalloc(n * sizeof(*w));
+	memcpy(v, data, n * sizeof(*v));
+	qsort(v, n, sizeof(*v), compare);
+
+	/* Values seen more times get their counts as weights */
+	for (i = k = 0; i < n; i++) {
+		if (k && v[k - 1] == v[i]) {
+			w[k - 1] += 1.0;
+			continue;
+		}
+		v[k] = v[i];
+		w[k++] = 1.0;
+	}
+
+	d = dist_discrete(v, w, k);
+	if (d)
+		d->name = "empirical";
+	free(v);
+	free(w);
+
+	return d;
+}
+
+void dist_free(struct dist *d)
+{
+	if (!d)
+		return;
+	free(d->values);
+	free(d->prob);
+	free(d->alias);
+	free(d);
+}
+
+/* Sample D, drawing from stream R */
+double dist_sample(const struct dist *d, struct rng *r)
+{
+	return d->sample(d, r);
+}
+
+const char *dist_name(const struct dist *d)
+{
+	return d->name;
+}
+
+/* Mean of D, as it follows from the parameters */
+double dist_mean(const struct dist *d)
+{
+	return d->mean;
+}
+
+/* Samples of D a second, measured on N samples drawn from R */
+double dist_rate(const struct dist *d, struct rng *r, size_t n)
+{
+	struct timespec t0, t1;
+	volatile double sink;
+	double sum = 0.0, t;
+	size_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++)
+		sum += d->sample(d, r);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sink = sum;
+	(void) sink;
+
+	t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	return t > 0.0 ? n / t : INFINITY;
+}
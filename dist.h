@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _DIST_H_
+#define _DIST_H_
+
+#include <stddef.h>
+#include "rng.h"
+
+/*
+ * Distributions.  One is made once with its parameters, which are
+ * checked and turned into whatever makes sampling cheap (the alias table
+ * of a discrete distribution, say), and then sampled from any stream
+ * as many times as needed.  A distribution is only read when sampled,
+ * so any number of processes and threads may share it.
+ *
+ * The constructors return NULL and set simerr to GLOB_INVAL when the
+ * parameters make no sense.
+ */
+struct dist;
+
+extern struct dist *dist_normal(double, double);
+extern struct dist *dist_exponential(double);
+extern struct dist *dist_erlang(unsigned int, double);
+extern struct dist *dist_gamma(double, double);
+extern struct dist *dist_weibull(double, double);
+extern struct dist *dist_lognormal(double, double);
+extern struct dist *dist_triangular(double, double, double);
+extern struct dist *dist_discrete(const double *, const double *, size_t);
+extern struct dist *dist_empirical(const double *, size_t);
+extern void dist_free(struct dist *);
+
+extern double dist_sample(const struct dist *, struct rng *);
+extern const char *dist_name(const struct dist *);
+extern double dist_mean(const struct dist *);
+extern double dist_rate(const struct dist *, struct rng *, size_t);
+
+/* Ziggurat samplers of the standard normal and exponential */
+extern double zig_normal(struct rng *);
+extern double zig_exponential(struct rng *);
+
+#endif /* _DIST_H_ */
@@ -20,14 +20,6 @@
 #include <stdio.h>
 #include "error.h"
 
-/*
- * Global error number variable
- * This differs from plain `int errno;' in that it doesn't create
- * a common definition, but a plain symbol that resides in .bss,
- * which can have an alias.
- */
-int simerr __attribute__ ((nocommon));
-
 /* Error strings */
 static const char *const strs[] = {
 	[GLOB_NOTINIT] = "simulation not initialized",
@@ -18,11 +18,14 @@
 #ifndef _ERROR_H_
 #define _ERROR_H_
 
+#include "sim.h"
+
 /* Error codes */
 #define GLOB_NOTINIT	1	/* Simulation not initialized */
 #define GLOB_INVAL	2	/* Invalid arguments */
 
-extern int simerr;
+/* Error number of the simulation bound to the calling thread */
+#define simerr	(sim_self()->err)
 
 extern void psimerr(const char *);
 extern const char *errstr(int);
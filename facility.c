@@ -37,28 +37,28 @@
 #include "facility.h"
 #include "process.h"
 #include "cal.h"
-
-#define debug(fmt, ...) fprintf(stderr, fmt "\n", ## __VA_ARGS__)
-//#define debug(fmt, ...) ((void)0)
+#include "trace.h"
 
 #define INTERNAL_ERROR(errstr)	\
 	errx(EXIT_FAILURE, _("%s(): INTERNAL ERROR at line %d (%s-%s): %s"),	\
 	__func__, __LINE__, VERSION, __DATE__, errstr)
 
+/* Last facility number given out */
+static unsigned int last_id;
+
 /*
  * Initialization of the facility
  */
 void fac_constructor(struct facility_t *fac)
 {
+	fac->id = __atomic_add_fetch(&last_id, 1, __ATOMIC_RELAXED);
 	fac->name = NULL;
 	fac->busy = false;
 	fac->queue = NULL;
 	fac->idx = (ssize_t) - 1;
 	fac->stats = xcalloc(1, sizeof(struct stat_t));
-	/* Initialize lock and cond */
-	if (pthread_mutex_init(&fac->flock, NULL)
-	    || pthread_cond_init(&fac->fcond, NULL))
-		err(EXIT_FAILURE, _("pthread init failed"));
+	memset(&fac->util, 0, sizeof(fac->util));
+	memset(&fac->qlen, 0, sizeof(fac->qlen));
 }
 
 void fac_clear(struct facility_t *fac)
@@ -66,22 +66,22 @@ void fac_clear(struct facility_t *fac)
 	free(fac->name);
 	fac->name = NULL;
 	fac->busy = false;
-	free(fac->queue);
-	fac->queue = NULL;
+	pq_clear(&fac->queue);
 	fac->idx = (ssize_t) - 1;
+	memset(&fac->util, 0, sizeof(fac->util));
+	memset(&fac->qlen, 0, sizeof(fac->qlen));
 }
 
 /*
- * Free all allocated memory for the facility
+ * Free all allocated memory for the facility.
+ * Queue nodes belong to the arena of the simulation and go away with it.
  */
 void fac_destructor(struct facility_t *fac)
 {
 	free(fac->name);
-	free(fac->queue);
+	fac->queue = NULL;
+	free_times(fac->stats);
 	free(fac->stats);
-	/* Destroy lock and cond */
-	pthread_cond_destroy(&fac->fcond);
-	pthread_mutex_destroy(&fac->flock);
 }
 
 /*
@@ -107,26 +107,39 @@ char *fac_get_name(struct facility_t *fac)
 	return fac->name;
 }
 
-void Seize(struct facility_t *fac, size_t idx)
+/*
+ * Process idx asks for the facility.  Returns true if it got it, false
+ * if it was queued; Release() then hands the facility over to it and
+ * activates it.
+ */
+bool fac_request(struct facility_t *fac, size_t idx)
 {
 	if (!fac_busy(fac)) {
-		// zamkni
-		pthread_mutex_lock(&fac->flock);
 		// obsad
 		fac->idx = idx;
 		fac->busy = true;
-	} else {
-		// musime jit do fronty
-		fac_queue_in(fac, idx);
-		// rekneme kalndari at spusti dalsi proces
-		pthread_cond_signal(&process_list[idx].cond);
-		// cekame dokud nas zarizeni samo nenatahne dovnitr
-		if (fac->idx == (ssize_t) idx)
-			return;
-		do {
-			pthread_cond_wait(&fac->fcond, &fac->flock);
-		} while (fac->idx != (ssize_t) idx);
+		tstat_set(&fac->util, 1.0);
+		trace(TRACE_RESOURCE, TR_SEIZE, cur_time, idx,
+		      PROC(idx).state, fac->id, 0);
+		return true;
 	}
+
+	// musime jit do fronty
+	fac_queue_in(fac, idx);
+	trace(TRACE_RESOURCE, TR_FAC_QUEUE, cur_time, idx,
+	      PROC(idx).state, fac->id, fac_queue_len(fac));
+	return false;
+}
+
+/*
+ * Process idx seizes the facility.  If it is busy, the process is
+ * stopped until it gets it.
+ */
+void (Seize)(struct facility_t *fac, size_t idx)
+{
+	// cekame dokud nas zarizeni samo nenatahne dovnitr
+	if (!fac_request(fac, idx))
+		process_yield(idx);
 }
 
 /*
@@ -136,25 +149,26 @@ void Seize(struct facility_t *fac, size_t idx)
 void Release(struct facility_t *fac)
 {
 	// uvolneni
+	trace(TRACE_RESOURCE, TR_RELEASE, cur_time, fac->idx,
+	      PROC(fac->idx).state, fac->id, 0);
 	fac->idx = (ssize_t) - 1;
 	fac->busy = false;
-	// odemceni
-	pthread_mutex_unlock(&fac->flock);
 
 	if (!pq_empty(&fac->queue)) {
-		pthread_mutex_lock(&fac->flock);
 		// vybrat dalsi prvek
 		// pustit ho
 		fac->idx = pq_top(&fac->queue);
 		pq_pop(&fac->queue);
+		tstat_add(&fac->qlen, -1.0);
 		fac->busy = true;
-		process_list[fac->idx].atime = cur_time;
+		trace(TRACE_RESOURCE, TR_SEIZE, cur_time, fac->idx,
+		      PROC(fac->idx).state, fac->id, 0);
+		PROC(fac->idx).atime = cur_time;
 		add_elem(fac->idx);
-
-		pthread_cond_broadcast(&fac->fcond);
-
-		pthread_mutex_unlock(&fac->flock);
+		return;
 	}
+
+	tstat_set(&fac->util, 0.0);
 }
 
 /*
@@ -176,4 +190,31 @@ size_t fac_queue_len(struct facility_t * fac)
 void fac_queue_in(struct facility_t *fac, size_t idx)
 {
 	pq_push(&fac->queue, idx);
+	tstat_add(&fac->qlen, 1.0);
+}
+
+/*
+ * Time-weighted stats of the facility, up to now since the start of the
+ * simulation or since the tstats were reset.
+ */
+
+/* Busy part of the time */
+double fac_util(struct facility_t *fac)
+{
+	return tstat_avg(&fac->util);
+}
+
+double fac_busy_time(struct facility_t *fac)
+{
+	return tstat_area(&fac->util);
+}
+
+double fac_queue_avg(struct facility_t *fac)
+{
+	return tstat_avg(&fac->qlen);
+}
+
+double fac_queue_max(struct facility_t *fac)
+{
+	return tstat_max(&fac->qlen);
 }
@@ -19,17 +19,22 @@
 #ifndef _FACILITY_H_
 #define _FACILITY_H_
 
-#include <pthread.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "process.h"
 #include "queue.h"
+#include "stats.h"
+#include "system.h"
 
 struct facility_t {
 	char *name;		/* name of facility */
 	bool busy;		/* true if facility is busy */
 	struct pq_t *queue;	/* priority queue for pending processes */
 	struct stat_t *stats;  /* stats of facility */
+	struct tstat util;	/* 1 while busy, 0 while idle */
+	struct tstat qlen;	/* length of the queue */
 	ssize_t idx;		/* index of serving process */
-	pthread_cond_t fcond;
-	pthread_mutex_t flock;
+	unsigned int id;	/* facility number in traces */
 };
 
 void fac_constructor(struct facility_t *);
@@ -41,10 +46,20 @@ char *fac_get_name(struct facility_t *);
 
 bool fac_busy(struct facility_t *);
 
-void Seize(struct facility_t *, size_t);
+bool fac_request(struct facility_t *, size_t);
+void (Seize)(struct facility_t *, size_t);
 void Release(struct facility_t *);
 
 size_t fac_queue_len(struct facility_t *);
 void fac_queue_in(struct facility_t *, size_t);
 
+double fac_util(struct facility_t *);
+double fac_busy_time(struct facility_t *);
+double fac_queue_avg(struct facility_t *);
+double fac_queue_max(struct facility_t *);
+
+/* Seize(fac) seizes the facility for the running process */
+#define Seize(...) __PICK2(__VA_ARGS__, (Seize), __seize_self, )(__VA_ARGS__)
+#define __seize_self(fac) (Seize)((fac), CURRENT())
+
 #endif				/* _FACILITY_H_ */
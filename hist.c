@@ -0,0 +1,280 @@
+/*
+ * Histograms.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * A value finds its bin with one multiplication for linear bins and with
+ * frexp() for log-linear ones: the exponent picks the power of two, the
+ * mantissa the bin inside it.  No log() and no search.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "hist.h"
+#include "stats.h"
+#include "system.h"
+
+/* Widest bar hist_print() draws */
+#define HIST_WIDTH	64
+
+enum hist_kind {
+	HIST_LINEAR,
+	HIST_LOG,
+};
+
+struct hist {
+	enum hist_kind kind;
+	double lo, hi;		/* The bins cover <lo; hi) */
+	size_t nbins;
+	double inv_width;	/* Linear: bins per unit */
+	unsigned int sub;	/* Log-linear: bins per power of two */
+	int exp;		/* Log-linear: lo is 2^exp */
+	uint64_t under, over;
+	uint64_t n;
+	uint64_t counts[];
+};
+
+static struct hist *new_hist(enum hist_kind kind, double lo, double hi,
+			     size_t nbins)
+{
+	struct hist *h = xcalloc(1, sizeof(*h) + nbins * sizeof(uint64_t));
+
+	h->kind = kind;
+	h->lo = lo;
+	h->hi = hi;
+	h->nbins = nbins;
+
+	return h;
+}
+
+/*
+ * NBINS bins equally wide over <LO; HI).  Returns NULL and sets simerr
+ * to GLOB_INVAL for bad arguments.
+ */
+struct hist *hist_linear(double lo, double hi, size_t nbins)
+{
+	struct hist *h;
+
+	if (!nbins || !isfinite(lo) || !isfinite(hi) || !(lo < hi)) {
+		simerr = GLOB_INVAL;
+		return NULL;
+	}
+
+	h = new_hist(HIST_LINEAR, lo, hi, nbins);
+	h->inv_width = nbins / (hi - lo);
+	return h;
+}
+
+/*
+ * SUB bins to every power of two from the one LO is in up to the one HI
+ * is in, so the bins go from at most LO up to at least HI.  LO must be
+ * positive.
+ */
+struct hist *hist_log(double lo, double hi, unsigned int sub)
+{
+	int elo, ehi;
+	double m;
+	struct hist *h;
+
+	if (!sub || sub > 1U << 20 || !(lo > 0.0) || !isfinite(hi)
+	    || !(lo < hi)) {
+		simerr = GLOB_INVAL;
+		return NULL;
+	}
+
+	/* x = m 2^e, m from <1/2; 1) */
+	frexp(lo, &elo);
+	elo--;
+	m = frexp(hi, &ehi);
+	if (m == 0.5)
+		ehi--;
+
+	h = new_hist(HIST_LOG, ldexp(1.0, elo), ldexp(1.0, ehi),
+		     (size_t) (ehi - elo) * sub);
+	h->sub = sub;
+	h->exp = elo;
+	return h;
+}
+
+void hist_free(struct hist *h)
+{
+	free(h);
+}
+
+/* Empty all the bins of H */
+void hist_clear(struct hist *h)
+{
+	memset(h->counts, 0, h->nbins * sizeof(uint64_t));
+	h->under = h->over = h->n = 0;
+}
+
+void hist_add(struct hist *h, double x)
+{
+	size_t i;
+	double m;
+	int e;
+
+	h->n++;
+	if (!(x >= h->lo)) {
+		h->under++;
+		return;
+	}
+	if (x >= h->hi) {
+		h->over++;
+		return;
+	}
+
+	if (h->kind == HIST_LINEAR) {
+		i = (size_t) ((x - h->lo) * h->inv_width);
+	} else {
+		m = frexp(x, &e);
+		i = (size_t) (e - 1 - h->exp) * h->sub
+		    + (size_t) ((2.0 * m - 1.0) * h->sub);
+	}
+
+	/* Rounding may get a value just below hi past the last bin */
+	h->counts[min(i, h->nbins - 1)]++;
+}
+
+/*
+ * Add the counts of SRC to DST.  Both must have the same bins; returns
+ * -1 and sets simerr to GLOB_INVAL otherwise.
+ */
+int hist_merge(struct hist *dst, const struct hist *src)
+{
+	size_t i;
+
+	if (dst->kind != src->kind || dst->lo != src->lo
+	    || dst->hi != src->hi || dst->nbins != src->nbins) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	for (i = 0; i < dst->nbins; i++)
+		dst->counts[i] += src->counts[i];
+	dst->under += src->under;
+	dst->over += src->over;
+	dst->n += src->n;
+
+	return 0;
+}
+
+/* A new histogram with the bins and the counts of H */
+struct hist *hist_copy(const struct hist *h)
+{
+	const size_t size = sizeof(*h) + h->nbins * sizeof(uint64_t);
+
+	return memcpy(xmalloc(size), h, size);
+}
+
+size_t hist_nbins(const struct hist *h)
+{
+	return h->nbins;
+}
+
+/* Count in bin I of H, its bounds go to FROM and TO if not NULL */
+uint64_t hist_bin(const struct hist *h, size_t i, double *from, double *to)
+{
+	double a, b;
+
+	if (h->kind == HIST_LINEAR) {
+		a = h->lo + i / h->inv_width;
+		b = i + 1 == h->nbins ? h->hi : h->lo + (i + 1) / h->inv_width;
+	} else {
+		const double base = ldexp(1.0, h->exp + (int) (i / h->sub));
+		const unsigned int j = i % h->sub;
+
+		a = base * (1.0 + (double) j / h->sub);
+		b = base * (1.0 + (double) (j + 1) / h->sub);
+	}
+
+	if (from)
+		*from = a;
+	if (to)
+		*to = b;
+	return h->counts[i];
+}
+
+/* Values below the first bin */
+uint64_t hist_under(const struct hist *h)
+{
+	return h->under;
+}
+
+/* Values from the end of the last bin up */
+uint64_t hist_over(const struct hist *h)
+{
+	return h->over;
+}
+
+uint64_t hist_count(const struct hist *h)
+{
+	return h->n;
+}
+
+/*
+ * Print H as bars of HISTOGRAM_SYMBOL, one a value until the biggest bin
+ * would be wider than HIST_WIDTH, scaled down after that.
+ */
+void hist_print(const struct hist *h, FILE *fp)
+{
+	uint64_t top = max(h->under, h->over), per, c, k;
+	double from, to;
+	size_t i;
+
+	for (i = 0; i < h->nbins; i++)
+		top = max(top, h->counts[i]);
+	per = top > HIST_WIDTH ? (top + HIST_WIDTH - 1) / HIST_WIDTH : 1;
+	if (per > 1)
+		fprintf(fp, "(%c is %llu values)\n", HISTOGRAM_SYMBOL,
+			(unsigned long long) per);
+
+	if (h->under)
+		fprintf(fp, "< %8s; %8.4g ): %llu\n", "-inf", h->lo,
+			(unsigned long long) h->under);
+	for (i = 0; i < h->nbins; i++) {
+		c = hist_bin(h, i, &from, &to);
+		fprintf(fp, "< %8.4g; %8.4g ): ", from, to);
+		for (k = 0; k < (c + per - 1) / per; k++)
+			fputc(HISTOGRAM_SYMBOL, fp);
+		if (per > 1 && c)
+			fprintf(fp, " %llu", (unsigned long long) c);
+		fputc('\n', fp);
+	}
+	if (h->over)
+		fprintf(fp, "< %8.4g; %8s ): %llu\n", h->hi, "inf",
+			(unsigned long long) h->over);
+}
+
+/* Write H for other programs, a "from to count" line a bin */
+void hist_write(const struct hist *h, FILE *fp)
+{
+	double from, to;
+	uint64_t c;
+	size_t i;
+
+	fprintf(fp, "-inf %.17g %llu\n", h->lo, (unsigned long long) h->under);
+	for (i = 0; i < h->nbins; i++) {
+		c = hist_bin(h, i, &from, &to);
+		fprintf(fp, "%.17g %.17g %llu\n", from, to,
+			(unsigned long long) c);
+	}
+	fprintf(fp, "%.17g inf %llu\n", h->hi, (unsigned long long) h->over);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _HIST_H_
+#define _HIST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Histogram of bins fixed when it is made, filled one value at a time.
+ * Linear bins are all equally wide.  Log-linear bins split every power
+ * of two into equally wide bins, so they are about equally wide
+ * relative to their values.  Values below the first bin and from the
+ * last one up are counted apart.
+ */
+struct hist;
+
+extern struct hist *hist_linear(double, double, size_t);
+extern struct hist *hist_log(double, double, unsigned int);
+extern void hist_free(struct hist *);
+extern void hist_clear(struct hist *);
+extern void hist_add(struct hist *, double);
+extern int hist_merge(struct hist *, const struct hist *);
+extern struct hist *hist_copy(const struct hist *);
+extern size_t hist_nbins(const struct hist *);
+extern uint64_t hist_bin(const struct hist *, size_t, double *, double *);
+extern uint64_t hist_under(const struct hist *);
+extern uint64_t hist_over(const struct hist *);
+extern uint64_t hist_count(const struct hist *);
+extern void hist_print(const struct hist *, FILE *);
+extern void hist_write(const struct hist *, FILE *);
+
+#endif /* _HIST_H_ */
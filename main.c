@@ -28,6 +28,12 @@ struct facility_t fac;
 /* Number of sewers in the facility */
 static const unsigned int sewers = 10;
 
+/* Every other customer has a higher priority */
+static int customer_prio(size_t i)
+{
+	return i % 2;
+}
+
 static void *foo(void *arg __unused__)
 {
 	/* actual time */
@@ -35,7 +41,7 @@ static void *foo(void *arg __unused__)
 
 	/* seize the facility */
 	debug("< Seize(fac)   PID: %d >", CURRENT());
-	Seize(&fac, CURRENT());
+	Seize(&fac);
 
 	/* after succesfull seize, save time into stats */
 	save_time(fac.stats, cur_time - _time);
@@ -60,15 +66,15 @@ int main(void)
 	/* Facility initialization */
 	fac_constructor(&fac);
 	fac_set_name(&fac, "Facility");
+	stats_keep_times(fac.stats, true);
 
 	/* Simulation initialization */
 	if (Init(0.0, 100.0) == -1)
 		psimerr("init");
 
-	/* Generating processes */
-	for (unsigned i = 0; i < sewers; ++i)
-		/* creating process with priority */
-		create_process(foo, i % 2);
+	/* Generating processes, all of them at once */
+	if (create_processes(foo, sewers, customer_prio, NULL) == -1)
+		psimerr("create_processes");
 
 	/* Runnig the simulation */
 	Run();
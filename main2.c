@@ -32,13 +32,13 @@ static void *foo(void *arg __unused__)
 {
 	double _time = cur_time;
 	debug("< Enter(store)   PID: %d >", CURRENT());
-	Enter(&store, CURRENT(), 20);
+	Enter(&store, 20);
 	debug("VE FRONTE %f", cur_time - _time);
 	save_time(store.stats, cur_time - _time);
 	debug("< Wait(store)    PID: %d >", CURRENT());
 	Wait(Exponential(4.50));
 	debug("< Leave(store)   PID: %d >", CURRENT());
-	Leave(&store, CURRENT(), 20);
+	Leave(&store, 20);
 
 	debug("< Quit()          PID: %d >", CURRENT());
 	Quit();
@@ -52,6 +52,7 @@ int main(void)
 	store_constructor(&store);
 	store_set_capacity(&store, 30);
 	store_set_name(&store, "Store");
+	stats_keep_times(store.stats, true);
 
 	/* Simulation initialization */
 	if (Init(0.0, 100.0) == -1)
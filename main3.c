@@ -0,0 +1,124 @@
+#if _POSIX_THREAD_SAFE_FUNCTIONS == -1
+#error Thread safe functions not available
+#endif
+
+#include <assert.h>
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "facility.h"
+#include "cal.h"
+#include "queue.h"
+#include "store.h"
+#include "error.h"
+#include "process.h"
+#include "system.h"
+#include "stats.h"
+
+/*
+ * Customers park in a small car park (a store) and then queue at one
+ * counter (a facility).  Half of them are ordinary processes, the other
+ * half are handlers without a stack; both kinds share the resources.
+ */
+
+/* Facilities and stores */
+struct facility_t fac;
+struct store_t park;
+
+/* Number of customers of each kind */
+static const unsigned int customers = 10;
+
+/* A handler customer, it remembers where it is */
+struct customer {
+	enum { PARKING, QUEUEING, SERVED, DONE } phase;
+	double arrived;
+};
+
+static void *process_customer(void *arg __unused__)
+{
+	double _time = cur_time;
+
+	Enter(&park, 1);
+	Seize(&fac);
+	save_time(fac.stats, cur_time - _time);
+	Wait(Exponential(1.25));
+	Release(&fac);
+	Leave(&park, 1);
+	Quit();
+
+	return NULL;
+}
+
+static struct activation handler_customer(size_t idx, void *data)
+{
+	struct customer *c = data;
+
+	switch (c->phase) {
+	case PARKING:
+		c->arrived = cur_time;
+		c->phase = QUEUEING;
+		return act_enter(&park, 1);
+	case QUEUEING:
+		c->phase = SERVED;
+		return act_seize(&fac);
+	case SERVED:
+		save_time(fac.stats, cur_time - c->arrived);
+		c->phase = DONE;
+		return act_wait(Exponential(1.25));
+	case DONE:
+		break;
+	}
+
+	Release(&fac);
+	Leave(&park, idx, 1);
+	return act_quit();
+}
+
+int main(void)
+{
+	struct customer *c = xcalloc(customers, sizeof(*c));
+
+	/* Facility and store initialization */
+	fac_constructor(&fac);
+	fac_set_name(&fac, "Counter");
+	stats_keep_times(fac.stats, true);
+	store_constructor(&park);
+	store_set_capacity(&park, 3);
+	store_set_name(&park, "Car park");
+
+	/* Simulation initialization */
+	if (Init(0.0, 100.0) == -1)
+		psimerr("init");
+
+	/* Generating customers of both kinds */
+	for (unsigned i = 0; i < customers; ++i) {
+		if (create_process(process_customer, i % 2) == -1)
+			psimerr("create_process");
+		if (create_handler(handler_customer, &c[i], i % 2) == -1)
+			psimerr("create_handler");
+	}
+
+	/* Runnig the simulation */
+	Run();
+
+	/* printing statistics */
+	printf("\033[1;32mStats for %s\033[0m\n", fac_get_name(&fac));
+	print_stats(fac.stats, customers - 1, 1);
+	printf("Utilization %.2f, mean queue %.2f, longest queue %.0f\n",
+	       fac_util(&fac), fac_queue_avg(&fac), fac_queue_max(&fac));
+	printf("\033[1;32mStats for %s\033[0m\n", store_get_name(&park));
+	printf("Mean occupancy %.2f of %u, mean queue %.2f\n",
+	       store_used_avg(&park), store_get_capacity(&park),
+	       store_queue_avg(&park));
+
+	/* Facility and store destruction */
+	store_destructor(&park);
+	fac_destructor(&fac);
+	free(c);
+
+	return EXIT_SUCCESS;
+}
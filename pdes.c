@@ -0,0 +1,474 @@
+/*
+ * Conservative parallel simulation engine.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Synchronization is the barrier-window protocol (YAWNS).  Every LP
+ * declares a lookahead L: an event it sends to another LP at time t is
+ * never earlier than t + L.  If next(i) is the earliest pending event of
+ * LP i, no LP can ever receive an event earlier than
+ *
+ *	W = min over i of (next(i) + L(i))
+ *
+ * so all events before W are safe and the LPs process them in parallel
+ * without talking to each other.  Events for other LPs are pushed onto
+ * the receiver's lock-free inbox; at the barrier every LP moves its
+ * inbox into its calendar and a new window is computed.
+ *
+ * The LPs are split into contiguous blocks, one block per worker thread.
+ * Inbox events are put into the calendar sorted by (time, sender, send
+ * order), so a run gives the same result whatever the number of threads.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cal.h"
+#include "error.h"
+#include "pdes.h"
+#include "system.h"
+
+/* Event in flight, lives in an inbox */
+struct pdes_msg {
+	struct pdes_msg *next;
+	struct pdes_event ev;
+};
+
+struct pdes_lp {
+	struct pdes *sim;
+	size_t id;
+	unsigned int worker;	/* Thread the LP runs on */
+	pdes_handler_t handler;
+	void *state;		/* Model data of the LP */
+	double lookahead;
+	double now;		/* Local virtual time */
+	uint64_t send_seq;
+
+	/* Pending events; the calendar handle is the slot number */
+	struct calq *cal;
+	struct pdes_event *ev;
+	size_t nslots;
+	size_t allocated;
+	size_t *free_slots;
+	size_t nfree;
+
+	/* Inbox, a Treiber stack drained all at once at the barrier */
+	struct pdes_msg *inbox __attribute__ ((aligned(64)));
+};
+
+/* Per-thread data, kept on its own cache line */
+struct worker {
+	struct pdes *sim;
+	unsigned int id;
+	size_t first, last;	/* LPs [first, last) */
+	pthread_t th;
+
+	struct pdes_msg *free;	/* Recycled messages */
+	struct pdes_msg **batch;	/* Scratch for draining inboxes */
+	size_t nbatch;
+
+	double min_next;	/* Earliest pending event */
+	double min_safe;	/* Earliest next + lookahead */
+	uint64_t events;
+	uint64_t remote;
+} __attribute__ ((aligned(64)));
+
+struct pdes {
+	struct pdes_lp **lp;
+	size_t nlps;
+	unsigned int nthreads;
+	struct worker *w;
+	pthread_barrier_t barrier;
+	double end;
+	uint64_t windows;
+	double wall;
+	bool running;
+};
+
+/* Take a free event slot of LP */
+static size_t slot_get(struct pdes_lp *lp)
+{
+	if (lp->nfree)
+		return lp->free_slots[--lp->nfree];
+
+	if (lp->nslots == lp->allocated) {
+		lp->allocated = lp->allocated ? 2 * lp->allocated : 16;
+		lp->ev = xrealloc(lp->ev, lp->allocated * sizeof(*lp->ev));
+		lp->free_slots = xrealloc(lp->free_slots,
+					  lp->allocated * sizeof(size_t));
+	}
+	return lp->nslots++;
+}
+
+/* Put event E into the calendar of LP */
+static void enqueue(struct pdes_lp *lp, const struct pdes_event *e)
+{
+	const size_t s = slot_get(lp);
+
+	lp->ev[s] = *e;
+	calq_insert(lp->cal, s, e->time, 0);
+}
+
+static double next_time(struct pdes_lp *lp)
+{
+	const struct cal_key *k = calq_head_key(lp->cal);
+
+	return k ? k->atime : INFINITY;
+}
+
+/* Throw away the workers of the previous run */
+static void free_workers(struct pdes *sim)
+{
+	unsigned int k;
+
+	for (k = 0; sim->w && k < sim->nthreads; k++) {
+		struct pdes_msg *m = sim->w[k].free;
+
+		while (m) {
+			struct pdes_msg *next = m->next;
+
+			free(m);
+			m = next;
+		}
+		free(sim->w[k].batch);
+	}
+	free(sim->w);
+	sim->w = NULL;
+}
+
+struct pdes *pdes_new(unsigned int nthreads)
+{
+	struct pdes *sim = xcalloc(1, sizeof(*sim));
+
+	sim->nthreads = nthreads ?: 1;
+
+	return sim;
+}
+
+void pdes_free(struct pdes *sim)
+{
+	size_t i;
+
+	if (!sim)
+		return;
+
+	free_workers(sim);
+	for (i = 0; i < sim->nlps; i++) {
+		calq_free(sim->lp[i]->cal);
+		free(sim->lp[i]->ev);
+		free(sim->lp[i]->free_slots);
+		free(sim->lp[i]);
+	}
+	free(sim->lp);
+	free(sim);
+}
+
+/*
+ * Add a logical process running HANDLER over STATE.  Events it sends to
+ * other LPs must be at least LOOKAHEAD (> 0) in its future.
+ * Returns id of the LP or -1 when error.
+ */
+ssize_t pdes_lp_new(struct pdes *sim, pdes_handler_t handler, void *state,
+		    double lookahead)
+{
+	struct pdes_lp *lp;
+
+	if (sim->running || !handler || !(lookahead > 0.0)) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	lp = xcalloc(1, sizeof(*lp));
+	lp->sim = sim;
+	lp->id = sim->nlps;
+	lp->handler = handler;
+	lp->state = state;
+	lp->lookahead = lookahead;
+	lp->cal = calq_new();
+
+	sim->lp = xrealloc(sim->lp, (sim->nlps + 1) * sizeof(*sim->lp));
+	sim->lp[sim->nlps++] = lp;
+
+	return (ssize_t) lp->id;
+}
+
+/* Schedule an initial event for LP DST, before pdes_run() */
+int pdes_schedule(struct pdes *sim, size_t dst, double t, int type,
+		  uint64_t u, double d)
+{
+	struct pdes_event e = {
+		.time = t, .src = dst, .dst = dst, .type = type, .u = u, .d = d,
+	};
+
+	if (sim->running || dst >= sim->nlps || t < 0.0) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	e.seq = sim->lp[dst]->send_seq++;
+	enqueue(sim->lp[dst], &e);
+
+	return 0;
+}
+
+/*
+ * Send an event from LP to DST at time T; only for handlers, use
+ * pdes_schedule() to set up the model.  Sending to itself only needs
+ * T not to be in the past, anything else must respect the lookahead.
+ */
+int pdes_send(struct pdes_lp *lp, size_t dst, double t, int type,
+	      uint64_t u, double d)
+{
+	struct pdes *sim = lp->sim;
+	struct worker *w = &sim->w[lp->worker];
+	struct pdes_msg *m;
+	struct pdes_lp *to;
+
+	if (unlikely(dst >= sim->nlps || t < lp->now
+		     || (dst != lp->id && t < lp->now + lp->lookahead))) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	const struct pdes_event e = {
+		.time = t, .src = lp->id, .dst = dst, .seq = lp->send_seq++,
+		.type = type, .u = u, .d = d,
+	};
+
+	if (dst == lp->id) {
+		enqueue(lp, &e);
+		return 0;
+	}
+
+	if (likely(w->free != NULL)) {
+		m = w->free;
+		w->free = m->next;
+	} else {
+		m = xmalloc(sizeof(*m));
+	}
+	m->ev = e;
+	w->remote++;
+
+	to = sim->lp[dst];
+	m->next = __atomic_load_n(&to->inbox, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&to->inbox, &m->next, m, true,
+					    __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED))
+		;
+
+	return 0;
+}
+
+double pdes_now(const struct pdes_lp *lp)
+{
+	return lp->now;
+}
+
+size_t pdes_lp_id(const struct pdes_lp *lp)
+{
+	return lp->id;
+}
+
+void *pdes_lp_state(const struct pdes_lp *lp)
+{
+	return lp->state;
+}
+
+double pdes_lookahead(const struct pdes_lp *lp)
+{
+	return lp->lookahead;
+}
+
+static int compare_msgs(const void *a, const void *b)
+{
+	const struct pdes_event *x = &(*(struct pdes_msg * const *)a)->ev;
+	const struct pdes_event *y = &(*(struct pdes_msg * const *)b)->ev;
+
+	if (x->time != y->time)
+		return x->time < y->time ? -1 : 1;
+	if (x->src != y->src)
+		return x->src < y->src ? -1 : 1;
+	return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+/* Move the inbox of LP into its calendar in a deterministic order */
+static void drain(struct worker *w, struct pdes_lp *lp)
+{
+	struct pdes_msg *m = __atomic_exchange_n(&lp->inbox, NULL,
+						 __ATOMIC_ACQUIRE);
+	size_t n = 0, i;
+
+	for (; m; m = m->next) {
+		if (n == w->nbatch) {
+			w->nbatch = w->nbatch ? 2 * w->nbatch : 64;
+			w->batch = xrealloc(w->batch,
+					    w->nbatch * sizeof(*w->batch));
+		}
+		w->batch[n++] = m;
+	}
+
+	if (n > 1)
+		qsort(w->batch, n, sizeof(*w->batch), compare_msgs);
+
+	for (i = 0; i < n; i++) {
+		enqueue(lp, &w->batch[i]->ev);
+		w->batch[i]->next = w->free;
+		w->free = w->batch[i];
+	}
+}
+
+/* Process all events of LP earlier than WINDOW */
+static void process(struct worker *w, struct pdes_lp *lp, double window)
+{
+	while (next_time(lp) < window) {
+		const size_t s = (size_t) calq_head(lp->cal);
+		const struct pdes_event e = lp->ev[s];
+
+		calq_del_head(lp->cal);
+		lp->free_slots[lp->nfree++] = s;
+
+		lp->now = e.time;
+		lp->handler(lp, &e);
+		w->events++;
+	}
+}
+
+static void *worker_loop(void *arg)
+{
+	struct worker *w = arg;
+	struct pdes *sim = w->sim;
+	size_t i;
+
+	for (;;) {
+		double next = INFINITY, window = INFINITY;
+		unsigned int k;
+
+		/* Collect what the others sent in the last window */
+		w->min_next = w->min_safe = INFINITY;
+		for (i = w->first; i < w->last; i++) {
+			struct pdes_lp *lp = sim->lp[i];
+			double t;
+
+			drain(w, lp);
+			t = next_time(lp);
+			w->min_next = min(w->min_next, t);
+			w->min_safe = min(w->min_safe, t + lp->lookahead);
+		}
+
+		pthread_barrier_wait(&sim->barrier);
+
+		/* Everybody computes the same window */
+		for (k = 0; k < sim->nthreads; k++) {
+			next = min(next, sim->w[k].min_next);
+			window = min(window, sim->w[k].min_safe);
+		}
+
+		if (next >= sim->end)
+			break;
+
+		if (w->id == 0)
+			sim->windows++;
+		window = min(window, sim->end);
+
+		for (i = w->first; i < w->last; i++)
+			process(w, sim->lp[i], window);
+
+		pthread_barrier_wait(&sim->barrier);
+	}
+
+	return NULL;
+}
+
+/*
+ * Run the model until END on the threads given to pdes_new().
+ * Returns 0 on success, -1 when error.
+ */
+int pdes_run(struct pdes *sim, double end)
+{
+	struct timespec t0, t1;
+	unsigned int k;
+	size_t i;
+	int e;
+
+	if (sim->running || !sim->nlps) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	free_workers(sim);
+
+	/* More threads than LPs would just spin at the barrier */
+	if (sim->nthreads > sim->nlps)
+		sim->nthreads = (unsigned int) sim->nlps;
+
+	sim->w = xcalloc(sim->nthreads, sizeof(*sim->w));
+	for (k = 0; k < sim->nthreads; k++) {
+		sim->w[k].sim = sim;
+		sim->w[k].id = k;
+		sim->w[k].first = sim->nlps * k / sim->nthreads;
+		sim->w[k].last = sim->nlps * (k + 1) / sim->nthreads;
+		for (i = sim->w[k].first; i < sim->w[k].last; i++)
+			sim->lp[i]->worker = k;
+	}
+
+	e = pthread_barrier_init(&sim->barrier, NULL, sim->nthreads);
+	if (unlikely(e))
+		errx(EXIT_FAILURE, "pthread_barrier_init: %s", strerror(e));
+
+	sim->end = end;
+	sim->windows = 0;
+	sim->running = true;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (k = 1; k < sim->nthreads; k++) {
+		e = pthread_create(&sim->w[k].th, NULL, worker_loop,
+				   &sim->w[k]);
+		if (unlikely(e))
+			errx(EXIT_FAILURE, "pthread_create: %s", strerror(e));
+	}
+	worker_loop(&sim->w[0]);
+	for (k = 1; k < sim->nthreads; k++)
+		pthread_join(sim->w[k].th, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sim->wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	sim->running = false;
+	pthread_barrier_destroy(&sim->barrier);
+
+	return 0;
+}
+
+/* Counters of the last run; call after pdes_run() */
+void pdes_get_stats(struct pdes *sim, struct pdes_stats *st)
+{
+	unsigned int k;
+
+	memset(st, 0, sizeof(*st));
+	st->windows = sim->windows;
+	st->wall = sim->wall;
+	for (k = 0; sim->w && k < sim->nthreads; k++) {
+		st->events += sim->w[k].events;
+		st->remote += sim->w[k].remote;
+	}
+}
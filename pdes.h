@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PDES_H_
+#define _PDES_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Conservative parallel engine.  The model is split into logical
+ * processes (LPs); each one owns its calendar and its state (queues,
+ * servers, ...) and only talks to the others by timestamped events.
+ */
+struct pdes;
+struct pdes_lp;
+
+/* An event, the payload is up to the model */
+struct pdes_event {
+	double time;		/* Time of the event */
+	size_t src;		/* Sending LP */
+	size_t dst;		/* Receiving LP */
+	uint64_t seq;		/* Send order of src, for stable ties */
+	int type;		/* Model defined */
+	uint64_t u;		/* Payload */
+	double d;
+};
+
+typedef void (*pdes_handler_t)(struct pdes_lp *, const struct pdes_event *);
+
+/* Counters of a run */
+struct pdes_stats {
+	uint64_t events;	/* Events processed */
+	uint64_t remote;	/* Events sent to another LP */
+	uint64_t windows;	/* Synchronization windows */
+	double wall;		/* Seconds spent in pdes_run() */
+};
+
+extern struct pdes *pdes_new(unsigned int);
+extern void pdes_free(struct pdes *);
+extern ssize_t pdes_lp_new(struct pdes *, pdes_handler_t, void *, double);
+extern int pdes_schedule(struct pdes *, size_t, double, int, uint64_t,
+			 double);
+extern int pdes_run(struct pdes *, double);
+extern void pdes_get_stats(struct pdes *, struct pdes_stats *);
+
+/* Called from handlers */
+extern int pdes_send(struct pdes_lp *, size_t, double, int, uint64_t,
+		     double);
+extern double pdes_now(const struct pdes_lp *);
+extern size_t pdes_lp_id(const struct pdes_lp *);
+extern void *pdes_lp_state(const struct pdes_lp *);
+extern double pdes_lookahead(const struct pdes_lp *);
+
+#endif /* _PDES_H_ */
@@ -0,0 +1,220 @@
+/*
+ * Closed tandem network on the parallel engine.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Stations form a ring, every station is one LP with a FIFO queue and a
+ * single server.  A served customer walks to the next station, which
+ * takes TRANSIT time units -- that is the lookahead.  The model is run
+ * with 1, 2, 4, ... threads up to -t and the speedup is printed; the
+ * number of served customers must be the same for every run.
+ */
+
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "error.h"
+#include "pdes.h"
+#include "system.h"
+
+#define TRANSIT		1.0	/* Walk to the next station */
+#define SERVICE		1.0	/* Mean service time */
+
+enum { ARRIVE, DEPART };
+
+struct station {
+	uint64_t rng;
+	uint64_t *queue;	/* Waiting customers, a ring buffer */
+	size_t qhead, qlen, qsize;
+	uint64_t served;
+	double busy_since;
+	double busy;		/* Total busy time */
+} __attribute__ ((aligned(64)));
+
+static size_t nstations = 256;
+static size_t ncustomers = 16;	/* Per station */
+static unsigned int work;	/* Busy loop per event, to model cost */
+
+static double uniform(struct station *s)
+{
+	s->rng ^= s->rng << 13;
+	s->rng ^= s->rng >> 7;
+	s->rng ^= s->rng << 17;
+	return ((s->rng >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static void burn(void)
+{
+	volatile unsigned int i;
+
+	for (i = 0; i < work; i++)
+		;
+}
+
+static void start_service(struct pdes_lp *lp, struct station *s, uint64_t c)
+{
+	s->busy_since = pdes_now(lp);
+	pdes_send(lp, pdes_lp_id(lp), pdes_now(lp) - SERVICE * log(uniform(s)),
+		  DEPART, c, 0.0);
+}
+
+static void station(struct pdes_lp *lp, const struct pdes_event *e)
+{
+	struct station *s = pdes_lp_state(lp);
+	const size_t next = (pdes_lp_id(lp) + 1) % nstations;
+
+	burn();
+
+	switch (e->type) {
+	case ARRIVE:
+		if (s->busy_since >= 0.0 || s->qlen) {
+			if (s->qlen == s->qsize) {
+				/* Grow and unwrap the ring */
+				uint64_t *q = xmalloc(2 * (s->qsize ?: 8)
+						      * sizeof(*q));
+				size_t i;
+
+				for (i = 0; i < s->qlen; i++)
+					q[i] = s->queue[(s->qhead + i)
+							% s->qsize];
+				free(s->queue);
+				s->queue = q;
+				s->qhead = 0;
+				s->qsize = 2 * (s->qsize ?: 8);
+			}
+			s->queue[(s->qhead + s->qlen++) % s->qsize] = e->u;
+		} else {
+			start_service(lp, s, e->u);
+		}
+		break;
+	case DEPART:
+		s->served++;
+		s->busy += pdes_now(lp) - s->busy_since;
+		s->busy_since = -1.0;
+		pdes_send(lp, next, pdes_now(lp) + TRANSIT, ARRIVE, e->u, 0.0);
+		if (s->qlen) {
+			const uint64_t c = s->queue[s->qhead];
+
+			s->qhead = (s->qhead + 1) % s->qsize;
+			s->qlen--;
+			start_service(lp, s, c);
+		}
+		break;
+	}
+}
+
+/* Build and run the network on NTHREADS, returns customers served */
+static uint64_t run(unsigned int nthreads, double end, struct pdes_stats *st)
+{
+	struct pdes *sim = pdes_new(nthreads);
+	struct station *s = xcalloc(nstations, sizeof(*s));
+	uint64_t served = 0;
+	size_t i, c;
+
+	for (i = 0; i < nstations; i++) {
+		s[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+		s[i].busy_since = -1.0;
+		if (pdes_lp_new(sim, station, &s[i], TRANSIT) == -1)
+			psimerr("pdes_lp_new");
+		for (c = 0; c < ncustomers; c++)
+			pdes_schedule(sim, i, uniform(&s[i]), ARRIVE,
+				      i * ncustomers + c, 0.0);
+	}
+
+	if (pdes_run(sim, end) == -1)
+		psimerr("pdes_run");
+	pdes_get_stats(sim, st);
+
+	for (i = 0; i < nstations; i++) {
+		served += s[i].served;
+		free(s[i].queue);
+	}
+	free(s);
+	pdes_free(sim);
+
+	return served;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-s stations] "
+		"[-c customers] [-e end_time] [-w work]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_threads = 8, t;
+	double end = 1000.0, wall1 = 0.0;
+	uint64_t served1 = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:c:e:w:")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			nstations = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			ncustomers = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			end = strtod(optarg, NULL);
+			break;
+		case 'w':
+			work = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!nstations || !max_threads)
+		usage(argv[0]);
+
+	printf("%zu stations, %zu customers each, end time %g\n",
+	       nstations, ncustomers, end);
+	printf("%8s %12s %10s %10s %12s %8s\n", "threads", "events",
+	       "windows", "wall [s]", "events/s", "speedup");
+
+	for (t = 1; t <= max_threads; t *= 2) {
+		struct pdes_stats st;
+		const uint64_t served = run(t, end, &st);
+
+		if (t == 1) {
+			served1 = served;
+			wall1 = st.wall;
+		} else if (served != served1) {
+			errx(EXIT_FAILURE, "%u threads served %llu customers, "
+			     "1 thread %llu", t, (unsigned long long) served,
+			     (unsigned long long) served1);
+		}
+
+		printf("%8u %12llu %10llu %10.3f %12.0f %8.2f\n", t,
+		       (unsigned long long) st.events,
+		       (unsigned long long) st.windows, st.wall,
+		       st.events / st.wall, wall1 / st.wall);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/*
+ * Coroutine backend: processes switched in user space.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * All processes run on the thread that called Run(), each one on its
+ * own stack.  A switch saves the callee-saved registers on the current
+ * stack and moves the stack pointer, no kernel is involved.  On x86-64
+ * this is done by hand, elsewhere by swapcontext(), which is correct
+ * but makes a system call for the signal mask on every switch.
+ *
+ * A stack is taken when the process is first dispatched and given back
+ * when it dies, see proc_stack.c.
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "cal.h"
+#include "process.h"
+#include "system.h"
+
+#ifndef __x86_64__
+# include <ucontext.h>
+#endif
+
+/* Process Run() switched to, per thread for simulations on threads */
+__thread size_t process_current attribute_hidden;
+
+/* Context of Run() while a process runs */
+static __thread void *sched_sp;
+
+static void __noreturn__ start(void)
+{
+	PROC(process_current).behaviour(NULL);
+
+	/* Fell off the end of the behaviour */
+	Quit();
+}
+
+#ifdef __x86_64__
+/*
+ * Save the callee-saved registers on the stack, the stack pointer to
+ * *SAVE and continue with the context at TO.
+ */
+extern void coro_switch(void **save, void *to)
+	__asm__("dsim_coro_switch") attribute_hidden;
+
+__asm__(".text\n"
+	".globl dsim_coro_switch\n"
+	".hidden dsim_coro_switch\n"
+	".type dsim_coro_switch, @function\n"
+	"dsim_coro_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size dsim_coro_switch, .-dsim_coro_switch\n");
+
+/* Make a context which enters start() on stack S of SIZE bytes */
+static void *coro_make(void *s, size_t size)
+{
+	void **sp = (void **) (((uintptr_t) s + size) & ~15UL);
+	int k;
+
+	*--sp = NULL;			/* start() never returns */
+	*--sp = (void *) (uintptr_t) start;	/* Where coro_switch() returns */
+	for (k = 0; k < 6; k++)
+		*--sp = NULL;		/* Registers */
+
+	return sp;
+}
+#else
+static __thread ucontext_t sched_uc;
+
+/* The ucontext lives at the top of the stack, SP points to it */
+static void coro_switch(void **save, void *to)
+{
+	ucontext_t *uc = save == &sched_sp ? &sched_uc : *save;
+
+	*save = uc;
+	if (swapcontext(uc, to))
+		err(EXIT_FAILURE, "swapcontext");
+}
+
+static void *coro_make(void *s, size_t size)
+{
+	ucontext_t *uc = (ucontext_t *) (((uintptr_t) s + size - sizeof(*uc))
+					 & ~15UL);
+
+	if (getcontext(uc))
+		err(EXIT_FAILURE, "getcontext");
+	uc->uc_stack.ss_sp = s;
+	uc->uc_stack.ss_size = (char *) uc - (char *) s;
+	uc->uc_link = NULL;
+	makecontext(uc, start, 0);
+
+	return uc;
+}
+#endif
+
+int process_init(size_t i)
+{
+	PROC(i).sp = NULL;
+	PROC(i).stack = NULL;
+
+	return 0;
+}
+
+void process_fini(size_t i)
+{
+#define this PROC(i)
+	if (this.stack) {
+		stack_free(this.stack, this.stack_size);
+		this.stack = NULL;
+	}
+	this.sp = NULL;
+#undef this
+}
+
+/* Run process I until it stops or dies, called by the calendar */
+void process_switch(size_t i)
+{
+#define this PROC(i)
+	if (this.state == TASK_WAKING) {
+		this.stack = stack_alloc(this.stack_size);
+		this.sp = coro_make(this.stack, this.stack_size);
+	}
+
+	this.state = TASK_RUNNING;
+	process_current = i;
+	coro_switch(&sched_sp, this.sp);
+#undef this
+}
+
+/* Stop the calling process I until the calendar dispatches it again */
+void process_yield(size_t i)
+{
+	PROC(i).state = TASK_STOPPED;
+	coro_switch(&PROC(i).sp, sched_sp);
+}
+
+/* Terminate the calling process I, the calendar frees its stack */
+void process_exit(size_t i)
+{
+	PROC(i).state = TASK_DEAD;
+	coro_switch(&PROC(i).sp, sched_sp);
+	__builtin_unreachable();
+}
@@ -0,0 +1,311 @@
+/*
+ * Stacks of processes.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Both backends take their stacks from here: coroutines run on them,
+ * threads are created on them.  Stacks are pooled by size, a stack goes
+ * back to the pool of its size and is handed out again from there.
+ * They are carved out of big mappings so that a million processes
+ * don't need a million mappings, and only the pages a process touches
+ * ever get memory.
+ *
+ * Below every stack is a guard page without any access, so a process
+ * running off its stack faults instead of trampling on its neighbour.
+ * Each guard splits the mapping, which costs the kernel a map entry; if
+ * it has no more of them (see vm.max_map_count) the stacks made from
+ * then on go without a guard.
+ *
+ * A free stack is never written to and fresh pages are zero, so the
+ * lowest nonzero word of a stack shows how deep it has ever been used.
+ * process_stack_stats() finds it, looking only at the pages mincore()
+ * says are in memory.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "cal.h"
+#include "error.h"
+#include "process.h"
+#include "system.h"
+
+/* Default stack of one process */
+#ifndef PROCESS_STACK
+# define PROCESS_STACK	(32 * 1024)
+#endif
+
+/* Smallest stack a process may ask for */
+#ifdef PROCESS_thread
+# define STACK_MIN	((size_t) PTHREAD_STACK_MIN)
+#else
+# define STACK_MIN	((size_t) 8 * 1024)
+#endif
+
+/* Bytes of stacks per mapping */
+#define STACK_CHUNK	(2 * 1024 * 1024)
+
+/* Stacks of one size */
+struct stack_pool {
+	struct stack_pool *next;
+	size_t size;		/* Usable size of a stack */
+	size_t slot;		/* The stack and its guard page */
+	size_t per_chunk;	/* Stacks per mapping */
+	void **free;		/* Unused stacks */
+	size_t nfree, afree;
+	char **chunks;		/* All mappings */
+	size_t nchunks;
+	size_t in_use;
+};
+
+static struct stack_pool *pools;
+
+/* Simulations on other threads share the pools */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Whether stacks get guard pages, and whether all of them got one */
+static bool guard = true;
+static bool guard_failed;
+
+static size_t page_size(void)
+{
+	static size_t page;
+
+	if (unlikely(!page))
+		page = sysconf(_SC_PAGESIZE);
+	return page;
+}
+
+/*
+ * Actual size of a stack of SIZE bytes, 0 means the default size.
+ * Returns 0 if it's too small.
+ */
+size_t process_stack_size(size_t size)
+{
+	if (!size)
+		return sim_self()->stack_size ?: PROCESS_STACK;
+	if (size < STACK_MIN)
+		return 0;
+	return round_up(size, page_size());
+}
+
+/*
+ * Set the size of stacks of processes the simulation creates from now
+ * on, 0 means PROCESS_STACK.
+ */
+int process_set_stack_size(size_t size)
+{
+	size = size ? process_stack_size(size) : PROCESS_STACK;
+	if (!size) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	sim_self()->stack_size = size;
+	return 0;
+}
+
+/* Turn guard pages of stacks made from now on on or off */
+void process_set_stack_guard(bool on)
+{
+	guard = on;
+}
+
+static struct stack_pool *get_pool(size_t size)
+{
+	struct stack_pool *p;
+
+	for (p = pools; p; p = p->next)
+		if (p->size == size)
+			return p;
+
+	p = xcalloc(1, sizeof(*p));
+	p->size = size;
+	p->slot = size + page_size();
+	p->per_chunk = max(STACK_CHUNK / p->slot, (size_t) 1);
+	p->next = pools;
+	pools = p;
+
+	return p;
+}
+
+static void put(struct stack_pool *p, void *s)
+{
+	if (p->nfree == p->afree) {
+		p->afree = p->afree ? 2 * p->afree : p->per_chunk;
+		p->free = xrealloc(p->free, p->afree * sizeof(*p->free));
+	}
+	p->free[p->nfree++] = s;
+}
+
+/* Map another chunk of stacks of pool P */
+static void grow(struct stack_pool *p)
+{
+	const size_t page = page_size();
+	char *c = mmap(NULL, p->per_chunk * p->slot, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+		       -1, 0);
+	size_t k;
+
+	if (c == MAP_FAILED)
+		err(EXIT_FAILURE, "cannot map process stacks");
+
+	p->chunks = xrealloc(p->chunks, (p->nchunks + 1) * sizeof(*p->chunks));
+	p->chunks[p->nchunks++] = c;
+
+	for (k = p->per_chunk; k-- > 0;) {
+		char *s = c + k * p->slot;
+
+		if (guard && !guard_failed && mprotect(s, page, PROT_NONE)) {
+			warn("stacks get no more guard pages");
+			guard_failed = true;
+		}
+		put(p, s + page);
+	}
+}
+
+/* Take a stack of SIZE bytes (see process_stack_size()) */
+void *stack_alloc(size_t size)
+{
+	struct stack_pool *p;
+	void *s;
+
+	pthread_mutex_lock(&lock);
+	p = get_pool(size);
+	if (unlikely(!p->nfree))
+		grow(p);
+	p->in_use++;
+	s = p->free[--p->nfree];
+	pthread_mutex_unlock(&lock);
+
+	return s;
+}
+
+/* Give stack S of SIZE bytes back */
+void stack_free(void *s, size_t size)
+{
+	struct stack_pool *p;
+
+	pthread_mutex_lock(&lock);
+	p = get_pool(size);
+	p->in_use--;
+	put(p, s);
+	pthread_mutex_unlock(&lock);
+}
+
+/* Deepest use of any stack of pool P; VEC is room for mincore() */
+static size_t high_water(struct stack_pool *p, unsigned char *vec,
+			 size_t *resident)
+{
+	const size_t page = page_size();
+	const size_t pages = p->slot / page;
+	size_t hwm = 0, n, k, j;
+
+	for (n = 0; n < p->nchunks; n++) {
+		if (mincore(p->chunks[n], p->per_chunk * p->slot, vec))
+			continue;
+
+		for (k = 0; k < p->per_chunk; k++) {
+			const unsigned char *v = vec + k * pages;
+			char *s = p->chunks[n] + k * p->slot + page;
+			const uintptr_t *w = NULL;
+
+			/* The first page is the guard */
+			for (j = 1; j < pages; j++) {
+				if (!(v[j] & 1))
+					continue;
+				*resident += page;
+				if (!w)
+					w = (const uintptr_t *) (s + (j - 1)
+								 * page);
+			}
+			if (!w)
+				continue;
+
+			while ((const char *) w < s + p->size && !*w)
+				w++;
+			hwm = max(hwm, (size_t) (s + p->size
+						 - (const char *) w));
+		}
+	}
+
+	return hwm;
+}
+
+/* Measure the stacks, in total and (if F isn't NULL) size by size */
+void process_stack_stats(struct stack_stats *st, FILE *f)
+{
+	unsigned char *vec = NULL;
+	struct stack_pool *p;
+
+	pthread_mutex_lock(&lock);
+	memset(st, 0, sizeof(*st));
+	st->size = process_stack_size(0);
+	st->guarded = guard && !guard_failed;
+
+	for (p = pools; p; p = p->next) {
+		size_t resident = 0, hwm;
+
+		vec = xrealloc(vec, p->per_chunk * p->slot / page_size());
+		hwm = high_water(p, vec, &resident);
+
+		st->stacks += p->nchunks * p->per_chunk;
+		st->in_use += p->in_use;
+		st->mapped += p->nchunks * p->per_chunk * p->slot;
+		st->resident += resident;
+		st->high_water = max(st->high_water, hwm);
+
+		if (f)
+			fprintf(f, "stacks of %zu B: %zu made, %zu in use, "
+				"high water %zu B (%.1f%%)\n", p->size,
+				p->nchunks * p->per_chunk, p->in_use, hwm,
+				100.0 * hwm / p->size);
+	}
+
+	pthread_mutex_unlock(&lock);
+	free(vec);
+}
+
+/*
+ * Unmap the stacks at exit.  A pool with stacks in use is left alone:
+ * pooled threads run on them and keep their TLS there, and one may be
+ * just past waking its simulation up for the last time.
+ */
+static void __attribute__((destructor)) stack_cleanup(void)
+{
+	struct stack_pool *p;
+	size_t k;
+
+	while ((p = pools)) {
+		pools = p->next;
+		if (p->in_use)
+			continue;
+		for (k = 0; k < p->nchunks; k++)
+			munmap(p->chunks[k], p->per_chunk * p->slot);
+		free(p->chunks);
+		free(p->free);
+		free(p);
+	}
+}
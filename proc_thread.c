@@ -0,0 +1,254 @@
+/*
+ * Thread per process backend.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Every process runs on a thread of its own.  The calendar and the
+ * process hand the control over by the state of the process and the
+ * cond of its thread: the calendar sets TASK_RUNNING and waits until the
+ * state changes, the process sets TASK_STOPPED or TASK_DEAD and waits
+ * until it is TASK_RUNNING again.  So exactly one of them runs.  The
+ * lock and cond belong to the thread, which outlives the process.
+ *
+ * Threads are not created and joined per process.  A thread whose
+ * process dies jumps back to its loop and parks in the pool; the next
+ * new process takes a parked thread with a stack of the size it wants
+ * if there is one (a hit) and only otherwise a new thread is created (a
+ * miss).  The stacks come from proc_stack.c.
+ */
+
+#include <err.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "system.h"
+#include "cal.h"
+#include "process.h"
+
+#define NO_PROCESS	((size_t) -1)
+
+/* A pooled thread */
+struct pool_thread {
+	struct pool_thread *next;	/* Next parked one */
+	pthread_t th;
+	pthread_mutex_t lock;	/* Protects idx and state of the process */
+	pthread_cond_t cond;
+	size_t idx;		/* Process to run or NO_PROCESS */
+	size_t stack_size;	/* The thread runs on a stack this big */
+	struct sim *sim;	/* Simulation of the process */
+	bool kill;		/* The process is to quit when woken up */
+	jmp_buf exit;		/* Back to the loop when the process dies */
+};
+
+/* Parked threads */
+static struct pool_thread *parked;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pool_stats pool_stats;
+
+/* Thread we are running on */
+static __thread struct pool_thread *self;
+
+/* Process running on this thread */
+__thread size_t process_current attribute_hidden;
+
+static void park(struct pool_thread *w)
+{
+	pthread_mutex_lock(&pool_lock);
+	w->next = parked;
+	parked = w;
+	pool_stats.busy--;
+	pthread_mutex_unlock(&pool_lock);
+}
+
+static void *worker_loop(void *arg)
+{
+	struct pool_thread *w = arg;
+	size_t i;
+
+	self = w;
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		while (w->idx == NO_PROCESS)
+			pthread_cond_wait(&w->cond, &w->lock);
+		i = w->idx;
+		sim_bind(w->sim);
+		pthread_mutex_unlock(&w->lock);
+
+		process_current = i;
+
+		if (!setjmp(w->exit)) {
+			PROC(i).behaviour(NULL);
+
+			/* Fell off the end of the behaviour */
+			Quit();
+		}
+
+		/*
+		 * The process is dead.  Park before telling the calendar,
+		 * so that the next process can have this thread, but under
+		 * the lock: a simulation on another thread may take it from
+		 * the pool right away and must find it idle.
+		 */
+		pthread_mutex_lock(&w->lock);
+		w->idx = NO_PROCESS;
+		park(w);
+		PROC(i).state = TASK_DEAD;
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	return NULL;
+}
+
+/* Take a parked thread with a stack of STACK_SIZE or make a new one */
+static struct pool_thread *get_thread(size_t stack_size)
+{
+	struct pool_thread *w, **pw;
+	pthread_attr_t attr;
+	int e;
+
+	pthread_mutex_lock(&pool_lock);
+	for (pw = &parked; (w = *pw); pw = &w->next)
+		if (w->stack_size == stack_size)
+			break;
+	if (w) {
+		*pw = w->next;
+		pool_stats.hits++;
+	} else {
+		pool_stats.misses++;
+		pool_stats.threads++;
+	}
+	pool_stats.busy++;
+	pool_stats.peak = max(pool_stats.peak, pool_stats.busy);
+	pthread_mutex_unlock(&pool_lock);
+
+	if (!w) {
+		w = xmalloc(sizeof(*w));
+		w->idx = NO_PROCESS;
+		w->stack_size = stack_size;
+		w->kill = false;
+		if (pthread_mutex_init(&w->lock, NULL)
+		    || pthread_cond_init(&w->cond, NULL)
+		    || pthread_attr_init(&attr)
+		    || pthread_attr_setstack(&attr, stack_alloc(stack_size),
+					     stack_size))
+			errx(EXIT_FAILURE, "pthread init failed");
+		e = pthread_create(&w->th, &attr, worker_loop, w);
+		pthread_attr_destroy(&attr);
+		if (unlikely(e))
+			errx(EXIT_FAILURE, "pthread_create: %s", strerror(e));
+	}
+
+	return w;
+}
+
+/* Counters of the thread pool */
+void process_pool_stats(struct pool_stats *st)
+{
+	pthread_mutex_lock(&pool_lock);
+	*st = pool_stats;
+	pthread_mutex_unlock(&pool_lock);
+}
+
+int process_init(size_t i)
+{
+	PROC(i).th = (pthread_t) 0;
+	PROC(i).thread = NULL;
+
+	return 0;
+}
+
+/*
+ * A process still alive (see sim_free()) is woken up to quit, so that
+ * its thread goes back to the pool.
+ */
+void process_fini(size_t i)
+{
+	struct pool_thread *w = PROC(i).thread;
+
+	if (w && PROC(i).state != TASK_DEAD) {
+		pthread_mutex_lock(&w->lock);
+		w->kill = true;
+		PROC(i).state = TASK_RUNNING;
+		pthread_cond_broadcast(&w->cond);
+		while (PROC(i).state == TASK_RUNNING)
+			pthread_cond_wait(&w->cond, &w->lock);
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	PROC(i).th = (pthread_t) 0;
+	PROC(i).thread = NULL;
+}
+
+/* Run process I until it stops or dies, called by the calendar */
+void process_switch(size_t i)
+{
+	struct pool_thread *w = PROC(i).thread;
+
+	if (!w) {
+		w = get_thread(PROC(i).stack_size);
+		PROC(i).thread = w;
+		PROC(i).th = w->th;
+	}
+
+	pthread_mutex_lock(&w->lock);
+
+	/* Start the process or wake it up */
+	w->idx = i;
+	w->sim = sim_self();
+	PROC(i).state = TASK_RUNNING;
+	pthread_cond_broadcast(&w->cond);
+
+	/* Wait for the process to give the control back */
+	while (PROC(i).state == TASK_RUNNING)
+		pthread_cond_wait(&w->cond, &w->lock);
+
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* Stop the calling process I until the calendar dispatches it again */
+void process_yield(size_t i)
+{
+	struct pool_thread *w = self;
+
+	pthread_mutex_lock(&w->lock);
+
+	/* Tell calendar we're done */
+	PROC(i).state = TASK_STOPPED;
+	pthread_cond_broadcast(&w->cond);
+
+	while (PROC(i).state != TASK_RUNNING)
+		pthread_cond_wait(&w->cond, &w->lock);
+
+	if (unlikely(w->kill)) {
+		w->kill = false;
+		pthread_mutex_unlock(&w->lock);
+		longjmp(w->exit, 1);
+	}
+
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* Terminate the calling process I, its thread goes back to the pool */
+void process_exit(size_t i __unused__)
+{
+	longjmp(self->exit, 1);
+}
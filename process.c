@@ -27,156 +27,337 @@
 #include <unistd.h>
 #include "system.h"
 #include "cal.h"
+#include "error.h"
+#include "facility.h"
 #include "process.h"
+#include "store.h"
+#include "trace.h"
 
-#define debug(fmt, ...) fprintf(stderr, fmt "\n", ## __VA_ARGS__)
-//#define debug(fmt, ...) ((void)0)
+/*
+ * The process table and its lock are in struct sim, see sim.h.  Slots
+ * below top are in use or on the free list.
+ */
 
-/* Array of processes in the system */
-struct process_struct *process_list attribute_hidden;
+/* Make room for N more processes above top, a segment at a time */
+static void reserve_processes(struct sim *s, size_t n)
+{
+	while (s->top + n > s->nsegments * PROC_SEGMENT) {
+		if (s->nsegments == s->asegments) {
+			s->asegments = s->asegments ? 2 * s->asegments : 16;
+			s->procs = xrealloc(s->procs, s->asegments
+					    * sizeof(*s->procs));
+		}
+		s->procs[s->nsegments++] = xcalloc(PROC_SEGMENT,
+						   sizeof(**s->procs));
+	}
+}
 
-/* Number of processes in the system */
-size_t process_count attribute_hidden;
+/* Take a free slot or a new one */
+static size_t alloc_slot(struct sim *s)
+{
+	if (s->nfree)
+		return s->free_slots[--s->nfree];
 
-/* Lock for process_list */
-static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	reserve_processes(s, 1);
+	return s->top++;
+}
 
-/*
- * Allocates and initializes a new process_struct.
- * The actual kick-off is left to the calendar.
- * Returns index of the process in the process_list or -1 when error.
- */
-int create_process(void *(*tf) (void *), int prio)
+static void free_slot(struct sim *s, size_t i)
+{
+	if (s->nfree == s->afree) {
+		s->afree = s->afree ? 2 * s->afree : PROC_SEGMENT;
+		s->free_slots = xrealloc(s->free_slots,
+					 s->afree * sizeof(*s->free_slots));
+	}
+	s->free_slots[s->nfree++] = i;
+}
+
+/* Set up a process_struct, the caller fills in prio and atime */
+static int init_process(size_t i, void *(*tf) (void *), size_t stack_size)
+{
+#define this PROC(i)
+	this.state = TASK_WAKING;
+	this.stack_size = stack_size;
+	this.behaviour = tf;
+	this.handler = NULL;
+	this.data = NULL;
+
+	return process_init(i);
+#undef this
+}
+
+/* Add a new process running TF or HANDLER, returns its index or -1 */
+static int new_process(void *(*tf) (void *), handler_t handler, void *data,
+		       int prio, size_t stack_size)
 {
+	struct sim *const s = sim_self();
+	size_t i;
+
 	/* Get the mutex */
-	pthread_mutex_lock(&lock);
+	pthread_mutex_lock(&s->proc_lock);
 
 	/* Allocate space for process */
-	const size_t sz = (process_count + 1) * sizeof(struct process_struct);
-	process_list = xrealloc(process_list, sz);
-
+	i = alloc_slot(s);
 
-#define this process_list[process_count]
+#define this PROC(i)
 	/* Initialize this new process */
-	this.state = TASK_WAKING;
 	this.prio = prio;
-	// XXX Toto je jen pro testovani funkcnosti vkladani na spravne misto
-	// XXX aby nemely vsechny prvky stejny atime
 	this.atime = cur_time;
-	//this.atime = process_count % 2 == 0 ? prio ^ 3 : prio | 3;
-	this.th = (pthread_t)0;
-	this.behaviour = tf;
-
-	/* Initialize lock and cond */
-	if (pthread_mutex_init(&this.lock, NULL)
-	    || pthread_cond_init(&this.cond, NULL))
+	if (init_process(i, tf, stack_size)) {
+		free_slot(s, i);
+		pthread_mutex_unlock(&s->proc_lock);
 		return -1;
+	}
+	this.handler = handler;
+	this.data = data;
 
 	/* Now the thread is ready to run */
 
 	/* Add this process into calendar */
-	add_elem(process_count);
+	add_elem(i);
+	trace(TRACE_EVENT, TR_CREATE, cur_time, i, TASK_WAKING, 0, prio);
 
 	/* We have a new process */
-	process_count++;
+	s->nprocs++;
 
 	/* Release the mutex */
-	pthread_mutex_unlock(&lock);
+	pthread_mutex_unlock(&s->proc_lock);
 
-	/* We have to return current index, not the new */
-	return process_count - 1;
+	return i;
 #undef this
 }
 
-/* Suspends thread until we receive a signal */
-int Wait(double t)
+/*
+ * Allocates and initializes a new process_struct.
+ * The actual kick-off is left to the calendar.
+ * Returns index of the process in the process table or -1 when error.
+ */
+int create_process(void *(*tf) (void *), int prio)
 {
-#define this process_list[i]
-	const size_t i = CURRENT();
+	return new_process(tf, NULL, NULL, prio, process_stack_size(0));
+}
 
-	/* Get the mutex */
-	pthread_mutex_lock(&this.lock);
+/*
+ * The same as create_process(), but the process gets a stack of
+ * STACK_SIZE bytes instead of the default one.
+ */
+int create_process_stack(void *(*tf) (void *), int prio, size_t stack_size)
+{
+	stack_size = process_stack_size(stack_size);
+	if (!stack_size) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
 
-	/* Mark process as stopped */
-	this.state = TASK_STOPPED;
+	return new_process(tf, NULL, NULL, prio, stack_size);
+}
 
-	/* Re-schedule */
-	this.atime = t + cur_time;
-	//this.atime = t + cur_time * i;
+/*
+ * Create a handler process: HANDLER(idx, DATA) is called now and then on
+ * every activation it asks for, see struct activation.
+ * Returns index of the process in the process table or -1 when error.
+ */
+int create_handler(handler_t handler, void *data, int prio)
+{
+	if (!handler) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
 
-	/* Add entry into the calendar */
-	add_elem(i);
+	return new_process(NULL, handler, data, prio, 0);
+}
+
+/*
+ * Create COUNT processes running TF in one go.  The i-th of them gets
+ * priority PRIO(i) and is activated at ATIME(i); when PRIO or ATIME is
+ * NULL, priority 0 or the current time is used.  The batch takes
+ * consecutive new slots, not free ones, and the calendar is built from
+ * the whole of it, so seeding a model with a million customers is
+ * O(n log n).
+ * Returns index of the first process or -1 when error.
+ */
+ssize_t create_processes(void *(*tf) (void *), size_t count,
+			 int (*prio) (size_t), double (*atime) (size_t))
+{
+	struct sim *const s = sim_self();
+	size_t first, i;
+
+	if (!tf) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	/* Get the mutex */
+	pthread_mutex_lock(&s->proc_lock);
+
+	first = s->top;
+	reserve_processes(s, count);
+
+#define this PROC(first + i)
+	/* Check activation times before anything is set up */
+	for (i = 0; i < count; i++) {
+		this.prio = prio ? prio(i) : 0;
+		this.atime = atime ? atime(i) : cur_time;
+		if (unlikely(this.atime < cur_time)) {
+			pthread_mutex_unlock(&s->proc_lock);
+			simerr = GLOB_INVAL;
+			return -1;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (init_process(first + i, tf, process_stack_size(0))) {
+			while (i-- > 0)
+				process_fini(first + i);
+			pthread_mutex_unlock(&s->proc_lock);
+			return -1;
+		}
+	}
+#undef this
 
-	/* Tell calendar we're done */
-	int e = pthread_cond_signal(&this.cond);
-	if (unlikely(e))
-		printf("pthread_cond_signal: %s\n", strerror(e));
+	/* Add the whole batch into calendar */
+	add_elems(first, count);
+	for (i = 0; i < count; i++)
+		trace(TRACE_EVENT, TR_CREATE, cur_time, first + i, TASK_WAKING,
+		      0, PROC(first + i).prio);
 
-	e = pthread_cond_wait(&this.cond, &this.lock);
-	if (unlikely(e))
-		printf("pthread_cond_wait: %s\n", strerror(e));
+	s->top += count;
+	s->nprocs += count;
 
 	/* Release the mutex */
-	pthread_mutex_unlock(&this.lock);
+	pthread_mutex_unlock(&s->proc_lock);
 
-	return 0;
+	return first;
+}
+
+/*
+ * Run handler process I, called by the calendar.  The handler is called
+ * again right away as long as it gets what it asks for.
+ */
+void handler_dispatch(size_t i)
+{
+	struct sim *const s = sim_self();
+
+#define this PROC_OF(s, i)
+	for (;;) {
+		struct activation a;
+
+		this.state = TASK_RUNNING;
+		process_current = i;
+		a = this.handler(i, this.data);
+
+		switch (a.kind) {
+		case ACT_WAIT:
+			this.atime = cur_time + a.t;
+			add_elem(i);
+			break;
+		case ACT_SEIZE:
+			if (fac_request(a.res, i))
+				continue;
+			break;
+		case ACT_ENTER:
+			if (store_request(a.res, i, a.capacity))
+				continue;
+			break;
+		case ACT_QUIT:
+			trace(TRACE_EVENT, TR_DEAD, cur_time, i, TASK_DEAD, 0, 0);
+			this.state = TASK_DEAD;
+			return;
+		default:
+			INTERNAL_ERROR("bad activation");
+		}
+
+		this.state = TASK_STOPPED;
+		return;
+	}
 #undef this
 }
 
-/* Mark process as terminated */
-int Quit(void)
+/* Suspends process for T time units */
+int Wait(double t)
 {
-#define this process_list[i]
+	struct sim *const s = sim_self();
+#define this PROC_OF(s, i)
 	const size_t i = CURRENT();
 
-	/* Get the mutex */
-	pthread_mutex_lock(&this.lock);
-
-	/* Mark process as dead */
-	this.state = TASK_DEAD;
+	/* Re-schedule */
+	this.atime = t + s->now;
 
-	/* Tell calendar we're done */
-	int e = pthread_cond_signal(&this.cond);
-	if (unlikely(e))
-		printf("pthread_cond_signal: %s\n", strerror(e));
+	/* Add entry into the calendar */
+	add_elem(i);
 
-	/* Release the mutex */
-	e = pthread_mutex_unlock(&this.lock);
-	if (unlikely(e))
-		printf("pthread_mutex_unlock: %s\n", strerror(e));
+	/* Let the calendar go on, we're back at atime */
+	process_yield(i);
 
-	return e;
+	return 0;
 #undef this
 }
 
-/* Invalidate entry in process_list */
+/* Terminate the calling process, doesn't return */
+int Quit(void)
+{
+	const size_t i = CURRENT();
+
+	trace(TRACE_EVENT, TR_DEAD, cur_time, i, TASK_DEAD, 0, 0);
+	process_exit(i);
+}
+
+/* Invalidate entry in the process table, the slot can be reused */
 int destroy_process(size_t i)
 {
-#define this process_list[i]
-	int e;
+	struct sim *const s = sim_self();
 
+#define this PROC_OF(s, i)
 	/* Invalidate values */
 	this.prio = -1;
 	this.atime = 0.0;
-	this.th = (pthread_t)0;
-
-	/* Destroy lock and cond */
-	e = pthread_cond_destroy(&this.cond);
-	if (unlikely(e))
-		printf("PROCESS pthread_cond_destroy: %s\n", strerror(e));
-	
-	/*
-	e = pthread_mutex_destroy(&this.lock);
-	if (unlikely(e))
-		printf("PROCESS pthread_mutex_destroy: %s\n", strerror(e));
-	*/
-
-	return e;
+
+	process_fini(i);
+
+	/* Old handles of the slot are stale now */
+	pthread_mutex_lock(&s->proc_lock);
+	this.gen++;
+	free_slot(s, i);
+	s->nprocs--;
+	pthread_mutex_unlock(&s->proc_lock);
+
+	return 0;
 #undef this
 }
 
+/* Handle of process I, valid until the process is destroyed */
+proc_handle_t process_handle(size_t i)
+{
+	return (uint64_t) PROC(i).gen << 32 | i;
+}
+
+/* Index of the process with handle H, or -1 if it's gone */
+ssize_t process_lookup(proc_handle_t h)
+{
+	const size_t i = h & UINT32_MAX;
+
+	if (h == PROC_HANDLE_NONE || i >= sim_self()->top
+	    || PROC(i).gen != h >> 32) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	return i;
+}
+
+/* Slots in the process table, at most the peak of live processes */
+size_t process_slots(void)
+{
+	return sim_self()->top;
+}
+
 static void __attribute__((destructor)) process_cleanup(void)
 {
-	/* Free whole process_list array */
-	free(process_list);
+	struct sim *const s = &sim_default;
+	size_t k;
+
+	for (k = 0; k < s->nsegments; k++)
+		free(s->procs[k]);
+	free(s->procs);
+	free(s->free_slots);
 }
@@ -19,6 +19,20 @@
 #define _PROCESS_H_
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sim.h"
+#include <sys/types.h>
+
+/*
+ * Processes run either as coroutines on their own small stacks,
+ * switched in user space (PROCESS_coro, the default), or each one as a
+ * thread (PROCESS_thread).  The Makefile picks one with PROCESS=.
+ */
+#if !defined(PROCESS_coro) && !defined(PROCESS_thread)
+# define PROCESS_coro 1
+#endif
 
 /* Process states */
 #define TASK_RUNNING		0	/* Thread is running */
@@ -28,17 +42,8 @@
 
 #define TASK_STATE_TO_CHAR_STR "RSDW"
 
-/* Returns index in process_list of current thread */
-#define CURRENT()							\
-({									\
-	size_t __i = 0;							\
-	while (!pthread_equal(pthread_self(), process_list[__i].th))	\
-		__i++;							\
-	if (unlikely(__i > process_count))				\
-		INTERNAL_ERROR("couldn't find process_struct");		\
-	__i;								\
-})
-
+/* Returns index in the process table of the running process, O(1) */
+#define CURRENT() process_self()
 
 #define INTERNAL_ERROR(errstr)	\
 	errx(EXIT_FAILURE, _("%s(): INTERNAL ERROR at line %d (%s-%s): %s"),	\
@@ -50,23 +55,161 @@
  * state < (int)sizeof(TASK_STATE_TO_CHAR_STR) -1 ? TASK_STATE_TO_CHAR_STR[state] : '?'
  */
 
+struct facility_t;
+struct store_t;
+
+/*
+ * A handler process has no stack; create_handler() registers a function
+ * which Run() calls on every activation.  It does a step and returns
+ * what it wants next: act_wait(t), act_seize(fac), act_enter(store, n)
+ * or act_quit().  A seized facility or entered store is granted when the
+ * handler is called again.  Release() and Leave() are called directly.
+ */
+enum {
+	ACT_WAIT,
+	ACT_SEIZE,
+	ACT_ENTER,
+	ACT_QUIT,
+};
+
+struct activation {
+	int kind;
+	double t;		/* ACT_WAIT */
+	void *res;		/* ACT_SEIZE, ACT_ENTER */
+	unsigned int capacity;	/* ACT_ENTER */
+};
+
+typedef struct activation (*handler_t) (size_t, void *);
+
+static inline struct activation act_wait(double t)
+{
+	return (struct activation) { .kind = ACT_WAIT, .t = t };
+}
+
+static inline struct activation act_seize(struct facility_t *fac)
+{
+	return (struct activation) { .kind = ACT_SEIZE, .res = fac };
+}
+
+static inline struct activation act_enter(struct store_t *store,
+					  unsigned int capacity)
+{
+	return (struct activation) {
+		.kind = ACT_ENTER, .res = store, .capacity = capacity,
+	};
+}
+
+static inline struct activation act_quit(void)
+{
+	return (struct activation) { .kind = ACT_QUIT };
+}
+
 /* The process structure */
 struct process_struct {
 	volatile int state;	/* -1 unrunnable, 0 runnable, >0 stopped */
 	int prio;
 	double atime;		/* Activate time */
-	pthread_t th;		/* Thread ID */
-	pthread_mutex_t lock;
-	pthread_cond_t cond;
 	void *(*behaviour) (void *);
+	handler_t handler;	/* Instead of behaviour */
+	void *data;		/* Argument of handler */
+	uint32_t gen;		/* Bumped when the slot is freed */
+	size_t stack_size;	/* Size of its stack */
+#ifdef PROCESS_coro
+	void *sp;		/* Saved context */
+	void *stack;
+#else
+	pthread_t th;		/* Thread ID */
+	struct pool_thread *thread;	/* Pooled thread running it */
+#endif
 };
 
-extern struct process_struct *process_list;
-extern size_t process_count;
+#ifdef PROCESS_thread
+/* Counters of the thread pool, see process_pool_stats() */
+struct pool_stats {
+	size_t hits;		/* Processes started on a parked thread */
+	size_t misses;		/* Processes that needed a new thread */
+	size_t threads;		/* Threads created */
+	size_t busy;		/* Threads running a process now */
+	size_t peak;		/* Most threads running processes at once */
+};
+#endif
+
+/* Stacks of processes, see process_stack_stats() */
+struct stack_stats {
+	size_t size;		/* Default size of a stack */
+	size_t stacks;		/* Stacks made */
+	size_t in_use;		/* Stacks of live processes */
+	size_t mapped;		/* Bytes mapped for stacks and guards */
+	size_t resident;	/* Bytes of stacks in memory */
+	size_t high_water;	/* Deepest use of any stack */
+	bool guarded;		/* Every stack has a guard page */
+};
+
+/*
+ * The process table is split into segments of PROC_SEGMENT processes,
+ * which are allocated as the table grows and never move, so a pointer
+ * into the table stays valid.  Slots of dead processes are reused, so
+ * the table only gets as big as the most processes alive at once.
+ */
+#define PROC_SEGMENT_SHIFT	12
+#define PROC_SEGMENT		(1UL << PROC_SEGMENT_SHIFT)
+
+/* The process with index I of simulation S, or of the bound one */
+#define PROC_OF(s, i)							\
+	(s)->procs[(i) >> PROC_SEGMENT_SHIFT][(i) & (PROC_SEGMENT - 1)]
+#define PROC(i)		PROC_OF(sim_self(), i)
+
+/* Number of processes alive */
+#define process_count	(sim_self()->nprocs)
+
+/*
+ * Handle of a process: its index and the generation of the slot.  Once
+ * the process is gone the handle is stale, even if the slot is reused.
+ */
+typedef uint64_t proc_handle_t;
+
+#define PROC_HANDLE_NONE	((proc_handle_t) -1)
+
+/*
+ * The running process.  Coroutines and handlers all run on the thread
+ * of Run(), one at a time; with threads every one knows its own.
+ */
+extern __thread size_t process_current;
+#ifdef PROCESS_thread
+extern void process_pool_stats(struct pool_stats *);
+#endif
+
+static inline size_t process_self(void)
+{
+	return process_current;
+}
 
 extern int create_process(void *(*) (void *), int);
+extern ssize_t create_processes(void *(*) (void *), size_t, int (*) (size_t),
+				double (*) (size_t));
+extern int create_process_stack(void *(*) (void *), int, size_t);
+extern int create_handler(handler_t, void *, int);
+extern void handler_dispatch(size_t);
 extern int destroy_process(size_t);
+extern proc_handle_t process_handle(size_t);
+extern ssize_t process_lookup(proc_handle_t);
+extern size_t process_slots(void);
 extern int Wait(double);
-extern int Quit(void);
+extern int Quit(void) __attribute__ ((noreturn));
+
+/* Stacks, see proc_stack.c */
+extern int process_set_stack_size(size_t);
+extern void process_set_stack_guard(bool);
+extern void process_stack_stats(struct stack_stats *, FILE *);
+extern size_t process_stack_size(size_t);
+extern void *stack_alloc(size_t);
+extern void stack_free(void *, size_t);
+
+/* Process backend, see proc_coro.c and proc_thread.c */
+extern int process_init(size_t);
+extern void process_fini(size_t);
+extern void process_switch(size_t);
+extern void process_yield(size_t);
+extern void process_exit(size_t) __attribute__ ((noreturn));
 
 #endif				/* _PROCESS_H_ */
@@ -29,9 +29,7 @@
 #include "process.h"
 #include "queue.h"
 #include "system.h"
-
-#define debug(fmt, ...) fprintf(stderr, fmt "\n", ## __VA_ARGS__)
-//#define debug(fmt, ...) ((void)0)
+#include "trace.h"
 
 /* Return length of pqueue */
 size_t pq_size(struct pq_t **queue)
@@ -50,7 +48,7 @@ void pq_pop(struct pq_t **queue)
 	if (!pq_empty(queue)) {
 		struct pq_t *tmp = *queue;
 		*queue = (*queue)->next;
-		free(tmp);
+		arena_free(&sim_self()->arena, tmp, sizeof(*tmp));
 	}
 }
 
@@ -82,23 +80,23 @@ void pq_push_attr(struct pq_t **queue, size_t idx, unsigned int attr)
 	struct pq_t *tmp = *queue;
 
 	/* Create new item */
-	struct pq_t *new = xmalloc(sizeof(*new));
+	struct pq_t *new = arena_alloc(&sim_self()->arena, sizeof(*new));
 
 	/* Initialize it */
 	new->idx = idx;
 	new->attr = attr;	// we care about attribute
 
-#define this process_list[idx]
+#define this PROC(idx)
 	/*
 	 * Queue is empty or priority of first item in the queue is (only)
 	 * lower than priority of new item.
 	 */
-	if (pq_empty(queue) || this.prio > process_list[tmp->idx].prio) {
+	if (pq_empty(queue) || this.prio > PROC(tmp->idx).prio) {
 		new->next = tmp;
 		*queue = new;
 	} else {
 		/* Insert item into the linked list according to its priority */
-		while (tmp->next && process_list[tmp->next->idx].prio >= this.prio)
+		while (tmp->next && PROC(tmp->next->idx).prio >= this.prio)
 			tmp = tmp->next;
 		new->next = tmp->next;
 		tmp->next = new;
@@ -118,7 +116,7 @@ void pq_debug(struct pq_t **queue)
 		debug("head ->");
 
 		while (tmp) {
-			debug("\t[item: %zu prio: %d attr: %u]", tmp->idx, process_list[tmp->idx].prio, tmp->attr);
+			debug("\t[item: %zu prio: %d attr: %u]", tmp->idx, PROC(tmp->idx).prio, tmp->attr);
 			tmp = tmp->next;
 		}
 
@@ -0,0 +1,436 @@
+/*
+ * Parallel replications.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The replications are dealt out to the workers in contiguous ranges.
+ * A worker runs its range from the bottom; once it's empty the worker
+ * steals the upper half of what another worker has left, so replications
+ * of very different length still keep all the threads busy.  A range is
+ * only touched under the lock of its worker, which is taken once per
+ * replication.
+ *
+ * Every replication keeps what it observed to itself.  The results are
+ * summed up after all of them ran, in the order of replications, so they
+ * are the same to the last bit whatever the number of threads.
+ */
+
+#include <err.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "error.h"
+#include "facility.h"
+#include "rep.h"
+#include "rng.h"
+#include "sim.h"
+#include "stats.h"
+#include "store.h"
+#include "system.h"
+
+/* One observed value */
+struct obs {
+	char *name;
+	double value;
+};
+
+struct replication {
+	size_t idx;
+	struct rng base;	/* Random numbers start here */
+	struct obs *obs;
+	size_t nobs, aobs;
+};
+
+struct rep_worker {
+	struct rep *rep;
+	unsigned int id;
+	pthread_t th;
+	pthread_mutex_t lock;	/* Protects lo and hi */
+	size_t lo, hi;		/* Replications left to this worker */
+	uint64_t steals;
+} __attribute__ ((aligned(64)));
+
+struct rep {
+	unsigned int nthreads;
+	double level;		/* Confidence level */
+	unsigned long seed;
+	rep_model_t model;
+	void *arg;
+
+	struct replication *reps;
+	size_t nreps;
+	struct rep_worker *w;
+
+	struct rep_result *res;
+	size_t nres;
+	double wall;
+};
+
+/* Create a runner with NTHREADS threads, 0 means one per CPU */
+struct rep *rep_new(unsigned int nthreads)
+{
+	struct rep *r = xcalloc(1, sizeof(*r));
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+	r->nthreads = nthreads ?: (ncpu > 0 ? (unsigned int) ncpu : 1);
+	r->level = 0.95;
+
+	return r;
+}
+
+static void free_results(struct rep *r)
+{
+	size_t i, k;
+
+	for (i = 0; i < r->nreps; i++) {
+		for (k = 0; k < r->reps[i].nobs; k++)
+			free(r->reps[i].obs[k].name);
+		free(r->reps[i].obs);
+	}
+	free(r->reps);
+	free(r->res);
+	r->reps = NULL;
+	r->nreps = 0;
+	r->res = NULL;
+	r->nres = 0;
+}
+
+static void free_workers(struct rep *r)
+{
+	unsigned int k;
+
+	for (k = 0; r->w && k < r->nthreads; k++)
+		pthread_mutex_destroy(&r->w[k].lock);
+	free(r->w);
+	r->w = NULL;
+}
+
+void rep_free(struct rep *r)
+{
+	if (!r)
+		return;
+
+	free_results(r);
+	free_workers(r);
+	free(r);
+}
+
+/* Confidence level of the intervals, 0.95 by default */
+int rep_set_confidence(struct rep *r, double level)
+{
+	if (!(level > 0.0 && level < 1.0)) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	r->level = level;
+	return 0;
+}
+
+/* Seed of the replications */
+void rep_set_seed(struct rep *r, unsigned long seed)
+{
+	r->seed = seed;
+}
+
+/* Number of the replication, from 0 */
+size_t rep_index(const struct replication *rp)
+{
+	return rp->idx;
+}
+
+/* Record VALUE of the quantity NAME in this replication */
+void rep_observe(struct replication *rp, const char *name, double value)
+{
+	const size_t len = strlen(name) + 1;
+
+	if (rp->nobs == rp->aobs) {
+		rp->aobs = rp->aobs ? 2 * rp->aobs : 8;
+		rp->obs = xrealloc(rp->obs, rp->aobs * sizeof(*rp->obs));
+	}
+	rp->obs[rp->nobs].name = memcpy(xmalloc(len), name, len);
+	rp->obs[rp->nobs].value = value;
+	rp->nobs++;
+}
+
+static void observe_stat(struct replication *rp, const char *name,
+			 const char *what, struct stat_t *st)
+{
+	char buf[128];
+
+	if (!times_cnt(st))
+		return;
+	snprintf(buf, sizeof(buf), "%s: %s", name, what);
+	rep_observe(rp, buf, times_avg(st));
+	if (st->sketch) {
+		snprintf(buf, sizeof(buf), "%s: 95th percentile", name);
+		rep_observe(rp, buf, times_quantile(st, 0.95));
+	}
+}
+
+/*
+ * Record the mean of the times saved into the stats of FAC, and their
+ * 95th percentile if the stats have a sketch.  The utilization and the
+ * mean queue length of FAC go along.
+ */
+void rep_observe_fac(struct replication *rp, struct facility_t *fac)
+{
+	char name[64], buf[128];
+
+	if (!fac->name)
+		snprintf(name, sizeof(name), "facility %u", fac->id);
+	observe_stat(rp, fac->name ?: name, "mean time", fac->stats);
+	snprintf(buf, sizeof(buf), "%s: utilization", fac->name ?: name);
+	rep_observe(rp, buf, fac_util(fac));
+	snprintf(buf, sizeof(buf), "%s: mean queue", fac->name ?: name);
+	rep_observe(rp, buf, fac_queue_avg(fac));
+}
+
+/* Record the mean of the times saved into the stats of STORE */
+void rep_observe_store(struct replication *rp, struct store_t *store)
+{
+	char name[64];
+
+	if (!store->name)
+		snprintf(name, sizeof(name), "store %u", store->id);
+	observe_stat(rp, store->name ?: name, "mean time", store->stats);
+}
+
+static void run_one(struct rep *r, size_t i)
+{
+	struct sim *s = sim_new(), *old;
+
+	if (!s)
+		errx(EXIT_FAILURE, "cannot make simulation");
+	s->quiet = 1;
+
+	old = sim_bind(s);
+	rng_reseed(&r->reps[i].base);
+	r->reps[i].idx = i;
+	r->model(&r->reps[i], r->arg);
+	sim_bind(old);
+
+	sim_free(s);
+}
+
+/* Take the next replication of W */
+static bool take(struct rep_worker *w, size_t *i)
+{
+	bool ok;
+
+	pthread_mutex_lock(&w->lock);
+	ok = w->lo < w->hi;
+	if (ok)
+		*i = w->lo++;
+	pthread_mutex_unlock(&w->lock);
+
+	return ok;
+}
+
+/* Move the upper half of the range of another worker to W */
+static bool steal(struct rep_worker *w)
+{
+	struct rep *r = w->rep;
+	unsigned int k;
+
+	for (k = 1; k < r->nthreads; k++) {
+		struct rep_worker *v = &r->w[(w->id + k) % r->nthreads];
+		size_t lo = 0, hi = 0;
+
+		pthread_mutex_lock(&v->lock);
+		if (v->lo < v->hi) {
+			hi = v->hi;
+			lo = v->hi - (v->hi - v->lo + 1) / 2;
+			v->hi = lo;
+		}
+		pthread_mutex_unlock(&v->lock);
+
+		if (lo < hi) {
+			pthread_mutex_lock(&w->lock);
+			w->lo = lo;
+			w->hi = hi;
+			pthread_mutex_unlock(&w->lock);
+			w->steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void *worker_loop(void *arg)
+{
+	struct rep_worker *w = arg;
+	size_t i;
+
+	/* Ranges only shrink, so no work means no more work */
+	do {
+		while (take(w, &i))
+			run_one(w->rep, i);
+	} while (steal(w));
+
+	return NULL;
+}
+
+/* Find or add the result called NAME */
+static struct rep_result *result(struct rep *r, const char *name,
+				 size_t *ares)
+{
+	size_t k;
+
+	for (k = 0; k < r->nres; k++)
+		if (!strcmp(r->res[k].name, name))
+			return &r->res[k];
+
+	if (r->nres == *ares) {
+		*ares = *ares ? 2 * *ares : 16;
+		r->res = xrealloc(r->res, *ares * sizeof(*r->res));
+	}
+	memset(&r->res[r->nres], 0, sizeof(*r->res));
+	r->res[r->nres].name = name;
+
+	return &r->res[r->nres++];
+}
+
+/* Means and confidence intervals, Welford's way */
+static void sum_up(struct rep *r)
+{
+	size_t ares = 0, i, k;
+
+	for (i = 0; i < r->nreps; i++) {
+		for (k = 0; k < r->reps[i].nobs; k++) {
+			const struct obs *o = &r->reps[i].obs[k];
+			struct rep_result *res = result(r, o->name, &ares);
+			const double d = o->value - res->mean;
+
+			res->n++;
+			res->mean += d / res->n;
+			/* stddev holds the sum of squares for now */
+			res->stddev += d * (o->value - res->mean);
+		}
+	}
+
+	for (k = 0; k < r->nres; k++) {
+		struct rep_result *res = &r->res[k];
+
+		if (res->n < 2) {
+			res->stddev = res->half = NAN;
+			continue;
+		}
+		res->stddev = sqrt(res->stddev / (res->n - 1));
+		res->half = student_t(r->level, res->n - 1) * res->stddev
+			    / sqrt(res->n);
+	}
+}
+
+/*
+ * Run NREPS replications of MODEL(replication, ARG).  The results of
+ * the previous run are thrown away.  Returns 0, or -1 when error.
+ */
+int rep_run(struct rep *r, size_t nreps, rep_model_t model, void *arg)
+{
+	struct timespec t0, t1;
+	unsigned int k;
+	size_t i;
+	int e;
+
+	if (!nreps || !model) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	free_results(r);
+	free_workers(r);
+	r->model = model;
+	r->arg = arg;
+	r->nreps = nreps;
+	r->reps = xcalloc(nreps, sizeof(*r->reps));
+
+	/* Every replication gets its own 2^192 numbers */
+	rng_seed(&r->reps[0].base, r->seed);
+	for (i = 1; i < nreps; i++) {
+		r->reps[i].base = r->reps[i - 1].base;
+		rng_long_jump(&r->reps[i].base);
+	}
+
+	r->w = xcalloc(r->nthreads, sizeof(*r->w));
+	for (k = 0; k < r->nthreads; k++) {
+		r->w[k].rep = r;
+		r->w[k].id = k;
+		r->w[k].lo = nreps * k / r->nthreads;
+		r->w[k].hi = nreps * (k + 1) / r->nthreads;
+		if (pthread_mutex_init(&r->w[k].lock, NULL))
+			errx(EXIT_FAILURE, "pthread_mutex_init failed");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (k = 1; k < r->nthreads; k++) {
+		e = pthread_create(&r->w[k].th, NULL, worker_loop, &r->w[k]);
+		if (unlikely(e))
+			errx(EXIT_FAILURE, "pthread_create: %s", strerror(e));
+	}
+	worker_loop(&r->w[0]);
+	for (k = 1; k < r->nthreads; k++)
+		pthread_join(r->w[k].th, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	r->wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	sum_up(r);
+
+	return 0;
+}
+
+/* Results of the last run, *N gets their number */
+const struct rep_result *rep_results(struct rep *r, size_t *n)
+{
+	*n = r->nres;
+	return r->res;
+}
+
+void rep_get_stats(struct rep *r, struct rep_stats *st)
+{
+	unsigned int k;
+
+	memset(st, 0, sizeof(*st));
+	st->replications = r->nreps;
+	st->wall = r->wall;
+	for (k = 0; r->w && k < r->nthreads; k++)
+		st->steals += r->w[k].steals;
+}
+
+/* Print the results of the last run */
+void rep_print(struct rep *r, FILE *fp)
+{
+	size_t k;
+
+	fprintf(fp, "%zu replications, %g%% confidence\n", r->nreps,
+		r->level * 100.0);
+	for (k = 0; k < r->nres; k++) {
+		const struct rep_result *res = &r->res[k];
+
+		fprintf(fp, "%-32s %12.4f +- %-10.4f (sd %.4f, n %zu)\n",
+			res->name, res->mean, res->half, res->stddev, res->n);
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _REP_H_
+#define _REP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * Independent replications of a model run on a pool of threads.  The
+ * model is a function which builds the model, calls Init() and Run()
+ * as usual and then reports what it measured with rep_observe().  Every
+ * replication runs in a simulation of its own (see sim.h).  Its random
+ * streams (see rng.h) are jumped off a base 2^192 numbers after the
+ * base of the previous replication, so no two replications share any
+ * numbers and the results don't depend on the threads.
+ *
+ * Every observed quantity is summed up over the replications into its
+ * mean and the half-width of its confidence interval.
+ */
+struct rep;
+struct replication;
+struct facility_t;
+struct store_t;
+struct stat_t;
+
+typedef void (*rep_model_t)(struct replication *, void *);
+
+/* A quantity over all replications */
+struct rep_result {
+	const char *name;
+	size_t n;		/* Replications which observed it */
+	double mean;
+	double stddev;		/* Sample standard deviation */
+	double half;		/* Half-width of the confidence interval */
+};
+
+/* Counters of a run */
+struct rep_stats {
+	size_t replications;
+	uint64_t steals;	/* Ranges of replications stolen */
+	double wall;		/* Seconds spent in rep_run() */
+};
+
+extern struct rep *rep_new(unsigned int);
+extern void rep_free(struct rep *);
+extern int rep_set_confidence(struct rep *, double);
+extern void rep_set_seed(struct rep *, unsigned long);
+extern int rep_run(struct rep *, size_t, rep_model_t, void *);
+extern const struct rep_result *rep_results(struct rep *, size_t *);
+extern void rep_get_stats(struct rep *, struct rep_stats *);
+extern void rep_print(struct rep *, FILE *);
+
+/* Called from the model */
+extern size_t rep_index(const struct replication *);
+extern void rep_observe(struct replication *, const char *, double);
+extern void rep_observe_fac(struct replication *, struct facility_t *);
+extern void rep_observe_store(struct replication *, struct store_t *);
+
+#endif /* _REP_H_ */
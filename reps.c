@@ -0,0 +1,213 @@
+/*
+ * Replications of a queue with the confidence intervals of the results.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * M/M/1 queue with load 0.8: the mean wait for the counter is 3.2.  The
+ * replications are run with 1, 2, 4, ... threads up to -t; the results
+ * must be the same every time.  The stats of all the replications are
+ * also merged pairwise into one, as if from a single long run.
+ */
+
+#include <err.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cal.h"
+#include "error.h"
+#include "facility.h"
+#include "process.h"
+#include "rep.h"
+#include "rng.h"
+#include "sim.h"
+#include "stats.h"
+#include "system.h"
+
+static double end = 10000.0;
+
+/* Stats of one replication, merged pairwise after the run */
+struct pool {
+	struct stat_t wait;
+	struct tstat util;
+};
+
+static struct pool *pools;
+
+/* One replication, processes reach it through the simulation */
+struct model {
+	struct facility_t fac;
+	struct rng *arrivals;	/* Streams of their own, see rng.h */
+	struct rng *service;
+};
+
+static void *customer(void *arg __unused__)
+{
+	struct model *m = sim_self()->data;
+	double arrived = cur_time;
+
+	Seize(&m->fac);
+	save_time(m->fac.stats, cur_time - arrived);
+	Wait(rng_exponential(m->service, 0.8));
+	Release(&m->fac);
+
+	return NULL;
+}
+
+static void *generator(void *arg __unused__)
+{
+	struct model *m = sim_self()->data;
+
+	for (;;) {
+		if (create_process(customer, 0) == -1)
+			psimerr("create_process");
+		Wait(rng_exponential(m->arrivals, 1.0));
+	}
+
+	return NULL;
+}
+
+static void model(struct replication *rp, void *arg __unused__)
+{
+	struct model m;
+
+	fac_constructor(&m.fac);
+	fac_set_name(&m.fac, "Counter");
+	stats_sketch(m.fac.stats, 0.01);
+	m.arrivals = rng_stream("arrivals");
+	m.service = rng_stream("service");
+	sim_self()->data = &m;
+
+	if (Init(0.0, end) == -1)
+		psimerr("init");
+	if (create_process(generator, 1) == -1)
+		psimerr("create_process");
+	Run();
+
+	rep_observe_fac(rp, &m.fac);
+	rep_observe(rp, "customers", times_cnt(m.fac.stats));
+
+	/* Every replication has a pool of its own, no locking */
+	stats_merge(&pools[rep_index(rp)].wait, m.fac.stats);
+	tstat_merge(&pools[rep_index(rp)].util, &m.fac.util);
+
+	free_times(m.fac.stats);
+	fac_destructor(&m.fac);
+}
+
+/* Merge the N pools into the first, pairwise like a tree */
+static void reduce(size_t n)
+{
+	size_t step, i;
+
+	for (step = 1; step < n; step *= 2)
+		for (i = 0; i + step < n; i += 2 * step) {
+			stats_merge(&pools[i].wait, &pools[i + step].wait);
+			tstat_merge(&pools[i].util, &pools[i + step].util);
+			free_times(&pools[i + step].wait);
+		}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n replications] [-t threads] "
+		"[-e end_time] [-s seed] [-c confidence]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_threads = 4, t;
+	size_t nreps = 100, n, k;
+	unsigned long seed = 1;
+	double level = 0.95, wall1 = 0.0;
+	struct rep_result *first = NULL;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:t:e:s:c:")) != -1) {
+		switch (c) {
+		case 'n':
+			nreps = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			end = strtod(optarg, NULL);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			level = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!nreps || !max_threads)
+		usage(argv[0]);
+
+	for (t = 1; t <= max_threads; t *= 2) {
+		struct rep *r = rep_new(t);
+		const struct rep_result *res;
+		struct rep_stats st;
+
+		pools = xcalloc(nreps, sizeof(*pools));
+		rep_set_seed(r, seed);
+		if (rep_set_confidence(r, level) == -1)
+			psimerr("confidence");
+		if (rep_run(r, nreps, model, NULL) == -1)
+			psimerr("rep_run");
+		res = rep_results(r, &n);
+		rep_get_stats(r, &st);
+
+		reduce(nreps);
+		if (t == 1) {
+			rep_print(r, stdout);
+			printf("merged: %zu customers, mean wait %.4f, sd %.4f, "
+			       "95th percentile %.4f, utilization %.4f\n",
+			       times_cnt(&pools->wait), times_avg(&pools->wait),
+			       times_dev(&pools->wait),
+			       times_quantile(&pools->wait, 0.95),
+			       tstat_avg(&pools->util));
+			first = xmalloc(n * sizeof(*first));
+			memcpy(first, res, n * sizeof(*first));
+			wall1 = st.wall;
+		} else {
+			for (k = 0; k < n; k++)
+				if (res[k].mean != first[k].mean
+				    || res[k].half != first[k].half)
+					errx(EXIT_FAILURE, "%u threads got "
+					     "other results", t);
+		}
+
+		printf("%2u threads: %.3f s, %llu steals, speedup %.2f\n", t,
+		       st.wall, (unsigned long long) st.steals,
+		       wall1 / st.wall);
+		free_times(&pools->wait);
+		free(pools);
+		rep_free(r);
+	}
+
+	free(first);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+/*
+ * Random number streams.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The generator is xoshiro256++, see <http://prng.di.unimi.it/>.  The
+ * streams of a simulation are only made and drawn from by its processes
+ * and the thread running it, one at a time, so nothing here is locked.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rng.h"
+#include "sim.h"
+#include "system.h"
+
+/* A named stream of a simulation */
+struct rng_stream {
+	struct rng rng;
+	char name[];
+};
+
+/* Next output of splitmix64 with state X */
+static uint64_t splitmix(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/*
+ * Seed stream R from SEED, the state is filled in by splitmix64.  R
+ * gets no buffers, see rng_buffer().
+ */
+void rng_seed(struct rng *r, uint64_t seed)
+{
+	int k;
+
+	for (k = 0; k < 4; k++)
+		r->s[k] = splitmix(&seed);
+	r->batch = NULL;
+}
+
+/* Jump R ahead by the polynomial POLY */
+static void jump(struct rng *r, const uint64_t poly[4])
+{
+	uint64_t s[4] = { 0, 0, 0, 0 };
+	int k, b;
+
+	for (k = 0; k < 4; k++)
+		for (b = 0; b < 64; b++) {
+			if (poly[k] & UINT64_C(1) << b) {
+				s[0] ^= r->s[0];
+				s[1] ^= r->s[1];
+				s[2] ^= r->s[2];
+				s[3] ^= r->s[3];
+			}
+			rng_next(r);
+		}
+
+	memcpy(r->s, s, sizeof(s));
+}
+
+/* Move R 2^128 numbers ahead */
+void rng_jump(struct rng *r)
+{
+	static const uint64_t poly[4] = {
+		0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+		0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL,
+	};
+
+	jump(r, poly);
+}
+
+/* Move R 2^192 numbers ahead */
+void rng_long_jump(struct rng *r)
+{
+	static const uint64_t poly[4] = {
+		0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+		0x77710069854ee241ULL, 0x39109bb02acbe635ULL,
+	};
+
+	jump(r, poly);
+}
+
+/* Start buffered stream R at BASE */
+static void start(struct rng *r, const struct rng *base)
+{
+	int k;
+
+	memcpy(r->s, base->s, sizeof(base->s));
+	rng_buffer(r);
+	for (k = 0; k < RNG_KINDS; k++)
+		r->batch->pos[k] = RNG_BATCH;
+}
+
+/*
+ * Seed the streams of the simulation from BASE.  The default stream
+ * starts at BASE, the named streams made so far start over as well.
+ */
+void rng_reseed(const struct rng *base)
+{
+	struct sim *const s = sim_self();
+	size_t k;
+
+	memcpy(s->rng_base.s, base->s, sizeof(base->s));
+	start(&s->rng, &s->rng_base);
+	for (k = 0; k < s->nstreams; k++) {
+		rng_jump(&s->rng_base);
+		start(&s->streams[k]->rng, &s->rng_base);
+	}
+	s->rng_seeded = 1;
+}
+
+static void seed_from_clock(void)
+{
+	struct timespec ts;
+	struct rng base;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	rng_seed(&base, (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec);
+	rng_reseed(&base);
+}
+
+/* Default stream of the simulation */
+struct rng *rng_default(void)
+{
+	struct sim *const s = sim_self();
+
+	if (unlikely(!s->rng_seeded))
+		seed_from_clock();
+	return &s->rng;
+}
+
+/*
+ * Stream called NAME, made if the simulation has none of that name yet.
+ * Streams are numbered in the order they are made, so a model making
+ * them in the same order gets the same numbers from the same seed.
+ */
+struct rng *rng_stream(const char *name)
+{
+	struct sim *const s = sim_self();
+	const size_t len = strlen(name) + 1;
+	struct rng_stream *st;
+	size_t k;
+
+	for (k = 0; k < s->nstreams; k++)
+		if (!strcmp(s->streams[k]->name, name))
+			return &s->streams[k]->rng;
+
+	if (unlikely(!s->rng_seeded))
+		seed_from_clock();
+
+	if (s->nstreams == s->astreams) {
+		s->astreams = s->astreams ? 2 * s->astreams : 8;
+		s->streams = xrealloc(s->streams,
+				      s->astreams * sizeof(*s->streams));
+	}
+
+	st = xmalloc(sizeof(*st) + len);
+	memcpy(st->name, name, len);
+	rng_jump(&s->rng_base);
+	st->rng.batch = NULL;
+	start(&st->rng, &s->rng_base);
+	s->streams[s->nstreams++] = st;
+
+	return &st->rng;
+}
+
+/* Free the streams of simulation S */
+void rng_free_streams(struct sim *s)
+{
+	size_t k;
+
+	rng_unbuffer(&s->rng);
+	for (k = 0; k < s->nstreams; k++) {
+		rng_unbuffer(&s->streams[k]->rng);
+		free(s->streams[k]);
+	}
+	free(s->streams);
+	s->streams = NULL;
+	s->nstreams = s->astreams = 0;
+}
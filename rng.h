@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _RNG_H_
+#define _RNG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Random number streams, xoshiro256++ by Blackman and Vigna.  A stream
+ * is four words of state: drawing from it takes no lock, it belongs to
+ * whoever draws from it.  rng_jump() moves a stream
+ * 2^128 numbers ahead and rng_long_jump() 2^192 numbers ahead, so
+ * streams made by jumping never overlap.
+ *
+ * Every simulation has a default stream, which Random() and the other
+ * variates without a stream draw from, and named streams made by
+ * rng_stream().  They are all jumped off one base: the default stream
+ * is the base itself, the n-th named stream is the base jumped n times.
+ * A simulation draws from a base seeded from the clock unless
+ * RandomSeed() or rng_reseed() seeds it.
+ */
+struct rng_batch;
+
+struct rng {
+	uint64_t s[4];
+	struct rng_batch *batch;	/* Buffered variates or NULL */
+};
+
+struct sim;
+
+/*
+ * A stream may have buffers of variates made RNG_BATCH at a time by
+ * the vector code of rng_batch.c (see rng_buffer()).  The exponentials
+ * and normals of stats.c drawn from such a stream just take the next
+ * one out of the buffer.  Uniforms are drawn straight from the stream,
+ * a buffer would only slow them down.  The streams of a simulation are
+ * buffered.
+ */
+#define RNG_BATCH	256
+
+enum rng_kind {
+	RNG_EXPONENTIAL,	/* Mean 1 */
+	RNG_NORMAL,		/* Mean 0, standard deviation 1 */
+	RNG_KINDS,
+};
+
+struct rng_batch {
+	unsigned int pos[RNG_KINDS];	/* Next one, RNG_BATCH if empty */
+	double v[RNG_KINDS][RNG_BATCH];
+};
+
+static inline uint64_t rng_rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/* Next 64 random bits of stream R */
+static inline uint64_t rng_next(struct rng *r)
+{
+	const uint64_t result = rng_rotl(r->s[0] + r->s[3], 23) + r->s[0];
+	const uint64_t t = r->s[1] << 17;
+
+	r->s[2] ^= r->s[0];
+	r->s[3] ^= r->s[1];
+	r->s[1] ^= r->s[2];
+	r->s[0] ^= r->s[3];
+	r->s[2] ^= t;
+	r->s[3] = rng_rotl(r->s[3], 45);
+
+	return result;
+}
+
+/* Uniform double from <0; 1), all 53 bits of it are random */
+static inline double rng_double(struct rng *r)
+{
+	return (rng_next(r) >> 11) * 0x1.0p-53;
+}
+
+extern void rng_seed(struct rng *, uint64_t);
+extern void rng_jump(struct rng *);
+extern void rng_long_jump(struct rng *);
+
+/* Bulk generation, see rng_batch.c */
+extern void rng_fill_uniform(struct rng *, double *, size_t);
+extern void rng_fill_exponential(struct rng *, double *, size_t);
+extern void rng_fill_normal(struct rng *, double *, size_t);
+extern void rng_buffer(struct rng *);
+extern void rng_unbuffer(struct rng *);
+extern void rng_refill(struct rng *, enum rng_kind);
+
+/* Next variate of kind K from the buffers of stream R */
+static inline double rng_pop(struct rng *r, enum rng_kind k)
+{
+	struct rng_batch *const b = r->batch;
+
+	if (__builtin_expect(b->pos[k] == RNG_BATCH, 0))
+		rng_refill(r, k);
+	return b->v[k][b->pos[k]++];
+}
+
+/* Streams of the simulation bound to the calling thread */
+extern struct rng *rng_default(void);
+extern struct rng *rng_stream(const char *);
+extern void rng_reseed(const struct rng *);
+extern void rng_free_streams(struct sim *);
+
+#endif /* _RNG_H_ */
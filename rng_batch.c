@@ -0,0 +1,274 @@
+/*
+ * Random variates made in bulk.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The raw numbers come from the stream one by one, xoshiro256++ is
+ * cheap enough.  What costs is turning them into variates: a log() per
+ * exponential, a log() and a sqrt() per pair of normals.  That is done
+ * here VLEN numbers at a time with the vector extensions of GCC, which
+ * become AVX2 or SSE2 code, whatever -march allows.  Without either of
+ * them the plain C library is used.
+ *
+ * Uniforms take the top 52 bits of a raw number as the mantissa of a
+ * double from <1; 2) and subtract 1.  Exponentials are -log(1 - u).
+ * Normals come in pairs from Marsaglia's polar method: points are drawn
+ * from the square until 0 < s = v1^2 + v2^2 < 1 and then scaled by
+ * sqrt(-2 log(s) / s), the scaling is done in vectors once there is a
+ * chunk of points.
+ *
+ * log() is the one of fdlibm (__ieee754_log), done for whole vectors.
+ * Every number of a batch goes through the same code, the tail of a
+ * batch is padded to a whole vector, so the results don't depend on
+ * where a number falls in its batch.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rng.h"
+#include "system.h"
+
+#if defined(__AVX2__)
+# define VLEN	4
+#elif defined(__SSE2__)
+# define VLEN	2
+#else
+# define VLEN	1
+#endif
+
+/* Numbers converted at once */
+#define CHUNK	RNG_BATCH
+
+/* Bits of 1.0 */
+#define ONE	0x3ff0000000000000ULL
+
+/* Raw bits X as a uniform from <0; 1) */
+static inline double unit(uint64_t x)
+{
+	union { uint64_t u; double d; } v = { .u = x >> 12 | ONE };
+
+	return v.d - 1.0;
+}
+
+#if VLEN > 1
+typedef double vdouble __attribute__ ((vector_size(VLEN * 8)));
+typedef int64_t vint __attribute__ ((vector_size(VLEN * 8)));
+typedef uint64_t vuint __attribute__ ((vector_size(VLEN * 8)));
+
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+static const double Lg1 = 6.666666666666735130e-01;
+static const double Lg2 = 3.999999999940941908e-01;
+static const double Lg3 = 2.857142874366239149e-01;
+static const double Lg4 = 2.222219843214978396e-01;
+static const double Lg5 = 1.818357216161805012e-01;
+static const double Lg6 = 1.531383769920937332e-01;
+static const double Lg7 = 1.479819860511658591e-01;
+
+/* log() of VLEN positive normal numbers */
+static inline vdouble vlog(vdouble x)
+{
+	const vint bits = (vint) x;
+	vint k = ((bits >> 52) & 0x7ff) - 1023;
+	vint m = (bits & 0x000fffffffffffffLL) | (int64_t) ONE;
+	/* All ones where the mantissa is above sqrt(2) */
+	const vint big = m > 0x3ff6a09e667f3bcdLL;
+	vdouble f, s, z, w, R, hfsq, dk;
+
+	/* Halve those, so that f is in <sqrt(2)/2 - 1; sqrt(2) - 1> */
+	m -= big & 0x0010000000000000LL;
+	k -= big;
+
+	f = (vdouble) m - 1.0;
+	s = f / (2.0 + f);
+	z = s * s;
+	w = z * z;
+	R = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7)))
+	    + w * (Lg2 + w * (Lg4 + w * Lg6));
+	hfsq = 0.5 * f * f;
+	dk = __builtin_convertvector(k, vdouble);
+
+	return dk * ln2_hi - ((hfsq - (s * (hfsq + R) + dk * ln2_lo)) - f);
+}
+
+/* Raw bits of VLEN numbers as uniforms */
+static inline vdouble vunit(vuint x)
+{
+	return (vdouble) (x >> 12 | ONE) - 1.0;
+}
+
+/* Load N <= VLEN numbers from P, the rest of the vector is PAD */
+static inline vdouble vload(const double *p, size_t n, double pad)
+{
+	double tmp[VLEN];
+	vdouble v;
+	size_t k;
+
+	if (likely(n == VLEN)) {
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+	for (k = 0; k < VLEN; k++)
+		tmp[k] = k < n ? p[k] : pad;
+	memcpy(&v, tmp, sizeof(v));
+	return v;
+}
+
+static inline void vstore(double *p, vdouble v, size_t n)
+{
+	memcpy(p, &v, n * sizeof(double));
+}
+#endif
+
+/* Fill OUT with N uniforms from <0; 1) drawn from R */
+void rng_fill_uniform(struct rng *r, double *out, size_t n)
+{
+	size_t i;
+
+#if VLEN > 1
+	uint64_t raw[CHUNK];
+
+	while (n) {
+		const size_t m = min(n, (size_t) CHUNK);
+
+		for (i = 0; i < m; i++)
+			raw[i] = rng_next(r);
+		for (i = 0; i + VLEN <= m; i += VLEN) {
+			vuint v;
+
+			memcpy(&v, raw + i, sizeof(v));
+			vstore(out + i, vunit(v), VLEN);
+		}
+		for (; i < m; i++)
+			out[i] = unit(raw[i]);
+		out += m;
+		n -= m;
+	}
+#else
+	for (i = 0; i < n; i++)
+		out[i] = unit(rng_next(r));
+#endif
+}
+
+/* Fill OUT with N exponentials of mean 1 drawn from R */
+void rng_fill_exponential(struct rng *r, double *out, size_t n)
+{
+	size_t i;
+
+	/* 1 - u is in (0; 1>, so the log() is finite */
+	for (i = 0; i < n; i++)
+		out[i] = 1.0 - unit(rng_next(r));
+
+#if VLEN > 1
+	for (i = 0; i < n; i += VLEN) {
+		const size_t m = min(n - i, (size_t) VLEN);
+
+		vstore(out + i, -vlog(vload(out + i, m, 1.0)), m);
+	}
+#else
+	for (i = 0; i < n; i++)
+		out[i] = -log(out[i]);
+#endif
+}
+
+/* Fill OUT with N standard normals drawn from R */
+void rng_fill_normal(struct rng *r, double *out, size_t n)
+{
+	double v1[CHUNK / 2], v2[CHUNK / 2], s[CHUNK / 2];
+
+	while (n) {
+		const size_t pairs = min((n + 1) / 2, (size_t) CHUNK / 2);
+		size_t i = 0;
+
+		/* Points inside the unit circle */
+		while (i < pairs) {
+			const double a = 2.0 * unit(rng_next(r)) - 1.0;
+			const double b = 2.0 * unit(rng_next(r)) - 1.0;
+			const double q = a * a + b * b;
+
+			if (q > 0.0 && q < 1.0) {
+				v1[i] = a;
+				v2[i] = b;
+				s[i++] = q;
+			}
+		}
+
+		/* s becomes the scale of the pair */
+#if VLEN > 1
+		for (i = 0; i < pairs; i += VLEN) {
+			const size_t m = min(pairs - i, (size_t) VLEN);
+			const vdouble q = vload(s + i, m, 0.5);
+			vdouble f = -2.0 * vlog(q) / q;
+			size_t k;
+
+			for (k = 0; k < VLEN; k++)
+				f[k] = sqrt(f[k]);
+			vstore(s + i, f, m);
+		}
+#else
+		for (i = 0; i < pairs; i++)
+			s[i] = sqrt(-2.0 * log(s[i]) / s[i]);
+#endif
+
+		for (i = 0; i < pairs; i++) {
+			*out++ = v1[i] * s[i];
+			if (--n == 0)
+				break;
+			*out++ = v2[i] * s[i];
+			n--;
+		}
+	}
+}
+
+/* Give stream R buffers, the variates of stats.c will use them */
+void rng_buffer(struct rng *r)
+{
+	int k;
+
+	if (r->batch)
+		return;
+	r->batch = xmalloc(sizeof(*r->batch));
+	for (k = 0; k < RNG_KINDS; k++)
+		r->batch->pos[k] = RNG_BATCH;
+}
+
+/* Drop the buffers of stream R, the numbers left in them are lost */
+void rng_unbuffer(struct rng *r)
+{
+	free(r->batch);
+	r->batch = NULL;
+}
+
+/* Fill the buffer of kind K of stream R */
+void rng_refill(struct rng *r, enum rng_kind k)
+{
+	struct rng_batch *const b = r->batch;
+
+	switch (k) {
+	case RNG_EXPONENTIAL:
+		rng_fill_exponential(r, b->v[k], RNG_BATCH);
+		break;
+	case RNG_NORMAL:
+		rng_fill_normal(r, b->v[k], RNG_BATCH);
+		break;
+	default:
+		abort();
+	}
+	b->pos[k] = 0;
+}
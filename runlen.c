@@ -0,0 +1,379 @@
+/*
+ * Run-length control.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * A watched stat_t keeps at most BATCH_MAX batches.  Batches start with
+ * BATCH_FIRST times; when all BATCH_MAX are full, neighbours are merged
+ * and the batches become twice as long.  So the memory stays the same
+ * however long the run is, and the batches grow long enough for their
+ * means to be nearly independent.
+ *
+ * Each time a batch is full, the watched stat_t is looked at again.
+ * Until its warm-up is over, the truncation point comes from MSER (White,
+ * 1997) on the batch means: the number d of batches to cut off that
+ * minimizes the variance of the mean of the rest divided by their number.
+ * The warm-up is taken as over once d is below half of the batches;
+ * otherwise there is not enough data yet.  Starting with batches of 5
+ * this is MSER-5.  The first d batches are then cut off.  The moments of
+ * the stat_t are made again from the batches that are left, and so are
+ * the kept times.  The sketch and the histogram cannot take values out;
+ * they start over.
+ *
+ * After the warm-up, the mean of the batch means is the estimate and
+ * their variance gives the half-width of the interval, with Student's t
+ * of one less than the number of batches.  As in LBATCH (Fishman and
+ * Yarberry, 1997) the interval is only trusted once the batch means pass
+ * a test of independence, the run goes on while they don't, and the
+ * batches grow.  A trend left over from a warm-up cut off too early
+ * shows there.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cal.h"
+#include "error.h"
+#include "runlen.h"
+#include "sim.h"
+#include "spill.h"
+#include "stats.h"
+#include "system.h"
+
+#define BATCH_FIRST	5
+#define BATCH_MAX	64
+/* Fewest batches the warm-up and the interval are judged by */
+#define BATCH_MIN	20
+/* Fewest times after the warm-up Run() stops with, see run_min() */
+#define RUN_MIN		1000
+
+struct batches {
+	struct moments b[BATCH_MAX];
+	double from[BATCH_MAX];	/* Time of the first time of each */
+	size_t nb;
+	size_t size;		/* Times a batch */
+	struct moments cur;	/* Batch being filled */
+	double cur_from;
+	bool warm;		/* The warm-up is cut off */
+	bool done;		/* Precise enough */
+	double warmup;		/* Time the warm-up ended */
+};
+
+/* Run-length control of a simulation */
+struct runlen {
+	double precision;	/* 0 never stops Run() */
+	double level;
+	size_t min;		/* Fewest times after the warm-up */
+	size_t nwatched, nwarm, ndone;
+	void (*warmup)(void *);
+	void *arg;
+	double t[BATCH_MAX];	/* student_t() by degrees of freedom */
+};
+
+static struct runlen *get_runlen(void)
+{
+	struct sim *const s = sim_self();
+
+	if (unlikely(!s->runlen)) {
+		s->runlen = xcalloc(1, sizeof(*s->runlen));
+		s->runlen->level = 0.95;
+		s->runlen->min = RUN_MIN;
+	}
+	return s->runlen;
+}
+
+/*
+ * Stop Run() once the half-width of the confidence interval at LEVEL
+ * (e.g. 0.95) is within PRECISION times the mean for every watched
+ * stat_t.  PRECISION 0 only keeps the intervals.
+ */
+int run_precision(double precision, double level)
+{
+	struct runlen *rl;
+
+	if (!(precision >= 0.0) || !isfinite(precision)
+	    || !(level > 0.0 && level < 1.0)) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	rl = get_runlen();
+	rl->precision = precision;
+	if (rl->level != level)
+		memset(rl->t, 0, sizeof(rl->t));
+	rl->level = level;
+	return 0;
+}
+
+/*
+ * Never stop before N times have been saved after the warm-up into
+ * every watched stat_t.  The test of independence cannot tell a short
+ * run in a slow drift from a steady state.
+ */
+void run_min(size_t n)
+{
+	get_runlen()->min = n;
+}
+
+/* Watch S, the times saved from now on go into batches */
+int run_watch(struct stat_t *s)
+{
+	struct runlen *const rl = get_runlen();
+
+	if (s->batches)
+		return 0;
+
+	s->batches = xcalloc(1, sizeof(*s->batches));
+	s->batches->size = BATCH_FIRST;
+	s->batches->warmup = NAN;
+	rl->nwatched++;
+	return 0;
+}
+
+/*
+ * Call FN with ARG once the warm-up of every watched stat_t is over, to
+ * reset whatever else the model measures, like the tstats of resources.
+ */
+void run_on_warmup(void (*fn)(void *), void *arg)
+{
+	struct runlen *const rl = get_runlen();
+
+	rl->warmup = fn;
+	rl->arg = arg;
+}
+
+/* Critical value of Student's t with DF degrees of freedom */
+static double crit(struct runlen *rl, size_t df)
+{
+	if (!rl->t[df])
+		rl->t[df] = student_t(rl->level, df);
+	return rl->t[df];
+}
+
+/* Half-width of the interval of the mean of the batches of B */
+static double halfwidth(struct runlen *rl, const struct batches *b,
+			double *mean)
+{
+	double sum = 0.0, ss = 0.0;
+	size_t i;
+
+	for (i = 0; i < b->nb; i++)
+		sum += b->b[i].mean;
+	*mean = sum / b->nb;
+	for (i = 0; i < b->nb; i++)
+		ss += (b->b[i].mean - *mean) * (b->b[i].mean - *mean);
+
+	return crit(rl, b->nb - 1) * sqrt(ss / (b->nb - 1) / b->nb);
+}
+
+/*
+ * Do the batch means of B look independent?  Their lag-1 correlation
+ * must be below what only 5 % of independent means would exceed.
+ */
+static bool independent(const struct batches *b, double mean)
+{
+	double num = 0.0, den = 0.0;
+	size_t i;
+
+	for (i = 0; i < b->nb; i++) {
+		const double y = b->b[i].mean - mean;
+
+		den += y * y;
+		if (i + 1 < b->nb)
+			num += y * (b->b[i + 1].mean - mean);
+	}
+
+	return !(den > 0.0) || num / den < 1.645 / sqrt(b->nb);
+}
+
+/* Merge neighbouring batches of B into twice as long ones */
+static void halve(struct batches *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->nb / 2; i++) {
+		b->b[i] = b->b[2 * i];
+		moments_merge(&b->b[i], &b->b[2 * i + 1]);
+		b->from[i] = b->from[2 * i];
+	}
+	b->nb /= 2;
+	b->size *= 2;
+}
+
+/* Batches of B to cut off by MSER, or B->nb if not yet known */
+static size_t mser(const struct batches *b)
+{
+	const size_t k = b->nb;
+	double s1 = 0.0, s2 = 0.0, best = INFINITY;
+	size_t d = k, best_d = k;
+
+	/* Sums of the means from d up, d going down */
+	while (d-- > 0) {
+		const double y = b->b[d].mean, n = k - d;
+		double v;
+
+		s1 += y;
+		s2 += y * y;
+		if (d > k / 2)
+			continue;
+		v = (s2 - s1 * s1 / n) / (n * n);
+		if (v <= best) {
+			best = v;
+			best_d = d;
+		}
+	}
+
+	return best_d < k / 2 ? best_d : k;
+}
+
+/* Cut the first D batches off S */
+static void cut(struct stat_t *s, size_t d)
+{
+	struct batches *const b = s->batches;
+	struct moments m = { .n = 0 };
+	size_t i;
+
+	memmove(b->b, b->b + d, (b->nb - d) * sizeof(*b->b));
+	memmove(b->from, b->from + d, (b->nb - d) * sizeof(*b->from));
+	b->nb -= d;
+
+	for (i = 0; i < b->nb; i++)
+		moments_merge(&m, &b->b[i]);
+	moments_merge(&m, &b->cur);
+
+	/* Nothing saved before the warm-up ended */
+	if (m.n == s->mom.n)
+		return;
+
+	s->mom = m;
+	if (s->times.nmemb > m.n) {
+		if (s->times.spill)
+			spill_cut(s->times.spill, m.n);
+		else
+			memmove(s->times.arr,
+				s->times.arr + s->times.nmemb - m.n,
+				m.n * sizeof(double));
+		s->times.nmemb = m.n;
+		s->sorted = false;
+	}
+	if (s->sketch)
+		sketch_clear(s->sketch);
+	if (s->hist)
+		hist_clear(s->hist);
+}
+
+/* A batch of S has just been filled */
+static void check(struct stat_t *s)
+{
+	struct sim *const sim = sim_self();
+	struct runlen *const rl = sim->runlen;
+	struct batches *const b = s->batches;
+	double mean, hw;
+	bool done;
+	size_t d;
+
+	if (!b->warm) {
+		if (b->nb < BATCH_MIN)
+			return;
+		d = mser(b);
+		if (d == b->nb)
+			return;
+
+		b->warmup = b->from[d];
+		cut(s, d);
+		b->warm = true;
+		if (++rl->nwarm == rl->nwatched && rl->warmup)
+			rl->warmup(rl->arg);
+	}
+
+	if (b->nb < BATCH_MIN)
+		return;
+
+	hw = halfwidth(rl, b, &mean);
+	done = rl->precision > 0.0 && s->mom.n >= rl->min
+	       && hw <= rl->precision * fabs(mean) && independent(b, mean);
+	if (done != b->done) {
+		b->done = done;
+		if (done)
+			rl->ndone++;
+		else
+			rl->ndone--;
+	}
+
+	if (rl->ndone == rl->nwatched && rl->precision > 0.0)
+		sim->stop = 1;
+}
+
+void batches_add(struct stat_t *s, double t)
+{
+	struct batches *const b = s->batches;
+
+	if (!b->cur.n)
+		b->cur_from = cur_time;
+	moments_add(&b->cur, t);
+	if (b->cur.n < b->size)
+		return;
+
+	b->b[b->nb] = b->cur;
+	b->from[b->nb++] = b->cur_from;
+	memset(&b->cur, 0, sizeof(b->cur));
+	if (b->nb == BATCH_MAX)
+		halve(b);
+
+	check(s);
+}
+
+void batches_free(struct batches *b)
+{
+	struct runlen *const rl = sim_self()->runlen;
+
+	if (!b)
+		return;
+	if (rl) {
+		rl->nwatched--;
+		rl->nwarm -= b->warm;
+		rl->ndone -= b->done;
+	}
+	free(b);
+}
+
+/*
+ * Half-width of the confidence interval of the mean of watched S, NAN
+ * while its warm-up is not over or there are too few batches
+ */
+double times_halfwidth(struct stat_t *s)
+{
+	const struct batches *const b = s->batches;
+	double mean;
+
+	if (!b || !b->warm || b->nb < 2)
+		return NAN;
+	return halfwidth(get_runlen(), b, &mean);
+}
+
+/* Time the warm-up of watched S ended, NAN if not yet */
+double times_warmup(struct stat_t *s)
+{
+	return s->batches ? s->batches->warmup : NAN;
+}
+
+void runlen_free(struct sim *s)
+{
+	free(s->runlen);
+	s->runlen = NULL;
+}
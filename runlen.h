@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _RUNLEN_H_
+#define _RUNLEN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Run-length control.  The times saved into a watched stat_t are
+ * grouped into batches.  Once the warm-up is over, the batch means give
+ * a confidence interval of the mean, and Run() returns as soon as that
+ * interval is narrow enough for every watched stat_t of the simulation.
+ * The end time given to Init() stays a limit.
+ *
+ *	Init(0.0, 1e9);
+ *	run_precision(0.01, 0.95);	(half-width within 1 % of the mean)
+ *	run_watch(fac.stats);
+ *	Run();
+ */
+
+struct batches;
+struct sim;
+struct stat_t;
+
+extern int run_precision(double, double);
+extern void run_min(size_t);
+extern int run_watch(struct stat_t *);
+extern void run_on_warmup(void (*)(void *), void *);
+extern double times_halfwidth(struct stat_t *);
+extern double times_warmup(struct stat_t *);
+
+/* For stats.c and sim.c */
+extern void batches_add(struct stat_t *, double);
+extern void batches_free(struct batches *);
+extern void runlen_free(struct sim *);
+
+#endif /* _RUNLEN_H_ */
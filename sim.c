@@ -0,0 +1,148 @@
+/*
+ * Simulation contexts.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "cal.h"
+#include "error.h"
+#include "process.h"
+#include "runlen.h"
+#include "sim.h"
+#include "system.h"
+#include "trace.h"
+
+/* Simulation of threads which didn't bind any */
+struct sim sim_default = {
+	.cal_lock = PTHREAD_MUTEX_INITIALIZER,
+	.proc_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+__thread struct sim *sim_bound = &sim_default;
+
+/* Make a new simulation, it has to be bound or passed to sim_*() */
+struct sim *sim_new(void)
+{
+	struct sim *s = xcalloc(1, sizeof(*s));
+
+	if (pthread_mutex_init(&s->cal_lock, NULL)
+	    || pthread_mutex_init(&s->proc_lock, NULL)) {
+		free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+/*
+ * Free simulation S with its calendar, process table and the queue
+ * nodes of its facilities and stores.  Processes still alive give their
+ * stacks and threads back.  S must not be bound to the calling thread.
+ */
+void sim_free(struct sim *s)
+{
+	struct sim *old;
+	size_t i;
+
+	if (!s || s == &sim_default)
+		return;
+
+	old = sim_bind(s);
+	for (i = 0; i < s->top; i++)
+		process_fini(i);
+	sim_bind(old);
+
+	if (s->traced)
+		trace_close();
+	calq_free(s->cal);
+	rng_free_streams(s);
+	runlen_free(s);
+	arena_release(&s->arena);
+	for (i = 0; i < s->nsegments; i++)
+		free(s->procs[i]);
+	free(s->procs);
+	free(s->free_slots);
+	pthread_mutex_destroy(&s->cal_lock);
+	pthread_mutex_destroy(&s->proc_lock);
+	free(s);
+}
+
+/*
+ * Bind simulation S to the calling thread, NULL binds the default one.
+ * Returns the simulation bound until now.
+ */
+struct sim *sim_bind(struct sim *s)
+{
+	struct sim *old = sim_bound;
+
+	sim_bound = s ?: &sim_default;
+	return old;
+}
+
+int sim_init(struct sim *s, double t0, double t1)
+{
+	struct sim *old = sim_bind(s);
+	int ret = Init(t0, t1);
+
+	sim_bind(old);
+	return ret;
+}
+
+int sim_run(struct sim *s)
+{
+	struct sim *old = sim_bind(s);
+	int ret = Run();
+
+	sim_bind(old);
+	return ret;
+}
+
+int sim_create_process(struct sim *s, void *(*tf) (void *), int prio)
+{
+	struct sim *old = sim_bind(s);
+	int ret = create_process(tf, prio);
+
+	sim_bind(old);
+	return ret;
+}
+
+int sim_create_handler(struct sim *s, handler_t handler, void *data, int prio)
+{
+	struct sim *old = sim_bind(s);
+	int ret = create_handler(handler, data, prio);
+
+	sim_bind(old);
+	return ret;
+}
+
+/* Current time of simulation S */
+double sim_time(struct sim *s)
+{
+	return s->now;
+}
+
+/* Error number of the last failed call on simulation S */
+int sim_error(struct sim *s)
+{
+	return s->err;
+}
+
+static void __attribute__((destructor)) sim_cleanup(void)
+{
+	arena_release(&sim_default.arena);
+}
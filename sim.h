@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include "rng.h"
+#include "system.h"
+
+/*
+ * A simulation: its calendar, times, process table and error number.
+ * Every thread is bound to one simulation, and Init(), Run(),
+ * create_process(), Seize(), cur_time, simerr and the rest work on that
+ * one.  A thread starts bound to the default simulation, so a program
+ * with a single simulation never sees a struct sim.  Independent
+ * simulations can run at once on different threads: each thread makes
+ * its own with sim_new() and binds it with sim_bind(), or calls the
+ * sim_*() functions, which bind it for the time of the call.  Processes
+ * of a simulation always run bound to it.
+ *
+ * Facilities, stores and stats belong to whichever simulation uses them
+ * and must not be shared.  A trace records every simulation running
+ * while it is open.
+ */
+
+struct activation;
+struct calq;
+struct process_struct;
+struct rng_stream;
+struct runlen;
+
+enum sim_state {
+	SIM_START,
+	SIM_INITIALIZED,
+	SIM_IN_PROGRESS,
+	SIM_TERMINATED,
+};
+
+struct sim {
+	/* Calendar, see cal.c */
+	double start;		/* start_time */
+	double end;		/* end_time */
+	double now;		/* cur_time */
+	enum sim_state state;
+	struct calq *cal;
+	pthread_mutex_t cal_lock;
+	int traced;		/* Init() opened the trace */
+	int quiet;		/* Run() doesn't announce itself */
+
+	/* Process table, see process.c */
+	struct process_struct **procs;	/* Segments */
+	size_t nsegments, asegments;
+	size_t nprocs;		/* Processes alive */
+	size_t top;		/* Slots ever used */
+	size_t *free_slots;	/* Slots to be reused */
+	size_t nfree, afree;
+	pthread_mutex_t proc_lock;
+	size_t stack_size;	/* Default stack, see proc_stack.c */
+
+	/* Random numbers, see rng.c */
+	struct rng rng;		/* Default stream */
+	struct rng rng_base;	/* Base jumped once per named stream */
+	struct rng_stream **streams;	/* Named streams */
+	size_t nstreams, astreams;
+	int rng_seeded;
+
+	/* Queue and log nodes of facilities and stores, see xmalloc.c */
+	struct arena arena;
+
+	/* Run-length control, see runlen.c */
+	struct runlen *runlen;
+	int stop;		/* Run() returns after this event */
+
+	int err;		/* simerr */
+	void *data;		/* Left to the model */
+};
+
+extern struct sim sim_default;
+extern __thread struct sim *sim_bound;
+
+/* Simulation bound to the calling thread */
+static inline struct sim *sim_self(void)
+{
+	return sim_bound;
+}
+
+extern struct sim *sim_new(void);
+extern void sim_free(struct sim *);
+extern struct sim *sim_bind(struct sim *);
+
+/* The same as the functions without sim_, on simulation S */
+extern int sim_init(struct sim *, double, double);
+extern int sim_run(struct sim *);
+extern int sim_create_process(struct sim *, void *(*) (void *), int);
+extern int sim_create_handler(struct sim *,
+			      struct activation (*) (size_t, void *),
+			      void *, int);
+extern double sim_time(struct sim *);
+extern int sim_error(struct sim *);
+
+#endif				/* _SIM_H_ */
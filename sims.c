@@ -0,0 +1,165 @@
+/*
+ * Independent simulations running at once in one process.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Every thread builds its own M/M/1 queue in a simulation of its own
+ * and runs it.  The models are the same, so all of them must serve the
+ * same number of customers as the one run alone before.
+ */
+
+#include <err.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cal.h"
+#include "error.h"
+#include "facility.h"
+#include "process.h"
+#include "sim.h"
+#include "system.h"
+
+/* One model, everything a process needs is reached through it */
+struct model {
+	struct sim *sim;
+	struct facility_t fac;
+	uint64_t rng;
+	unsigned long served;
+};
+
+static double end = 10000.0;
+
+static double exponential(struct model *m, double mean)
+{
+	m->rng ^= m->rng << 13;
+	m->rng ^= m->rng >> 7;
+	m->rng ^= m->rng << 17;
+	return -mean * log(((m->rng >> 11) + 0.5) * (1.0 / 9007199254740992.0));
+}
+
+static void *customer(void *arg __unused__)
+{
+	struct model *m = sim_self()->data;
+
+	Seize(&m->fac);
+	Wait(exponential(m, 0.9));
+	Release(&m->fac);
+	m->served++;
+
+	return NULL;
+}
+
+static void *generator(void *arg __unused__)
+{
+	struct model *m = sim_self()->data;
+
+	for (;;) {
+		if (create_process(customer, 0) == -1)
+			psimerr("create_process");
+		Wait(exponential(m, 1.0));
+	}
+
+	return NULL;
+}
+
+/* Thread of one simulation */
+static void *run(void *arg)
+{
+	struct model *m = arg;
+
+	sim_bind(m->sim);
+
+	fac_constructor(&m->fac);
+	if (Init(0.0, end) == -1)
+		psimerr("init");
+	if (create_process(generator, 1) == -1)
+		psimerr("create_process");
+	if (Run() == -1)
+		psimerr("run");
+	fac_destructor(&m->fac);
+
+	sim_bind(NULL);
+
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n simulations] [-e end_time]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nsims = 8, i;
+	struct model *m;
+	pthread_t *th;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:e:")) != -1) {
+		switch (c) {
+		case 'n':
+			nsims = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			end = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!nsims)
+		usage(argv[0]);
+
+	/* Model 0 runs alone first, the others at once */
+	m = xcalloc(nsims + 1, sizeof(*m));
+	th = xcalloc(nsims, sizeof(*th));
+	for (i = 0; i <= nsims; i++) {
+		m[i].sim = sim_new();
+		if (!m[i].sim)
+			errx(EXIT_FAILURE, "sim_new failed");
+		m[i].sim->data = &m[i];
+		m[i].rng = 0x9E3779B97F4A7C15ULL;
+	}
+
+	run(&m[0]);
+	for (i = 0; i < nsims; i++)
+		if (pthread_create(&th[i], NULL, run, &m[i + 1]))
+			errx(EXIT_FAILURE, "pthread_create failed");
+	for (i = 0; i < nsims; i++)
+		pthread_join(th[i], NULL);
+
+	for (i = 0; i <= nsims; i++) {
+		if (m[i].served != m[0].served)
+			errx(EXIT_FAILURE, "simulation %u served %lu customers, "
+			     "alone %lu", i, m[i].served, m[0].served);
+		sim_free(m[i].sim);
+	}
+	printf("%u simulations at once, %lu customers served in each\n",
+	       nsims, m[0].served);
+
+	free(th);
+	free(m);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,260 @@
+/*
+ * Quantile sketch.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The buckets are those of DDSketch (Masson, Rim and Lee, 2019), a log
+ * histogram in the spirit of HDR Histogram: with g = (1 + a) / (1 - a)
+ * for the relative error a, bucket k counts the values from
+ * (g^(k-1); g^k> and answers with 2 g^k / (g + 1), which is within a of
+ * every one of them.  Negative values have buckets of their own, values
+ * too small to be normal doubles are counted as zeros.  Infinities and
+ * NaN have no bucket and are refused.
+ *
+ * Only the buckets from the least to the biggest key seen are allocated.
+ * Their number grows with the log of the ratio of the biggest and the
+ * least value, not with the number of values: a hundred or so per factor
+ * of ten at 1 %.
+ */
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "sketch.h"
+#include "system.h"
+
+/* Counts of the keys from lo up */
+struct buckets {
+	uint64_t *counts;
+	int lo;
+	size_t len;
+};
+
+struct sketch {
+	double gamma;
+	double inv_log_gamma;
+	uint64_t n;
+	uint64_t zeros;
+	struct buckets pos;	/* Buckets of the positive values */
+	struct buckets neg;	/* And of the magnitudes of the negative ones */
+};
+
+/*
+ * Sketch answering quantiles within the relative error ALPHA, from
+ * (0; 1).  ALPHA must leave the key of DBL_MAX within an int.  Returns
+ * NULL and sets simerr to GLOB_INVAL otherwise.
+ */
+struct sketch *sketch_new(double alpha)
+{
+	struct sketch *sk;
+	double gamma;
+
+	if (!(alpha > 0.0 && alpha < 1.0)) {
+		simerr = GLOB_INVAL;
+		return NULL;
+	}
+	gamma = (1.0 + alpha) / (1.0 - alpha);
+	if (!(log(DBL_MAX) / log(gamma) < INT_MAX)) {
+		simerr = GLOB_INVAL;
+		return NULL;
+	}
+
+	sk = xcalloc(1, sizeof(*sk));
+	sk->gamma = gamma;
+	sk->inv_log_gamma = 1.0 / log(gamma);
+
+	return sk;
+}
+
+void sketch_free(struct sketch *sk)
+{
+	if (!sk)
+		return;
+	free(sk->pos.counts);
+	free(sk->neg.counts);
+	free(sk);
+}
+
+/* Forget the values added to SK, the buckets stay */
+void sketch_clear(struct sketch *sk)
+{
+	if (sk->pos.len)
+		memset(sk->pos.counts, 0, sk->pos.len * sizeof(uint64_t));
+	if (sk->neg.len)
+		memset(sk->neg.counts, 0, sk->neg.len * sizeof(uint64_t));
+	sk->n = sk->zeros = 0;
+}
+
+/* Make room in B for KEY, at least doubling it */
+static void grow(struct buckets *b, int key)
+{
+	const int hi = b->lo + (int) b->len;
+	const int lo = min(b->lo, key), top = max(hi, key + 1);
+	const size_t len = max(2 * b->len, (size_t) (top - lo));
+	/* Spare buckets go to the side we grew at */
+	const int nlo = key < b->lo ? top - (int) len : lo;
+	uint64_t *counts = xcalloc(len, sizeof(*counts));
+
+	memcpy(counts + (b->lo - nlo), b->counts, b->len * sizeof(*counts));
+	free(b->counts);
+	b->counts = counts;
+	b->lo = nlo;
+	b->len = len;
+}
+
+static void buckets_add(struct buckets *b, int key, uint64_t n)
+{
+	if (unlikely(!b->len)) {
+		b->len = 64;
+		b->lo = key - 32;
+		b->counts = xcalloc(b->len, sizeof(*b->counts));
+	} else if (unlikely(key < b->lo || key >= b->lo + (int) b->len)) {
+		grow(b, key);
+	}
+	b->counts[key - b->lo] += n;
+}
+
+/*
+ * Key of the bucket of positive X.  The value of the last bucket may
+ * overflow to infinity when merged, it goes to the bucket of DBL_MAX.
+ */
+static inline int key_of(const struct sketch *sk, double x)
+{
+	const double k = ceil(log(min(x, DBL_MAX)) * sk->inv_log_gamma);
+
+	return (int) k;
+}
+
+/* Value answered for bucket K */
+static double value(const struct sketch *sk, int k)
+{
+	return 2.0 * pow(sk->gamma, k) / (sk->gamma + 1.0);
+}
+
+/*
+ * Count X in SK.  Returns -1 and sets simerr to GLOB_INVAL if X is
+ * infinite or NaN, which SK does not count.
+ */
+int sketch_add(struct sketch *sk, double x)
+{
+	if (unlikely(!isfinite(x))) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	sk->n++;
+	if (x >= DBL_MIN)
+		buckets_add(&sk->pos, key_of(sk, x), 1);
+	else if (x <= -DBL_MIN)
+		buckets_add(&sk->neg, key_of(sk, -x), 1);
+	else
+		sk->zeros++;
+	return 0;
+}
+
+/* Add the buckets B of SRC to those of DST */
+static void merge_buckets(const struct sketch *dst, struct buckets *to,
+			  const struct sketch *src, const struct buckets *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->len; i++) {
+		const int k = b->lo + (int) i;
+
+		if (!b->counts[i])
+			continue;
+		if (dst->gamma == src->gamma)
+			buckets_add(to, k, b->counts[i]);
+		else
+			buckets_add(to, key_of(dst, value(src, k)),
+				    b->counts[i]);
+	}
+}
+
+/*
+ * Add the values of SRC to DST, which then answers as if they had been
+ * added to it one by one.  If the sketches were made with different
+ * relative errors, a value of SRC goes in as the value of its bucket and
+ * the errors add up.
+ */
+void sketch_merge(struct sketch *dst, const struct sketch *src)
+{
+	merge_buckets(dst, &dst->pos, src, &src->pos);
+	merge_buckets(dst, &dst->neg, src, &src->neg);
+	dst->zeros += src->zeros;
+	dst->n += src->n;
+}
+
+/* A new sketch with the values of SK */
+struct sketch *sketch_copy(const struct sketch *sk)
+{
+	struct sketch *c = xcalloc(1, sizeof(*c));
+
+	c->gamma = sk->gamma;
+	c->inv_log_gamma = sk->inv_log_gamma;
+	sketch_merge(c, sk);
+
+	return c;
+}
+
+uint64_t sketch_count(const struct sketch *sk)
+{
+	return sk->n;
+}
+
+/*
+ * The Q-quantile, Q from <0; 1>, of the values added to SK.  It is the
+ * value of rank Q (n - 1), counted from 0, up to the relative error.
+ * NAN if SK is empty or Q out of range.
+ */
+double sketch_quantile(const struct sketch *sk, double q)
+{
+	const struct buckets *b;
+	double rank, seen = 0.0;
+	size_t i;
+
+	if (!sk->n || !(q >= 0.0 && q <= 1.0))
+		return NAN;
+
+	rank = q * (sk->n - 1);
+
+	/* From the most negative value up */
+	b = &sk->neg;
+	for (i = b->len; i-- > 0; ) {
+		seen += b->counts[i];
+		if (seen > rank)
+			return -value(sk, b->lo + (int) i);
+	}
+
+	seen += sk->zeros;
+	if (seen > rank)
+		return 0.0;
+
+	b = &sk->pos;
+	for (i = 0; i < b->len; i++) {
+		seen += b->counts[i];
+		if (seen > rank)
+			return value(sk, b->lo + (int) i);
+	}
+
+	/* Not reached, RANK is below n */
+	return NAN;
+}
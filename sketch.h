@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SKETCH_H_
+#define _SKETCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Quantile sketch.  Values are counted in buckets growing geometrically,
+ * so that any quantile is answered within the relative error given when
+ * the sketch is made, whatever the number of values.
+ */
+struct sketch;
+
+extern struct sketch *sketch_new(double);
+extern void sketch_free(struct sketch *);
+extern void sketch_clear(struct sketch *);
+extern int sketch_add(struct sketch *, double);
+extern void sketch_merge(struct sketch *, const struct sketch *);
+extern struct sketch *sketch_copy(const struct sketch *);
+extern uint64_t sketch_count(const struct sketch *);
+extern double sketch_quantile(const struct sketch *, double);
+
+#endif /* _SKETCH_H_ */
@@ -0,0 +1,233 @@
+/*
+ * Times spilled into a memory-mapped file.
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * The file grows by SPILL_CHUNK times at once, and only the chunk being
+ * written is mapped.  Chunks written before are unmapped and left to the
+ * kernel to write back, so the times take no more memory than one chunk
+ * however many there are.  The header is rewritten with every new chunk
+ * and on close; the unused end of the last chunk is cut off then.
+ *
+ * For queries all the times are mapped read-only, again when more have
+ * been added since.  The pages are read in as they are touched.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spill.h"
+#include "system.h"
+
+#define SPILL_DATA	4096		/* Offset of the times */
+#define SPILL_CHUNK	(1 << 20)	/* Times the file grows by, 8 MiB */
+
+/* A mapping of a part of the file */
+struct mapping {
+	void *base;
+	size_t len;
+};
+
+struct spill {
+	int fd;
+	bool writable;
+	uint32_t data;
+	uint64_t count;
+	uint64_t first;
+	struct mapping win;	/* Chunk being written */
+	double *cur;		/* Its times */
+	uint64_t cur_from;	/* Index of cur[0] */
+	struct mapping all;	/* All times, for spill_times() */
+	uint64_t all_count;	/* Times mapped there */
+};
+
+/* Map LEN bytes of the file of SP from OFF, aligned or not */
+static void *map(struct spill *sp, struct mapping *m, off_t off, size_t len,
+		 int prot)
+{
+	const off_t skip = off % sysconf(_SC_PAGESIZE);
+	void *p;
+
+	p = mmap(NULL, len + skip, prot, MAP_SHARED, sp->fd, off - skip);
+	if (p == MAP_FAILED)
+		return NULL;
+	m->base = p;
+	m->len = len + skip;
+	return (char *) p + skip;
+}
+
+static void unmap(struct mapping *m)
+{
+	if (m->base)
+		munmap(m->base, m->len);
+	m->base = NULL;
+}
+
+static int put_hdr(struct spill *sp)
+{
+	struct spill_hdr hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SPILL_MAGIC, sizeof(hdr.magic));
+	hdr.size = sizeof(double);
+	hdr.data = sp->data;
+	hdr.count = sp->count;
+	hdr.first = sp->first;
+	return pwrite(sp->fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) ? 0 : -1;
+}
+
+/* Create the file PATH for times to be added, NULL and errno on error */
+struct spill *spill_create(const char *path)
+{
+	struct spill *sp;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1)
+		return NULL;
+
+	sp = xcalloc(1, sizeof(*sp));
+	sp->fd = fd;
+	sp->writable = true;
+	sp->data = SPILL_DATA;
+	if (ftruncate(fd, SPILL_DATA) || put_hdr(sp)) {
+		close(fd);
+		free(sp);
+		return NULL;
+	}
+	return sp;
+}
+
+/* Open the file PATH written before, NULL and errno on error */
+struct spill *spill_open(const char *path)
+{
+	struct spill_hdr hdr;
+	struct spill *sp;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fstat(fd, &st)
+	    || memcmp(hdr.magic, SPILL_MAGIC, sizeof(hdr.magic))
+	    || hdr.size != sizeof(double) || hdr.data < sizeof(hdr)
+	    || hdr.data % sizeof(double)
+	    || hdr.first > hdr.count
+	    || (uint64_t) st.st_size < hdr.data + hdr.count * sizeof(double)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	sp = xcalloc(1, sizeof(*sp));
+	sp->fd = fd;
+	sp->data = hdr.data;
+	sp->count = hdr.count;
+	sp->first = hdr.first;
+	return sp;
+}
+
+/* Map the next chunk of SP to write */
+static int grow(struct spill *sp)
+{
+	const off_t off = sp->data + sp->count * sizeof(double);
+	const size_t len = SPILL_CHUNK * sizeof(double);
+	int e;
+
+	unmap(&sp->win);
+	e = posix_fallocate(sp->fd, off, len);
+	if (e) {
+		errno = e;
+		return -1;
+	}
+	sp->cur = map(sp, &sp->win, off, len, PROT_READ | PROT_WRITE);
+	if (!sp->cur)
+		return -1;
+	sp->cur_from = sp->count;
+	return put_hdr(sp);
+}
+
+/* Add T to the end of SP, made by spill_create() */
+void spill_add(struct spill *sp, double t)
+{
+	if (unlikely(!sp->cur || sp->count - sp->cur_from == SPILL_CHUNK)
+	    && grow(sp))
+		err(EXIT_FAILURE, "cannot spill times");
+	sp->cur[sp->count++ - sp->cur_from] = t;
+}
+
+/* Leave the last N times to spill_times(), the ones before are warm-up */
+void spill_cut(struct spill *sp, size_t n)
+{
+	sp->first = sp->count - min((uint64_t) n, sp->count);
+	if (sp->writable)
+		put_hdr(sp);
+}
+
+/*
+ * The times of SP after the warm-up, their number in N.  Adding more
+ * times takes the array away.  NULL if there are none, or with errno
+ * if they cannot be mapped.
+ */
+const double *spill_times(struct spill *sp, size_t *n)
+{
+	const double *t;
+
+	*n = 0;
+	if (sp->first == sp->count)
+		return NULL;
+
+	if (!sp->all.base || sp->all_count != sp->count) {
+		unmap(&sp->all);
+		t = map(sp, &sp->all, sp->data,
+			sp->count * sizeof(double), PROT_READ);
+		if (!t)
+			return NULL;
+		madvise(sp->all.base, sp->all.len, MADV_SEQUENTIAL);
+		sp->all_count = sp->count;
+	}
+
+	t = (const double *) ((char *) sp->all.base + sp->all.len)
+	    - (sp->count - sp->first);
+	*n = sp->count - sp->first;
+	return t;
+}
+
+/* Finish the file of SP and free it, the file stays */
+void spill_close(struct spill *sp)
+{
+	if (!sp)
+		return;
+
+	unmap(&sp->win);
+	unmap(&sp->all);
+	if (sp->writable
+	    && (ftruncate(sp->fd, sp->data + sp->count * sizeof(double))
+		|| put_hdr(sp)))
+		warn("cannot finish spilled times");
+	close(sp->fd);
+	free(sp);
+}
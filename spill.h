@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SPILL_H_
+#define _SPILL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Times spilled into a file.  The file is a header followed by the
+ * times as native doubles, in the order they were saved.  Analysis
+ * tools can map it and read them in place:
+ *
+ *	struct spill *sp = spill_open("wait.times");
+ *	const double *t = spill_times(sp, &n);
+ */
+#define SPILL_MAGIC	"DSIMTIM1"
+struct spill_hdr {
+	char magic[8];
+	uint32_t size;		/* sizeof(double) */
+	uint32_t data;		/* Offset of the first time */
+	uint64_t count;		/* Times in the file */
+	uint64_t first;		/* Times before it are the warm-up */
+};
+
+struct spill;
+
+extern struct spill *spill_create(const char *);
+extern struct spill *spill_open(const char *);
+extern void spill_add(struct spill *, double);
+extern void spill_cut(struct spill *, size_t);
+extern const double *spill_times(struct spill *, size_t *);
+extern void spill_close(struct spill *);
+
+#endif /* _SPILL_H_ */
@@ -30,15 +30,19 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include "cal.h"
+#include "error.h"
+#include "rng.h"
+#include "runlen.h"
+#include "sim.h"
+#include "sketch.h"
+#include "spill.h"
 #include "stats.h"
 #include "system.h"
 
 //#define debug(fmt, ...) fprintf(stderr, fmt, ## __VA_ARGS__)
 #define debug(fmt, ...) ((void)0)
 
-const __possibly_unused unsigned int seed[3] =
-    { 0x12344321U, 0xEE11DD22U, 0xFEDCBA98 };
-
 /* Structure holding stats */
 static struct {
 	double *arr;		/* Array of times */
@@ -79,6 +83,11 @@ Statistics\n\
 	fprintf(fp, FMT"Maximum:"END"            \033[1;34m%6.2f min\033[0m\n", times_max(s));
 	fprintf(fp, FMT"Minimum:"END"            \033[1;34m%6.2f min\033[0m\n", times_min(s));
 	fprintf(fp, FMT"Standard deviation:"END" \033[1;34m%6.2f min\033[0m\n", times_dev(s));
+	if (!isnan(times_quantile(s, 0.5))) {
+		fprintf(fp, FMT"Median:"END"             \033[1;34m%6.2f min\033[0m\n", times_quantile(s, 0.5));
+		fprintf(fp, FMT"95th percentile:"END"    \033[1;34m%6.2f min\033[0m\n", times_quantile(s, 0.95));
+		fprintf(fp, FMT"99th percentile:"END"    \033[1;34m%6.2f min\033[0m\n", times_quantile(s, 0.99));
+	}
 
 	fputs(print_header ? "\033[1;32m\n\
 Histogram\n\
@@ -106,32 +115,152 @@ static void sort_times(struct stat_t *s)
 	s->sorted = true;
 }
 
-//static __attribute__ ((destructor))
-void free_times(struct stat_t *s)
+/* Bins of a round of select_kth() */
+#define SELECT_BINS	4096
+
+/* Is X in [LO, HI), or [LO, HI] with TOP? */
+static inline bool in_range(double x, double lo, double hi, bool top)
+{
+	return x >= lo && (x < hi || (top && x == hi));
+}
+
+/* Bin of X between the SELECT_BINS + 1 EDGES */
+static size_t edge_bin(const double *edges, double x)
+{
+	size_t lo = 0, hi = SELECT_BINS;
+
+	while (hi - lo > 1) {
+		const size_t mid = (lo + hi) / 2;
+
+		if (x < edges[mid])
+			hi = mid;
+		else
+			lo = mid;
+	}
+	return lo;
+}
+
+/*
+ * The K-th least of the N times T, which stay as they are.  They are
+ * counted into bins from the least to the biggest, then those in the
+ * bin of the K-th into bins again, until few enough are left to sort.
+ * Each round reads T once.
+ */
+static double select_kth(const double *t, size_t n, size_t k)
+{
+	size_t *cnt = xmalloc(SELECT_BINS * sizeof(*cnt));
+	double *edges = xmalloc((SELECT_BINS + 1) * sizeof(*edges));
+	double lo = t[0], hi = t[0], *buf, r;
+	size_t i, b, m, below = 0, inside = n;
+	bool top = true;
+
+	for (i = 1; i < n; i++) {
+		lo = min(lo, t[i]);
+		hi = max(hi, t[i]);
+	}
+
+	while (inside > SELECT_BINS && lo < hi) {
+		for (b = 0; b < SELECT_BINS; b++)
+			edges[b] = lo + (hi - lo) * b / SELECT_BINS;
+		edges[SELECT_BINS] = hi;
+
+		memset(cnt, 0, SELECT_BINS * sizeof(*cnt));
+		for (i = 0; i < n; i++)
+			if (in_range(t[i], lo, hi, top))
+				cnt[edge_bin(edges, t[i])]++;
+		for (b = 0; b < SELECT_BINS - 1 && below + cnt[b] <= k; b++)
+			below += cnt[b];
+
+		/* LO and HI are next to each other */
+		if (edges[b] == lo && edges[b + 1] == hi)
+			break;
+		inside = cnt[b];
+		top = top && b == SELECT_BINS - 1;
+		lo = edges[b];
+		hi = edges[b + 1];
+	}
+
+	if (inside > SELECT_BINS) {
+		/* Only LO and HI are left */
+		for (m = 0, i = 0; i < n; i++)
+			m += t[i] == lo;
+		r = k - below < m ? lo : hi;
+	} else {
+		buf = xmalloc(inside * sizeof(*buf));
+		for (m = 0, i = 0; i < n; i++)
+			if (in_range(t[i], lo, hi, top))
+				buf[m++] = t[i];
+		qsort(buf, m, sizeof(*buf), compare);
+		r = buf[k - below];
+		free(buf);
+	}
+
+	free(edges);
+	free(cnt);
+	return r;
+}
+
+/* The kept times of S, their number in N */
+static const double *kept_times(struct stat_t *s, size_t *n)
+{
+	if (s->times.spill)
+		return spill_times(s->times.spill, n);
+	*n = s->times.nmemb;
+	return s->times.arr;
+}
+
+static void drop_times(struct stat_t *s)
 {
+	spill_close(s->times.spill);
 	free(s->times.arr);
+	memset(&s->times, 0, sizeof(s->times));
+	s->sorted = false;
 }
 
-/* Return random number from <0; 1) */
-double Random(void)
+/* Free the kept times, the sketch, the histogram and the batches of S */
+//static __attribute__ ((destructor))
+void free_times(struct stat_t *s)
 {
-	return (double)(random() / (double)RAND_MAX);
+	drop_times(s);
+	batches_free(s->batches);
+	s->batches = NULL;
+	sketch_free(s->sketch);
+	s->sketch = NULL;
+	hist_free(s->hist);
+	s->hist = NULL;
 }
 
-/* Returns number from <M; N) */
-double Uniform(double M, double N)
+/* Seed the random numbers of the simulation */
+void RandomSeed(unsigned long val)
 {
-	return M + random() / (RAND_MAX / (N - M + 1.0) + 1.0);
+	struct rng base;
+
+	rng_seed(&base, val);
+	rng_reseed(&base);
 }
 
 /*
- * Normal distribution:
- * x = mean +/- std_dev * sqrt((-2.0) * log(y)), 0 < y <= 1
+ * The exponentials and normals below take the next number out of the
+ * buffers of stream R if it has them, see rng_batch.c.  Otherwise they
+ * draw one by one.
  */
-double Normal(double mean, double std_dev)
+
+/* Return random number from <0; 1) drawn from stream R */
+double rng_random(struct rng *r)
+{
+	return rng_double(r);
+}
+
+/* Returns number from <M; N) */
+double rng_uniform(struct rng *r, double M, double N)
+{
+	return M + (N - M) * rng_random(r);
+}
+
+/* Normal distribution, Marsaglia's polar method */
+double rng_normal(struct rng *r, double mean, double std_dev)
 {
-	double y;
-	unsigned int bin;
+	double v1, v2, s;
 
 	errno = 0;
 
@@ -142,149 +271,516 @@ double Normal(double mean, double std_dev)
 		return mean;
 	}
 
-	/* 0.0 <= y < 1.0 */
-	y = (double) (random() / (double) (RAND_MAX + 1.0));
-	bin  = (y < 0.5) ? 0 : 1;
-	y = fabs(y - 1.0);                        /* 0.0 < y <= 1.0 */
-	y = std_dev * sqrt((-2.0) * log(y));
+	if (likely(r->batch))
+		return mean + std_dev * rng_pop(r, RNG_NORMAL);
 
-	return bin ? (mean + y) : (mean - y);
-}
+	/* A point inside the unit circle, the other normal is wasted */
+	do {
+		v1 = 2.0 * rng_double(r) - 1.0;
+		v2 = 2.0 * rng_double(r) - 1.0;
+		s = v1 * v1 + v2 * v2;
+	} while (s >= 1.0 || s == 0.0);
 
+	return mean + std_dev * v1 * sqrt(-2.0 * log(s) / s);
+}
 
 /*
  * The exponential distribution has the form
  *	p(x) dx = exp(-x/mu) dx/mu
  */
-double Exponential(double mu)
+double rng_exponential(struct rng *r, double mu)
 {
-	/* `u' in <0; 1) */
-	double u = Random();
-	debug("<%s> From <0; 1): %f\n", __FILE__, u);
+	double u;
+
+	if (likely(r->batch))
+		return mu * rng_pop(r, RNG_EXPONENTIAL);
+
+	/* `u' in (0; 1> so that log() stays finite */
+	u = 1.0 - rng_double(r);
+	debug("<%s> From (0; 1>: %f\n", __FILE__, u);
 
 	return -mu * log(u);
 }
 
-static void __attribute__ ((constructor)) set_seed(void)
+/* The same drawn from the default stream of the simulation */
+double Random(void)
+{
+	return rng_random(rng_default());
+}
+
+double Uniform(double M, double N)
+{
+	return rng_uniform(rng_default(), M, N);
+}
+
+double Normal(double mean, double std_dev)
 {
-	debug("<%s> Setting seed...\n", __FILE__);
+	return rng_normal(rng_default(), mean, std_dev);
+}
 
-	/* Set seed */
-	srandom(time(NULL));
+double Exponential(double mu)
+{
+	return rng_exponential(rng_default(), mu);
 }
 
 size_t internal_function_def times_cnt(struct stat_t *s)
 {
-	return s->times.nmemb;
+	return s->mom.n;
 }
 
+/* The queries below are NAN with no times saved */
 double internal_function_def times_avg(struct stat_t *s)
 {
-	return times_sum(s) / times_cnt(s);
+	return s->mom.n ? s->mom.mean : NAN;
 }
 
 double internal_function_def times_max(struct stat_t *s)
 {
-	if (!s->sorted)
-		sort_times(s);
-
-	return s->times.arr[s->times.nmemb - 1];
+	return s->mom.n ? s->mom.max : NAN;
 }
 
 double internal_function_def times_min(struct stat_t *s)
 {
-	if (!s->sorted)
-		sort_times(s);
-
-	return s->times.arr[0];
+	return s->mom.n ? s->mom.min : NAN;
 }
 
 double times_sum(struct stat_t *s)
 {
-	size_t i;
-	double sum = 0.0;
-
-	for (i = 0; i < s->times.nmemb; i++)
-		sum += s->times.arr[i];
+	return s->mom.sum;
+}
 
-	return sum;
+/* Variance of the times, divided by their number, not one less */
+double times_var(struct stat_t *s)
+{
+	return s->mom.n ? s->mom.m2 / s->mom.n : NAN;
 }
 
 /* See <http://en.wikipedia.org/wiki/Standard_deviation> */
 double times_dev(struct stat_t *s)
 {
-	const double mean = times_avg(s);
-	double total = 0.0;
+	return sqrt(times_var(s));
+}
+
+/*
+ * The Q-quantile of the times, Q from <0; 1>.  From the sketch it is
+ * kept within [min; max]; from the kept times it is interpolated
+ * between the two nearest.  NAN if there is neither or Q is bad.
+ */
+double times_quantile(struct stat_t *s, double q)
+{
+	double pos;
 	size_t i;
 
-	/*
-	 * Compute the difference of each data point from the mean, and square
-	 * the result of each:
-	 */
-	for (i = 0; i < s->times.nmemb; i++) {
-		const double diff = s->times.arr[i] - mean;
-		total += (diff * diff);
+	if (!(q >= 0.0 && q <= 1.0) || !s->mom.n)
+		return NAN;
+
+	if (s->sketch)
+		return min(max(sketch_quantile(s->sketch, q), s->mom.min),
+			   s->mom.max);
+
+	if (!s->times.nmemb)
+		return NAN;
+
+	/* Spilled times cannot be sorted in place */
+	if (s->times.spill) {
+		size_t n;
+		const double *t = spill_times(s->times.spill, &n);
+		double a;
+
+		if (!t)
+			return NAN;
+		pos = q * (n - 1);
+		i = (size_t) pos;
+		a = select_kth(t, n, i);
+		if (i + 1 >= n)
+			return a;
+		return a + (pos - i) * (select_kth(t, n, i + 1) - a);
 	}
 
-	/* Compute the average of these values, and take the square root */
-	total /= s->times.nmemb;
-	return sqrt(total);
+	if (!s->sorted)
+		sort_times(s);
+
+	pos = q * (s->times.nmemb - 1);
+	i = (size_t) pos;
+	if (i + 1 >= s->times.nmemb)
+		return s->times.arr[s->times.nmemb - 1];
+	return s->times.arr[i] + (pos - i) * (s->times.arr[i + 1]
+					     - s->times.arr[i]);
+}
+
+static void tstat_start(struct tstat *ts)
+{
+	ts->started = true;
+	ts->start = ts->last = start_time;
+	ts->level = ts->area = 0.0;
+	ts->max = max(ts->max, 0.0);
+}
+
+/* The level of TS is LEVEL from now on */
+void tstat_set(struct tstat *ts, double level)
+{
+	if (unlikely(!ts->started))
+		tstat_start(ts);
+
+	ts->area += ts->level * (cur_time - ts->last);
+	ts->last = cur_time;
+	ts->level = level;
+	if (level > ts->max)
+		ts->max = level;
+}
+
+/* The level of TS changes by DELTA */
+void tstat_add(struct tstat *ts, double delta)
+{
+	tstat_set(ts, (ts->started ? ts->level : 0.0) + delta);
+}
+
+/* Integrate TS from now on, its level stays */
+void tstat_reset(struct tstat *ts)
+{
+	const double level = ts->started ? ts->level : 0.0;
+
+	ts->started = true;
+	ts->start = ts->last = cur_time;
+	ts->area = ts->past_area = ts->past_span = 0.0;
+	ts->level = ts->max = level;
 }
 
-/* Print HISTOGRAM_SYMBOL for every number in interval (from; to>? */
-static void print_syms(struct stat_t *s, FILE *fp, double from, double to)
+double tstat_level(const struct tstat *ts)
+{
+	return ts->started ? ts->level : 0.0;
+}
+
+/* Integral of the level of TS up to now */
+double tstat_area(const struct tstat *ts)
+{
+	if (!ts->started)
+		return ts->past_area;
+	return ts->past_area + ts->area + ts->level * (cur_time - ts->last);
+}
+
+/* Time TS has been integrated over up to now */
+double tstat_span(const struct tstat *ts)
+{
+	if (!ts->started)
+		return ts->past_span;
+	return ts->past_span + cur_time - ts->start;
+}
+
+/* Average level of TS up to now, the level itself if no time passed */
+double tstat_avg(const struct tstat *ts)
+{
+	const double span = tstat_span(ts);
+
+	if (!(span > 0.0))
+		return tstat_level(ts);
+	return tstat_area(ts) / span;
+}
+
+/* The highest level of TS */
+double tstat_max(const struct tstat *ts)
+{
+	return ts->max;
+}
+
+/*
+ * Add SRC, integrated up to now, to DST.  The averages of DST are then
+ * over the time of both, as if one came after the other.  Call it
+ * bound to the simulation of SRC, DST may be of any.
+ */
+void tstat_merge(struct tstat *dst, const struct tstat *src)
+{
+	dst->past_area += tstat_area(src);
+	dst->past_span += tstat_span(src);
+	dst->max = max(dst->max, src->max);
+}
+
+/*
+ * Add the stats SRC to DST: the moments exactly, the sketch and the
+ * histogram as if the times of SRC had been counted into those of DST,
+ * which gets copies if it has none, and the kept times if DST keeps
+ * them.  Batches of run-length control are not merged.  The histograms
+ * must have the same bins; returns -1 and sets simerr to GLOB_INVAL
+ * otherwise, with DST as it was.  Merging is associative, so results of
+ * threads or replications can be summed up in any tree.
+ */
+int stats_merge(struct stat_t *dst, struct stat_t *src)
 {
 	size_t i;
-	static size_t last_stop;
 
-	/* It'll be more effective, if we operate on sorted array */
-	if (s->sorted)
-		sort_times(s);
+	/* The only thing that can fail goes first */
+	if (src->hist) {
+		if (!dst->hist)
+			dst->hist = hist_copy(src->hist);
+		else if (hist_merge(dst->hist, src->hist))
+			return -1;
+	}
 
-	/* Go through remaining elements */
-	for (i = last_stop; i < s->times.nmemb; i++) {
-		if (s->times.arr[i] > to) {
-			/*
-			 * No point in searching further -- all the
-			 * remaining elements are bigger.
-			 */
-			last_stop = i;
-			break;
+	if (src->sketch) {
+		if (!dst->sketch)
+			dst->sketch = sketch_copy(src->sketch);
+		else
+			sketch_merge(dst->sketch, src->sketch);
+	}
+
+	moments_merge(&dst->mom, &src->mom);
+
+	if (dst->keep_times && src->times.nmemb) {
+		size_t m;
+		const double *t = kept_times(src, &m);
+		const size_t n = dst->times.nmemb + m;
+
+		if (dst->times.spill) {
+			for (i = 0; i < m; i++)
+				spill_add(dst->times.spill, t[i]);
+			dst->times.nmemb = n;
+			return 0;
+		}
+		if (n > dst->times.allocated) {
+			dst->times.allocated = max(n, 2 * dst->times.allocated);
+			dst->times.arr = xrealloc(dst->times.arr,
+						  dst->times.allocated
+						  * sizeof(double));
 		}
-		if (s->times.arr[i] >= from && s->times.arr[i] < to)
-			/* Found it */
-			fputc(HISTOGRAM_SYMBOL, fp);
+		memcpy(dst->times.arr + dst->times.nmemb, t, m * sizeof(double));
+		dst->times.nmemb = n;
+		dst->sorted = false;
+	}
+
+	return 0;
+}
+
+/* Continued fraction of the incomplete beta function, see betacf() in NR */
+static double betacf(double a, double b, double x)
+{
+	const double tiny = 1e-300;
+	double c = 1.0, d = 1.0 - (a + b) * x / (a + 1.0), h;
+	int m;
+
+	d = 1.0 / (fabs(d) < tiny ? tiny : d);
+	h = d;
+	for (m = 1; m < 300; m++) {
+		const double m2 = 2.0 * m;
+		double aa = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2)), del;
+
+		d = 1.0 + aa * d;
+		d = 1.0 / (fabs(d) < tiny ? tiny : d);
+		c = 1.0 + aa / c;
+		c = fabs(c) < tiny ? tiny : c;
+		h *= d * c;
+
+		aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+		d = 1.0 + aa * d;
+		d = 1.0 / (fabs(d) < tiny ? tiny : d);
+		c = 1.0 + aa / c;
+		c = fabs(c) < tiny ? tiny : c;
+		del = d * c;
+		h *= del;
+		if (fabs(del - 1.0) < 1e-15)
+			break;
+	}
+
+	return h;
+}
+
+/* Regularized incomplete beta function I_x(a, b) */
+static double ibeta(double a, double b, double x)
+{
+	double bt;
+
+	if (x <= 0.0)
+		return 0.0;
+	if (x >= 1.0)
+		return 1.0;
+
+	bt = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x)
+		 + b * log1p(-x));
+	if (x < (a + 1.0) / (a + b + 2.0))
+		return bt * betacf(a, b, x) / a;
+	return 1.0 - bt * betacf(b, a, 1.0 - x) / b;
+}
+
+/*
+ * Critical value of Student's t distribution with DF degrees of freedom
+ * for a two-sided confidence LEVEL (e.g. 0.95): the mean of n samples
+ * is within student_t(level, n - 1) * s / sqrt(n) with probability
+ * LEVEL.  Returns NAN for bad arguments.
+ */
+double student_t(double level, size_t df)
+{
+	const double tail = (1.0 - level) / 2.0;
+	double lo = 0.0, hi = 1.0;
+	int k;
+
+	if (!df || !(level > 0.0 && level < 1.0))
+		return NAN;
+
+	/* P(|T| > t) = I_{df / (df + t^2)}(df / 2, 1 / 2) */
+	while (ibeta(df / 2.0, 0.5, df / (df + hi * hi)) / 2.0 > tail)
+		hi *= 2.0;
+	for (k = 0; k < 100; k++) {
+		const double t = (lo + hi) / 2.0;
+
+		if (ibeta(df / 2.0, 0.5, df / (df + t * t)) / 2.0 > tail)
+			lo = t;
+		else
+			hi = t;
 	}
+
+	return (lo + hi) / 2.0;
 }
 
-/* Print a histogram */
+/*
+ * Print the histogram of S, from its own one if it has it.  Otherwise
+ * the kept times are counted into NBINS + 1 bins as wide as NBINS of
+ * them from the least to the biggest time.
+ */
 void print_histogram(struct stat_t *s, FILE *fp, size_t nbins)
 {
-	struct histogram h;
-	size_t i;
-	const double min = times_min(s);
-	double step = min;
-
-	/* Fill the histogram struct */
-	h.n = nbins ?: 1;
-	h.range = ((times_max(s) - min) / h.n);
-
-	/* Go through all the bins */
-	for (i = 0; i <= h.n; i++) {
-		fprintf(fp, "< %8.2f; %8.2f ): ", step, step + h.range);
-		print_syms(s, fp, step, step + h.range);
-		step += h.range;
-		fputc('\n', fp);
+	const double *t;
+	struct hist *h;
+	double min, range;
+	size_t i, n;
+
+	if (s->hist) {
+		hist_print(s->hist, fp);
+		return;
+	}
+
+	t = kept_times(s, &n);
+	if (!n) {
+		fputs("(no times kept)\n", fp);
+		return;
+	}
+
+	nbins = nbins ?: 1;
+	min = times_min(s);
+	range = (times_max(s) - min) / nbins;
+	h = hist_linear(min, min + (nbins + 1) * (range > 0.0 ? range : 1.0),
+			nbins + 1);
+	for (i = 0; i < n; i++)
+		hist_add(h, t[i]);
+	hist_print(h, fp);
+	hist_free(h);
+}
+
+/* Add T to the moments M, Welford's update */
+void moments_add(struct moments *m, double t)
+{
+	const double delta = t - m->mean;
+
+	if (!m->n++) {
+		m->min = m->max = t;
+	} else {
+		if (t < m->min)
+			m->min = t;
+		if (t > m->max)
+			m->max = t;
+	}
+	m->sum += t;
+	m->mean += delta / m->n;
+	m->m2 += delta * (t - m->mean);
+}
+
+/*
+ * Add the moments SRC to DST, as if the times of SRC were added one by
+ * one, up to rounding (Chan, Golub and LeVeque)
+ */
+void moments_merge(struct moments *dst, const struct moments *src)
+{
+	const double delta = src->mean - dst->mean;
+	const size_t n = dst->n + src->n;
+
+	if (!src->n)
+		return;
+	if (!dst->n) {
+		*dst = *src;
+		return;
 	}
+
+	dst->m2 += src->m2 + delta * delta * ((double) dst->n * src->n / n);
+	dst->mean += delta * src->n / n;
+	dst->sum += src->sum;
+	dst->min = min(dst->min, src->min);
+	dst->max = max(dst->max, src->max);
+	dst->n = n;
+}
+
+/* Keep the times themselves from now on, or drop them */
+void stats_keep_times(struct stat_t *s, bool keep)
+{
+	s->keep_times = keep;
+	if (!keep)
+		drop_times(s);
 }
 
-/* Add new time into times array */
-void save_time(struct stat_t *stats, double t)
+/*
+ * Keep the times of S in the file PATH from now on, see spill.h.  Only
+ * a chunk of them is in memory at a time.  The times kept so far go
+ * there first.  Returns -1 if the file cannot be made.
+ */
+int stats_spill(struct stat_t *s, const char *path)
 {
+	struct spill *sp;
+	const double *t;
+	size_t i, n;
+
+	if (!path) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+	sp = spill_create(path);
+	if (!sp)
+		return -1;
+
+	t = kept_times(s, &n);
+	for (i = 0; i < n; i++)
+		spill_add(sp, t[i]);
+	drop_times(s);
+	s->times.spill = sp;
+	s->times.nmemb = n;
+	s->keep_times = true;
+	return 0;
+}
+
+/*
+ * Answer quantiles of S from a sketch within the relative error ALPHA
+ * (see sketch.c).  Only the times saved from now on get into it.
+ */
+int stats_sketch(struct stat_t *s, double alpha)
+{
+	struct sketch *sk = sketch_new(alpha);
+
+	if (!sk)
+		return -1;
+	sketch_free(s->sketch);
+	s->sketch = sk;
+	return 0;
+}
+
+/*
+ * Count the times saved from now on into H, see hist.h.  S takes H
+ * over, NULL drops the one S has.
+ */
+void stats_hist(struct stat_t *s, struct hist *h)
+{
+	hist_free(s->hist);
+	s->hist = h;
+}
+
+/* Keep T among the times of STATS */
+static void keep_time(struct stat_t *stats, double t)
+{
+	if (stats->times.spill) {
+		spill_add(stats->times.spill, t);
+		stats->times.nmemb++;
+		return;
+	}
+
 	/* Do we need to allocate more space? */
 	if (stats->times.nmemb + 1 > stats->times.allocated) {
-		/* Add space for ten elements */
-		stats->times.allocated += 10;
+		stats->times.allocated = stats->times.allocated
+					 ? 2 * stats->times.allocated : 64;
 		size_t newsize = stats->times.allocated * sizeof(double);
 		stats->times.arr = (double *)xrealloc(stats->times.arr, newsize);
 	}
@@ -299,6 +795,33 @@ void save_time(struct stat_t *stats, double t)
 	stats->sorted = false;
 }
 
+/*
+ * Add new time into the stats.  T is kept before the batches see it, a
+ * warm-up cut off there trims the kept times with T among them.
+ * Returns -1 and sets simerr to GLOB_INVAL if T is infinite or NaN,
+ * which the stats don't take.
+ */
+int save_time(struct stat_t *stats, double t)
+{
+	if (unlikely(!isfinite(t))) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	moments_add(&stats->mom, t);
+
+	if (stats->keep_times)
+		keep_time(stats, t);
+	if (stats->batches)
+		batches_add(stats, t);
+	if (stats->sketch)
+		sketch_add(stats->sketch, t);
+	if (stats->hist)
+		hist_add(stats->hist, t);
+
+	return 0;
+}
+
 static void test_print_times(void)
 {
 	size_t i;
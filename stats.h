@@ -19,43 +19,107 @@
 #define _STATS_H_
 
 #include "system.h"
+#include "rng.h"
+#include "hist.h"
+#include "sketch.h"
 #include <stdbool.h>
 
-/* A histogram structure */
-struct histogram {
-	size_t n;	/* Number of histogram bins */
-	double range;	/* Range of the bins */
-};
+struct spill;
 
 /* Structure holding stats */
 struct times {
 	double *arr;		/* Array of times */
 	size_t nmemb;		/* Number of elements */
 	size_t allocated;	/* Allocated elements */
+	struct spill *spill;	/* Or the times are in a file, see spill.h */
+};
+
+/* Moments of the times, updated as they come (Welford's method) */
+struct moments {
+	size_t n;		/* Number of times */
+	double sum;
+	double mean;
+	double m2;		/* Sum of squared differences from the mean */
+	double min;
+	double max;
 };
 
-/* The statistics structure */
+/*
+ * The statistics structure.  All the times_*() but the histogram only
+ * need the moments.  The times themselves are kept only if asked for
+ * with stats_keep_times(), in memory, or in a file with stats_spill().
+ * Quantiles come from the sketch if there is one (see stats_sketch())
+ * and from the kept times otherwise.  So does the histogram, from the
+ * one given by stats_hist() or else made from the kept times when
+ * printed.
+ */
 struct stat_t {
+	struct moments mom;
 	struct times times;
+	struct sketch *sketch;
+	struct hist *hist;
+	struct batches *batches;	/* Batch means, see runlen.c */
+	bool keep_times;
 	bool sorted;
 	char p[0];
 };
 
+/*
+ * A level changing in time, like the length of a queue, integrated over
+ * time as it changes.  It starts at 0 at the start time of the
+ * simulation, or at the time of tstat_reset().  The queries go up to
+ * the current time.  Other tstats merged in count as time before that.
+ */
+struct tstat {
+	bool started;
+	double start;		/* Integrated since */
+	double last;		/* Time of the last change */
+	double level;		/* Level since then */
+	double area;		/* Integral from start to last */
+	double max;
+	double past_area;	/* Integral of the merged tstats */
+	double past_span;	/* And their time */
+};
+
 #define HISTOGRAM_SYMBOL	'*'
 
 extern void print_stats(struct stat_t *, size_t, bool);
 extern void stats_foo(void);
 extern double Exponential(double);
 extern double Random(void);
+extern void RandomSeed(unsigned long);
 extern double Uniform(double, double);
 extern double Normal(double, double);
-extern void save_time(struct stat_t *, double);
+extern double rng_random(struct rng *);
+extern double rng_uniform(struct rng *, double, double);
+extern double rng_exponential(struct rng *, double);
+extern double rng_normal(struct rng *, double, double);
+extern int save_time(struct stat_t *, double);
+extern void moments_add(struct moments *, double);
+extern void moments_merge(struct moments *, const struct moments *);
+extern void stats_keep_times(struct stat_t *, bool);
+extern int stats_spill(struct stat_t *, const char *);
+extern int stats_sketch(struct stat_t *, double);
+extern void stats_hist(struct stat_t *, struct hist *);
 extern size_t internal_function_def times_cnt(struct stat_t *);
 extern double times_sum(struct stat_t *);
 extern double internal_function_def times_avg(struct stat_t *);
 extern double internal_function_def times_min(struct stat_t *);
 extern double internal_function_def times_max(struct stat_t *);
+extern double times_var(struct stat_t *);
 extern double times_dev(struct stat_t *);
+extern double times_quantile(struct stat_t *, double);
+extern double student_t(double, size_t);
+extern void tstat_set(struct tstat *, double);
+extern void tstat_add(struct tstat *, double);
+extern void tstat_reset(struct tstat *);
+extern double tstat_level(const struct tstat *);
+extern double tstat_area(const struct tstat *);
+extern double tstat_span(const struct tstat *);
+extern double tstat_avg(const struct tstat *);
+extern double tstat_max(const struct tstat *);
+extern void tstat_merge(struct tstat *, const struct tstat *);
+extern int stats_merge(struct stat_t *, struct stat_t *);
 extern void free_times(struct stat_t *s);
 extern void print_histogram(struct stat_t *, FILE *, size_t);
 extern void output_file(const char *);
@@ -0,0 +1,154 @@
+/*
+ * Steady-state mean of a queue with run-length control.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * M/M/1 queue with load 0.9, whose steady-state mean wait is 8.1 and
+ * utilization 0.9.  It starts with -b customers at the counter, so the
+ * first waits are far too long.  The run stops once the mean wait is
+ * known within -p of itself; the warm-up is cut off on the way.  With
+ * -f every wait after the warm-up is spilled into a file, see times_dump.
+ */
+
+#include <err.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "cal.h"
+#include "error.h"
+#include "facility.h"
+#include "process.h"
+#include "rng.h"
+#include "runlen.h"
+#include "sim.h"
+#include "stats.h"
+#include "system.h"
+
+static struct facility_t fac;
+static struct rng *arrivals, *service;
+
+static void *customer(void *arg __unused__)
+{
+	double arrived = cur_time;
+
+	Seize(&fac);
+	save_time(fac.stats, cur_time - arrived);
+	Wait(rng_exponential(service, 0.9));
+	Release(&fac);
+
+	return NULL;
+}
+
+static void *generator(void *arg __unused__)
+{
+	for (;;) {
+		Wait(rng_exponential(arrivals, 1.0));
+		if (create_process(customer, 0) == -1)
+			psimerr("create_process");
+	}
+
+	return NULL;
+}
+
+/* The warm-up is over, measure the facility from now on */
+static void warmed_up(void *arg __unused__)
+{
+	tstat_reset(&fac.util);
+	tstat_reset(&fac.qlen);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-p precision] [-c confidence] "
+		"[-b backlog] [-e end_time] [-s seed] [-f times_file]\n",
+		prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	double precision = 0.02, level = 0.95, end = 1e9;
+	unsigned long seed = 1, backlog = 100, i;
+	const char *spill = NULL;
+	int c;
+
+	while ((c = getopt(argc, argv, "p:c:b:e:s:f:")) != -1) {
+		switch (c) {
+		case 'p':
+			precision = strtod(optarg, NULL);
+			break;
+		case 'c':
+			level = strtod(optarg, NULL);
+			break;
+		case 'b':
+			backlog = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			end = strtod(optarg, NULL);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			spill = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	fac_constructor(&fac);
+	fac_set_name(&fac, "Counter");
+	if (spill && stats_spill(fac.stats, spill) == -1)
+		err(EXIT_FAILURE, "%s", spill);
+	RandomSeed(seed);
+	arrivals = rng_stream("arrivals");
+	service = rng_stream("service");
+
+	if (Init(0.0, end) == -1)
+		psimerr("init");
+	if (run_precision(precision, level) == -1)
+		psimerr("run_precision");
+	run_watch(fac.stats);
+	run_on_warmup(warmed_up, NULL);
+
+	for (i = 0; i < backlog; i++)
+		if (create_process(customer, 0) == -1)
+			psimerr("create_process");
+	if (create_process(generator, 0) == -1)
+		psimerr("create_process");
+	Run();
+
+	printf("stopped at %.1f after %zu customers, warm-up until %.1f\n",
+	       cur_time, times_cnt(fac.stats), times_warmup(fac.stats));
+	printf("mean wait   %.3f +- %.3f  (8.1 in theory)\n",
+	       times_avg(fac.stats), times_halfwidth(fac.stats));
+	printf("utilization %.3f          (0.9 in theory)\n", fac_util(&fac));
+	printf("mean queue  %.3f          (8.1 in theory)\n",
+	       fac_queue_avg(&fac));
+	if (spill)
+		printf("median wait %.3f, 95th percentile %.3f\n",
+		       times_quantile(fac.stats, 0.5),
+		       times_quantile(fac.stats, 0.95));
+
+	free_times(fac.stats);
+	fac_destructor(&fac);
+
+	return EXIT_SUCCESS;
+}
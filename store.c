@@ -30,9 +30,10 @@
 #include "system.h"
 #include "store.h"
 #include "cal.h"
+#include "trace.h"
 
-#define debug(fmt, ...) fprintf(stderr, fmt, ## __VA_ARGS__)
-//#define debug(fmt, ...) ((void)0)
+/* Last store number given out */
+static unsigned int last_id;
 
 /*
  * Constructor of the store.
@@ -40,31 +41,29 @@
  */
 void store_constructor(struct store_t *store)
 {
+	store->id = __atomic_add_fetch(&last_id, 1, __ATOMIC_RELAXED);
 	store->name = NULL;
 	store->capacity = (unsigned int)0;
 	store->free_capacity = (unsigned int)0;
 	store->queue = NULL;
 	store->stats = xcalloc(1, sizeof(struct stat_t));
+	memset(&store->used, 0, sizeof(store->used));
+	memset(&store->qlen, 0, sizeof(store->qlen));
 	log_init(&store->log);
-	store->first_available = -1;
-	if (pthread_mutex_init(&store->slock, NULL)
-	    || pthread_cond_init(&store->scond, NULL))
-		err(EXIT_FAILURE, _("pthread init failed"));
 }
 
 /*
  * Destructor of the store.
- * All allocated memory is freed.
+ * Queue and log nodes belong to the arena of the simulation and go away
+ * with it.
  */
 void store_destructor(struct store_t *store)
 {
 	free(store->name);
-	free(store->queue);
+	free_times(store->stats);
 	free(store->stats);
-	log_clear(&store->log);
-	free(store->log);
-	pthread_cond_destroy(&store->scond);
-	pthread_mutex_destroy(&store->slock);
+	store->queue = NULL;
+	store->log = NULL;
 }
 
 /*
@@ -95,10 +94,9 @@ void store_clear(struct store_t *store)
 	store->capacity = (unsigned int)0;
 	store->free_capacity = (unsigned int)0;
 	pq_clear(&store->queue);
-	store->queue = NULL;
 	log_clear(&store->log);
-	free(store->log);
-	store->log = NULL;
+	memset(&store->used, 0, sizeof(store->used));
+	memset(&store->qlen, 0, sizeof(store->qlen));
 }
 
 /*
@@ -152,11 +150,11 @@ bool store_full(struct store_t * store)
 }
 
 /*
- * Process idx blocks capacity of the store.
- * If there isn't enough free capacity, process is queued in
- * the priority queue.
+ * Process idx asks for capacity of the store.  Returns true if it got
+ * it, false if it was queued in the priority queue; Leave() then grants
+ * the capacity and activates it.
  */
-void Enter(struct store_t *store, size_t idx, unsigned int capacity)
+bool store_request(struct store_t *store, size_t idx, unsigned int capacity)
 {
 	assert(capacity <= store->capacity);
 
@@ -165,20 +163,30 @@ void Enter(struct store_t *store, size_t idx, unsigned int capacity)
 	 * process blockes capacity and make a record in log
 	 */
 	if (pq_empty(&store->queue) && store_free(store) >= capacity) {
-		pthread_mutex_lock(&store->slock);
 		store->free_capacity -= capacity;
+		tstat_add(&store->used, capacity);
 		log_add_capacity(&store->log, idx, capacity);
-	} else {	/* no free capacity -> process in queue */
-		store_queue_in(store, idx, capacity);
-		pthread_cond_signal(&process_list[idx].cond);
-	
-		if (store->first_available == (ssize_t) idx)			
-			return;
-
-		do
-			pthread_cond_wait(&store->scond, &store->slock);
-		while (store->first_available != (ssize_t) idx);
+		trace(TRACE_RESOURCE, TR_ENTER, cur_time, idx,
+		      PROC(idx).state, store->id, capacity);
+		return true;
 	}
+
+	/* no free capacity -> process in queue */
+	store_queue_in(store, idx, capacity);
+	trace(TRACE_RESOURCE, TR_STORE_QUEUE, cur_time, idx,
+	      PROC(idx).state, store->id, capacity);
+	return false;
+}
+
+/*
+ * Process idx blocks capacity of the store.
+ * If there isn't enough free capacity, process is stopped until
+ * it gets it.
+ */
+void (Enter)(struct store_t *store, size_t idx, unsigned int capacity)
+{
+	if (!store_request(store, idx, capacity))
+		process_yield(idx);
 }
 
 /*
@@ -187,23 +195,22 @@ void Enter(struct store_t *store, size_t idx, unsigned int capacity)
  * the store) is removed from the queue and served (add note into
  * the log).
  */
-void Leave(struct store_t *store, size_t idx, unsigned int capacity)
+void (Leave)(struct store_t *store, size_t idx, unsigned int capacity)
 {
 	/* process tries to return more capacity than it has blocked */
 	assert((int) capacity <= log_process_capacity(&store->log, idx));
 
 	/* leave capacity (add to the free capacity, remove from log */
+	trace(TRACE_RESOURCE, TR_LEAVE, cur_time, idx,
+	      PROC(idx).state, store->id, capacity);
 	store->free_capacity += capacity;
+	tstat_add(&store->used, -(double) capacity);
 	log_del_capacity(&store->log, idx, capacity);
-	store->first_available = (ssize_t) -1;
-	pthread_mutex_unlock(&store->slock);
 
 	/* is no process is pending in the queue, no one is served */
 	if (pq_empty(&store->queue))
 		return;
 
-	pthread_mutex_lock(&store->slock);
-
 	/*
 	 * firstly we find process which can be served (it demands less
 	 * or equal capacity as is free capacity)
@@ -220,6 +227,8 @@ void Leave(struct store_t *store, size_t idx, unsigned int capacity)
 		return;
 
 	/* otherwise del is process which is about to be served */
+	const unsigned int granted = pq_top_attr(&del);
+	const size_t next = (size_t) pq_top(&del);
 	struct pq_t *tmp = store->queue;
 	if (tmp != del) {
 		/* we find previous item */
@@ -229,27 +238,24 @@ void Leave(struct store_t *store, size_t idx, unsigned int capacity)
 		/* new process blockes the capacity */
 		store->free_capacity -= pq_top_attr(&del);
 
-		store->first_available = pq_top(&del);
-
 		log_add_capacity(&store->log, pq_top(&del), pq_top_attr(&del));
 		/* and it is removed from the queue */
 		tmp->next = del->next;
-		free(del);
+		arena_free(&sim_self()->arena, del, sizeof(*del));
 	} else {
 		/* is del is the very first item in the queue */
 		store->free_capacity -= pq_top_attr(&tmp);
-		
-		store->first_available = pq_top(&del);
-		
+
 		log_add_capacity(&store->log, pq_top(&tmp), pq_top_attr(&tmp));
 		pq_pop(&store->queue);
 	}
 
-	process_list[store->first_available].atime = cur_time;
-	add_elem(store->first_available);
-
-	pthread_cond_broadcast(&store->scond);
-	pthread_mutex_unlock(&store->slock);
+	tstat_add(&store->used, granted);
+	tstat_add(&store->qlen, -1.0);
+	trace(TRACE_RESOURCE, TR_ENTER, cur_time, next,
+	      PROC(next).state, store->id, granted);
+	PROC(next).atime = cur_time;
+	add_elem(next);
 }
 
 /*
@@ -266,6 +272,40 @@ size_t store_queue_len(struct store_t *store)
 void store_queue_in(struct store_t *store, size_t idx, unsigned int capacity)
 {
 	pq_push_attr(&store->queue, idx, capacity);
+	tstat_add(&store->qlen, 1.0);
+}
+
+/*
+ * Time-weighted stats of the store, up to now since the start of the
+ * simulation or since the tstats were reset.
+ */
+
+/* Average used capacity */
+double store_used_avg(struct store_t *store)
+{
+	return tstat_avg(&store->used);
+}
+
+double store_used_max(struct store_t *store)
+{
+	return tstat_max(&store->used);
+}
+
+/* Average used part of the capacity */
+double store_util(struct store_t *store)
+{
+	return store->capacity ? tstat_avg(&store->used) / store->capacity
+			       : 0.0;
+}
+
+double store_queue_avg(struct store_t *store)
+{
+	return tstat_avg(&store->qlen);
+}
+
+double store_queue_max(struct store_t *store)
+{
+	return tstat_max(&store->qlen);
 }
 
 /*
@@ -284,7 +324,7 @@ void log_clear(struct log_t **log)
 	struct log_t *tmp = *log;
 	while (tmp) {
 		*log = (*log)->next;
-		free(tmp);
+		arena_free(&sim_self()->arena, tmp, sizeof(*tmp));
 		tmp = *log;
 	}
 }
@@ -332,7 +372,7 @@ void log_add_capacity(struct log_t **log, size_t idx, unsigned int capacity)
 	}
 
 	/* process isn't in the list -> new item is allocated */
-	struct log_t *new = xmalloc(sizeof(*new));
+	struct log_t *new = arena_alloc(&sim_self()->arena, sizeof(*new));
 	new->idx = idx;
 	new->capacity = capacity;
 	tmp = *log;
@@ -375,7 +415,7 @@ void log_del_capacity(struct log_t **log, size_t idx, unsigned int capacity)
 	/* remove item from the log list (if process is the first item) */
 	if (tmp == *log) {
 		*log = (*log)->next;
-		free(tmp);
+		arena_free(&sim_self()->arena, tmp, sizeof(*tmp));
 		return;
 	}
 
@@ -388,5 +428,5 @@ void log_del_capacity(struct log_t **log, size_t idx, unsigned int capacity)
 
 	/* then we free the item */
 	tmp->next = del->next;
-	free(del);
+	arena_free(&sim_self()->arena, del, sizeof(*del));
 }
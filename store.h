@@ -19,8 +19,11 @@
 #define _STORE_H_
 
 #include <stdbool.h>
-#include <pthread.h>
+#include <sys/types.h>
+#include "process.h"
 #include "queue.h"
+#include "stats.h"
+#include "system.h"
 
 struct log_t {
 	struct log_t *next;	/* next item */
@@ -34,10 +37,10 @@ struct store_t {
 	unsigned int free_capacity;
 	struct pq_t *queue;	/* priority queue for pending processes */
 	struct log_t *log;	/* log of occupied capacity */
-	ssize_t first_available;
-	pthread_cond_t scond;
-	pthread_mutex_t slock;
+	unsigned int id;	/* store number in traces */
 	struct stat_t *stats;  /* stats of store */
+	struct tstat used;	/* used capacity */
+	struct tstat qlen;	/* length of the queue */
 };
 
 void store_constructor(struct store_t *);
@@ -51,10 +54,22 @@ unsigned int store_free(struct store_t *);
 unsigned int store_used(struct store_t *);
 bool store_empty(struct store_t *);
 bool store_full(struct store_t *);
-void Enter(struct store_t *, size_t, unsigned int);
-void Leave(struct store_t *, size_t, unsigned int);
+bool store_request(struct store_t *, size_t, unsigned int);
+void (Enter)(struct store_t *, size_t, unsigned int);
+void (Leave)(struct store_t *, size_t, unsigned int);
 size_t store_queue_len(struct store_t *);
 void store_queue_in(struct store_t *, size_t, unsigned int);
+double store_used_avg(struct store_t *);
+double store_used_max(struct store_t *);
+double store_util(struct store_t *);
+double store_queue_avg(struct store_t *);
+double store_queue_max(struct store_t *);
+
+/* Enter(store, n) and Leave(store, n) are for the running process */
+#define Enter(...) __PICK3(__VA_ARGS__, (Enter), __enter_self, )(__VA_ARGS__)
+#define Leave(...) __PICK3(__VA_ARGS__, (Leave), __leave_self, )(__VA_ARGS__)
+#define __enter_self(store, n) (Enter)((store), CURRENT(), (n))
+#define __leave_self(store, n) (Leave)((store), CURRENT(), (n))
 
 /* work with log */
 void log_init(struct log_t **);
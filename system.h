@@ -48,6 +48,10 @@
 #define round_up(x, y) ((((x)-1) | __round_mask(x, y))+1)
 #define round_down(x, y) ((x) & ~__round_mask(x, y))
 
+/* NAME out of the ones after the arguments, by how many there are */
+#define __PICK2(_1, _2, NAME, ...) NAME
+#define __PICK3(_1, _2, _3, NAME, ...) NAME
+
 #define FIELD_SIZEOF(t, f) (sizeof(((t*)0)->f))
 #define DIV_ROUND_UP(n,d) (((n) + (d) - 1) / (d))
 #define roundup(x, y) ((((x) + ((y) - 1)) / (y)) * (y))
@@ -104,9 +108,33 @@
 #define prefetch(x) __builtin_prefetch(x)
 #define prefetchw(x) __builtin_prefetch(x,1)
 
+/* Allocation counters, see alloc_stats_get() */
+struct alloc_stats {
+	size_t mallocs;		/* xmalloc() and xcalloc() calls */
+	size_t reallocs;	/* xrealloc() calls */
+};
+
+/* Arena of small nodes, see xmalloc.c.  All zeros is an empty one. */
+#define ARENA_ALIGN	16		/* Granularity of size classes */
+#define ARENA_MAX	256		/* Bigger requests go to malloc() */
+#define ARENA_CLASSES	(ARENA_MAX / ARENA_ALIGN)
+
+struct arena {
+	struct arena_chunk *chunks;	/* All chunks, for arena_release() */
+	char *bump;			/* Free space in the newest chunk */
+	char *end;
+	struct arena_node *free[ARENA_CLASSES];
+};
+
 /* Function prototypes */
 extern void *xmalloc(size_t) __attribute__ ((__malloc__));
 extern void *xcalloc(size_t, size_t) __attribute__ ((__malloc__));
 extern void *xrealloc(void *, size_t) __attribute__ ((__malloc__));
+extern void *arena_alloc(struct arena *, size_t) __attribute__ ((__malloc__));
+extern void *arena_zalloc(struct arena *, size_t)
+	__attribute__ ((__malloc__));
+extern void arena_free(struct arena *, void *, size_t);
+extern void arena_release(struct arena *);
+extern void alloc_stats_get(struct alloc_stats *);
 
 #endif /* system.h */
@@ -0,0 +1,91 @@
+/*
+ * Print the times spilled by stats_spill().
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "spill.h"
+
+/*
+ * The times after the warm-up are printed one a line, or with -a all of
+ * them.  With -s only their number, mean, least and biggest.
+ */
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-a] [-s] times-file\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	bool all = false, summary = false;
+	struct spill *sp;
+	const double *t;
+	size_t i, n;
+	int c;
+
+	while ((c = getopt(argc, argv, "as")) != -1) {
+		switch (c) {
+		case 'a':
+			all = true;
+			break;
+		case 's':
+			summary = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind + 1 != argc)
+		usage(argv[0]);
+
+	sp = spill_open(argv[optind]);
+	if (!sp)
+		err(EXIT_FAILURE, "%s", argv[optind]);
+	if (all)
+		spill_cut(sp, (size_t) -1);
+	errno = 0;
+	t = spill_times(sp, &n);
+	if (!t && errno)
+		err(EXIT_FAILURE, "%s", argv[optind]);
+
+	if (summary) {
+		double sum = 0.0, lo = n ? t[0] : 0.0, hi = lo;
+
+		for (i = 0; i < n; i++) {
+			sum += t[i];
+			if (t[i] < lo)
+				lo = t[i];
+			if (t[i] > hi)
+				hi = t[i];
+		}
+		printf("%zu times, mean %g, min %g, max %g\n", n,
+		       n ? sum / n : 0.0, lo, hi);
+	} else {
+		for (i = 0; i < n; i++)
+			printf("%.17g\n", t[i]);
+	}
+
+	spill_close(sp);
+
+	return EXIT_SUCCESS;
+}
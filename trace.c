@@ -0,0 +1,252 @@
+/*
+ * Binary event trace.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Records are put into a ring buffer and a background thread writes
+ * them into the trace file, so the simulation itself never formats
+ * anything or makes a syscall.  The ring is a bounded MPMC queue in the
+ * style of D. Vyukov: every slot carries a sequence number telling
+ * whether it is free for the producer or ready for the writer.  Only
+ * when the ring is full does a producer yield the CPU.
+ *
+ * Simulations running at once share the trace.  Every trace_open()
+ * takes a reference and the last trace_close() ends the trace.  A
+ * producer counts itself in tr.emitters before it looks at tr.open, so
+ * the ring is only freed once no producer is left in it.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "error.h"
+#include "system.h"
+#include "trace.h"
+
+#define RING_SIZE	(1U << 16)	/* Records, must be a power of two */
+#define BATCH		4096		/* Records written at once */
+#define IDLE_NS		1000000		/* Writer sleep when the ring is empty */
+
+struct slot {
+	uint64_t seq;
+	struct trace_rec rec;
+};
+
+int trace_level;
+
+const char *const trace_event_names[TR_NEVENTS] = {
+	[TR_PENDING] = "pending",
+	[TR_DISPATCH] = "dispatch",
+	[TR_CREATE] = "create",
+	[TR_DEAD] = "dead",
+	[TR_SEIZE] = "seize",
+	[TR_RELEASE] = "release",
+	[TR_FAC_QUEUE] = "fac_queue",
+	[TR_ENTER] = "enter",
+	[TR_LEAVE] = "leave",
+	[TR_STORE_QUEUE] = "store_queue",
+};
+
+static struct {
+	struct slot *ring;	/* NULL if no trace is open */
+	bool open;		/* Producers may fill the ring */
+	unsigned int emitters;	/* Producers in trace_emit() */
+	unsigned int users;	/* trace_open() not closed yet */
+	uint64_t head;		/* Next slot to fill */
+	uint64_t tail;		/* Next slot to write, writer only */
+	FILE *fp;
+	pthread_t writer;
+	bool stop;
+	pthread_mutex_t lock;	/* Opening and closing */
+} tr = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Move all ready records from the ring into the file */
+static size_t drain(void)
+{
+	static struct trace_rec buf[BATCH];
+	size_t n = 0;
+
+	for (;;) {
+		struct slot *s = &tr.ring[tr.tail & (RING_SIZE - 1)];
+
+		if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != tr.tail + 1)
+			break;
+
+		buf[n++] = s->rec;
+		__atomic_store_n(&s->seq, tr.tail + RING_SIZE,
+				 __ATOMIC_RELEASE);
+		tr.tail++;
+
+		if (n == BATCH)
+			break;
+	}
+
+	if (n && fwrite(buf, sizeof(buf[0]), n, tr.fp) != n)
+		warn("trace write failed");
+
+	return n;
+}
+
+static void *writer(void *arg __unused__)
+{
+	const struct timespec idle = { 0, IDLE_NS };
+
+	for (;;) {
+		if (drain())
+			continue;
+		if (__atomic_load_n(&tr.stop, __ATOMIC_ACQUIRE)) {
+			/* Producers are done, take what's left */
+			while (drain())
+				;
+			break;
+		}
+		nanosleep(&idle, NULL);
+	}
+
+	return NULL;
+}
+
+/* Set runtime trace level without opening a file (for debug()) */
+void trace_set_level(int level)
+{
+	trace_level = min(level, TRACE_LEVEL);
+}
+
+/*
+ * Start writing records up to LEVEL into file PATH.  If a trace is open
+ * already, it is shared: PATH and LEVEL of the first one stay.  Every
+ * trace_open() needs its trace_close().
+ * Returns 0 on success, -1 when error.
+ */
+int trace_open(const char *path, int level)
+{
+	struct trace_hdr hdr;
+	size_t i;
+	int e;
+
+	if (!path || level < TRACE_NONE) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&tr.lock);
+	if (tr.ring) {
+		tr.users++;
+		pthread_mutex_unlock(&tr.lock);
+		return 0;
+	}
+
+	tr.fp = fopen(path, "wb");
+	if (!tr.fp) {
+		pthread_mutex_unlock(&tr.lock);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.recsize = sizeof(struct trace_rec);
+	hdr.level = min(level, TRACE_LEVEL);
+	fwrite(&hdr, sizeof(hdr), 1, tr.fp);
+
+	tr.ring = xmalloc(RING_SIZE * sizeof(*tr.ring));
+	for (i = 0; i < RING_SIZE; i++)
+		tr.ring[i].seq = i;
+	tr.head = tr.tail = 0;
+	tr.stop = false;
+
+	e = pthread_create(&tr.writer, NULL, writer, NULL);
+	if (unlikely(e)) {
+		errno = e;
+		fclose(tr.fp);
+		free(tr.ring);
+		tr.ring = NULL;
+		pthread_mutex_unlock(&tr.lock);
+		return -1;
+	}
+
+	tr.users = 1;
+	__atomic_store_n(&tr.open, true, __ATOMIC_SEQ_CST);
+	trace_set_level(level);
+	pthread_mutex_unlock(&tr.lock);
+
+	return 0;
+}
+
+/* Drop a reference to the trace, the last one flushes and closes it */
+void trace_close(void)
+{
+	pthread_mutex_lock(&tr.lock);
+	if (!tr.ring || --tr.users) {
+		pthread_mutex_unlock(&tr.lock);
+		return;
+	}
+
+	trace_level = TRACE_NONE;
+
+	/* Wait for the producers still filling the ring */
+	__atomic_store_n(&tr.open, false, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&tr.emitters, __ATOMIC_SEQ_CST))
+		sched_yield();
+
+	__atomic_store_n(&tr.stop, true, __ATOMIC_RELEASE);
+	pthread_join(tr.writer, NULL);
+
+	fclose(tr.fp);
+	free(tr.ring);
+	tr.ring = NULL;
+	pthread_mutex_unlock(&tr.lock);
+}
+
+/* Put one record into the ring, called through trace() */
+void trace_emit(unsigned int ev, double t, size_t idx, int state,
+		unsigned int res, unsigned int arg)
+{
+	struct slot *s;
+	uint64_t pos;
+
+	__atomic_add_fetch(&tr.emitters, 1, __ATOMIC_SEQ_CST);
+	if (unlikely(!__atomic_load_n(&tr.open, __ATOMIC_SEQ_CST))) {
+		__atomic_sub_fetch(&tr.emitters, 1, __ATOMIC_RELEASE);
+		return;
+	}
+
+	pos = __atomic_fetch_add(&tr.head, 1, __ATOMIC_RELAXED);
+	s = &tr.ring[pos & (RING_SIZE - 1)];
+
+	/* Ring is full, wait for the writer */
+	while (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != pos)
+		sched_yield();
+
+	s->rec.time = t;
+	s->rec.idx = (uint32_t) idx;
+	s->rec.res = res;
+	s->rec.event = (uint16_t) ev;
+	s->rec.state = (uint8_t) state;
+	s->rec.pad = 0;
+	s->rec.arg = arg;
+
+	__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&tr.emitters, 1, __ATOMIC_RELEASE);
+}
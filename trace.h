@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "system.h"
+
+/* Trace levels */
+#define TRACE_NONE	0	/* Nothing */
+#define TRACE_EVENT	1	/* Dispatched activations, process life */
+#define TRACE_RESOURCE	2	/* Facility and store operations */
+#define TRACE_DEBUG	3	/* debug() messages on stderr */
+
+/*
+ * Highest level compiled in, set by the Makefile (TRACE=n).  Calls
+ * above it vanish at compile time; calls below it cost one test of
+ * trace_level when tracing is off.
+ */
+#ifndef TRACE_LEVEL
+# define TRACE_LEVEL	TRACE_RESOURCE
+#endif
+
+/* Trace events */
+#define TR_PENDING	0	/* In the calendar at Run(), activation order */
+#define TR_DISPATCH	1	/* Activation taken off the calendar */
+#define TR_CREATE	2	/* Process created */
+#define TR_DEAD		3	/* Process terminated */
+#define TR_SEIZE	4	/* Facility seized */
+#define TR_RELEASE	5	/* Facility released */
+#define TR_FAC_QUEUE	6	/* Queued in front of facility */
+#define TR_ENTER	7	/* Store capacity taken, arg = capacity */
+#define TR_LEAVE	8	/* Store capacity returned, arg = capacity */
+#define TR_STORE_QUEUE	9	/* Queued in front of store, arg = capacity */
+#define TR_NEVENTS	10
+
+/* One trace record, the file is a header followed by these */
+struct trace_rec {
+	double time;		/* Simulation time */
+	uint32_t idx;		/* Process index */
+	uint32_t res;		/* Facility or store id, 0 if none */
+	uint16_t event;		/* TR_* */
+	uint8_t state;		/* Process state */
+	uint8_t pad;
+	uint32_t arg;		/* Event specific */
+};
+
+/* Trace file header */
+#define TRACE_MAGIC	"DSIMTRC1"
+struct trace_hdr {
+	char magic[8];
+	uint32_t recsize;	/* sizeof(struct trace_rec) */
+	uint32_t level;		/* Level the trace was written with */
+};
+
+extern const char *const trace_event_names[TR_NEVENTS];
+
+/* Current runtime level, TRACE_NONE unless a trace is open */
+extern int trace_level;
+
+extern int trace_open(const char *, int);
+extern void trace_close(void);
+extern void trace_set_level(int);
+extern void trace_emit(unsigned int, double, size_t, int, unsigned int,
+		       unsigned int);
+
+/* Record event EV if level LVL is both compiled in and enabled */
+#define trace(lvl, ev, t, idx, state, res, arg)				\
+do {									\
+	if (TRACE_LEVEL >= (lvl) && unlikely(trace_level >= (lvl)))	\
+		trace_emit((ev), (t), (idx), (state), (res), (arg));	\
+} while (0)
+
+#if TRACE_LEVEL >= TRACE_DEBUG
+# define debug(fmt, ...)						\
+do {									\
+	if (unlikely(trace_level >= TRACE_DEBUG))			\
+		fprintf(stderr, fmt "\n", ## __VA_ARGS__);		\
+} while (0)
+#else
+# define debug(fmt, ...) ((void) 0)
+#endif
+
+#endif /* _TRACE_H_ */
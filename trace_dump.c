@@ -0,0 +1,103 @@
+/*
+ * Decode a binary trace written by DSIM_TRACE or trace_open().
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "process.h"
+#include "trace.h"
+
+/* Name of the resource in record R */
+static const char *res_kind(const struct trace_rec *r)
+{
+	switch (r->event) {
+	case TR_SEIZE:
+	case TR_RELEASE:
+	case TR_FAC_QUEUE:
+		return "fac";
+	case TR_ENTER:
+	case TR_LEAVE:
+	case TR_STORE_QUEUE:
+		return "store";
+	default:
+		return NULL;
+	}
+}
+
+static void print_rec(const struct trace_rec *r)
+{
+	const char *kind = res_kind(r);
+	const char state = r->state < sizeof(TASK_STATE_TO_CHAR_STR) - 1
+	    ? TASK_STATE_TO_CHAR_STR[r->state] : '?';
+
+	printf("%14.6f %-11s idx:%-6u state:%c", r->time,
+	       r->event < TR_NEVENTS ? trace_event_names[r->event] : "?",
+	       r->idx, state);
+	if (kind)
+		printf(" %s:%u", kind, r->res);
+
+	switch (r->event) {
+	case TR_PENDING:
+	case TR_DISPATCH:
+	case TR_CREATE:
+		printf(" prio:%d", (int) r->arg);
+		break;
+	case TR_FAC_QUEUE:
+		printf(" qlen:%u", r->arg);
+		break;
+	case TR_ENTER:
+	case TR_LEAVE:
+	case TR_STORE_QUEUE:
+		printf(" cap:%u", r->arg);
+		break;
+	}
+	putchar('\n');
+}
+
+int main(int argc, char **argv)
+{
+	struct trace_hdr hdr;
+	struct trace_rec r;
+	FILE *fp;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s trace-file\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fp = fopen(argv[1], "rb");
+	if (!fp)
+		err(EXIT_FAILURE, "%s", argv[1]);
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+	    || memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)))
+		errx(EXIT_FAILURE, "%s: not a trace file", argv[1]);
+	if (hdr.recsize != sizeof(r))
+		errx(EXIT_FAILURE, "%s: record size %u, expected %zu",
+		     argv[1], hdr.recsize, sizeof(r));
+
+	printf("# trace level %u\n", hdr.level);
+	while (fread(&r, sizeof(r), 1, fp) == 1)
+		print_rec(&r);
+
+	fclose(fp);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1014 @@
+/*
+ * Optimistic (Time Warp) parallel simulation engine.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The LPs are split into contiguous blocks, one block per worker thread,
+ * and every worker keeps a single calendar for all events of its LPs.  A
+ * worker never waits: it executes its earliest event and goes on.  An
+ * event coming in the past of its receiver (a straggler) is mostly sent
+ * by another worker, but after a rollback also by an LP of the same one.
+ *
+ * State saving is incremental: tw_save() copies the old bytes into the
+ * undo log of the LP.  Every processed event remembers where the undo
+ * log and the log of sent events were when it started.  A rollback to
+ * time t pops the processed events not earlier than t, restores the
+ * saved bytes, cancels what they sent and puts them back to the calendar.
+ * Memory from tw_alloc() is freed by a rollback of its event, memory
+ * given to tw_dispose() and times given to tw_save_time() wait for the
+ * commit of theirs.
+ * Cancelling an event on the same worker just removes it (rolling its
+ * receiver back first if it was processed already), an event on another
+ * worker gets an anti-message.  Inboxes are drained in send order, so an
+ * anti-message never overtakes its event.
+ *
+ * GVT is computed synchronously.  Once a worker has processed
+ * GVT_INTERVAL events, it raises a flag and all workers meet at the
+ * barrier.  A worker with nothing to do below the window raises it once
+ * the others have processed GVT_IDLE events since the last GVT, or when
+ * all of them are idle, and leaves the CPU to them until then; GVT could
+ * not move much earlier.  They drain their inboxes until nobody sends any
+ * anti-message anymore, then GVT is the earliest pending event.
+ * Nothing can be rolled back before GVT, so the processed events below it
+ * are committed and their logs thrown away (fossil collection).
+ *
+ * Every worker runs bound to a simulation of its own (see sim.h), whose
+ * clock is the time of the event being processed.  So cur_time, simerr
+ * and the tstats of facilities and stores work in handlers, and queue
+ * nodes come from the arena of the worker.
+ *
+ * Simultaneous events are not ordered deterministically, the model should
+ * avoid them or not depend on their order.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cal.h"
+#include "error.h"
+#include "sim.h"
+#include "stats.h"
+#include "system.h"
+#include "tw.h"
+
+/* Events between two GVT computations, per worker */
+#define GVT_INTERVAL	4096
+/* Events of all workers an idle one waits for before asking for GVT */
+#define GVT_IDLE	1024
+
+/* Event ids are (sender << ID_BITS) | counter */
+#define ID_BITS		40
+
+/* Event in flight, lives in an inbox */
+struct tw_msg {
+	struct tw_msg *next;
+	struct tw_event ev;
+	bool anti;		/* Cancels the event with the same id */
+};
+
+/* Processed, not yet committed, event */
+struct done {
+	struct tw_event ev;
+	size_t undo;		/* Length of the undo log before */
+	size_t sent;		/* Length of the sent log before */
+	size_t later;		/* Length of the deferred log before */
+};
+
+/* Saved bytes, the data are in the undo buffer */
+struct undo {
+	void *addr;
+	size_t len;
+	size_t off;
+};
+
+/* Event sent by a processed event, to be cancelled on rollback */
+struct sent {
+	uint64_t id;
+	size_t dst;
+	double time;
+};
+
+/* What waits for the commit or the rollback of a processed event */
+enum deferred_kind {
+	DEF_ALLOC,		/* Freed on rollback */
+	DEF_DISPOSE,		/* Freed on commit */
+	DEF_TIME,		/* Saved into the stats on commit */
+};
+
+struct deferred {
+	enum deferred_kind kind;
+	void *addr;		/* Memory, or the struct stat_t */
+	size_t len;
+	double t;
+};
+
+struct tw_lp {
+	struct tw *sim;
+	size_t id;
+	unsigned int worker;	/* Thread the LP runs on */
+	tw_handler_t handler;
+	void *state;		/* Model data of the LP */
+	double lookahead;
+	double now;		/* Local virtual time */
+	uint64_t counter;	/* For event ids, never goes back */
+
+	struct done *done;
+	size_t ndone, adone;
+	struct undo *undo;
+	size_t nundo, aundo;
+	char *ubuf;
+	size_t nubuf, aubuf;
+	struct sent *sent;
+	size_t nsent, asent;
+	struct deferred *later;
+	size_t nlater, alater;
+};
+
+/* Per-thread data, kept on its own cache line */
+struct worker {
+	struct tw *sim;
+	unsigned int id;
+	size_t first, last;	/* LPs [first, last) */
+	pthread_t th;
+	struct sim *ctx;	/* Bound while running */
+
+	/* Pending events; the calendar handle is the slot number */
+	struct calq *cal;
+	struct tw_event *ev;
+	size_t nslots;
+	size_t allocated;
+	size_t *free_slots;
+	size_t nfree;
+
+	/* Event id -> slot, linear probing */
+	uint64_t *hkey;
+	size_t *hval;
+	size_t hsize, hcount;
+
+	struct tw_msg *free;	/* Recycled messages */
+	struct tw_msg **batch;	/* Scratch for draining the inbox */
+	size_t nbatch;
+
+	uint64_t processed;
+	uint64_t committed;
+	uint64_t rolled_back;
+	uint64_t rollbacks;
+	uint64_t antimsgs;
+	uint64_t since_gvt;	/* Read by idle workers */
+	bool idle;		/* Nothing to do below the window */
+	uint64_t round_sent;	/* Messages sent while draining */
+	double min_next;
+
+	/* Inbox, a Treiber stack */
+	struct tw_msg *inbox __attribute__ ((aligned(64)));
+} __attribute__ ((aligned(64)));
+
+struct tw {
+	struct tw_lp **lp;
+	size_t nlps;
+	unsigned int nthreads;
+	struct worker *w;
+	struct sim **ctx;	/* Bound by the workers, kept between runs */
+	struct worker init;	/* Holds events of tw_schedule() */
+	pthread_barrier_t barrier;
+	double end;
+	double window;		/* Optimism limit above GVT */
+	double gvt;
+	uint64_t gvt_rounds;
+	double wall;
+	bool gvt_request;
+	bool running;
+};
+
+#define EMPTY_KEY	UINT64_MAX
+
+static inline size_t hash(uint64_t id, size_t size)
+{
+	return (size_t) ((id * 0x9E3779B97F4A7C15ULL) >> 17) & (size - 1);
+}
+
+static void ht_put(struct worker *w, uint64_t id, size_t slot);
+
+static void ht_grow(struct worker *w)
+{
+	uint64_t *key = w->hkey;
+	size_t *val = w->hval;
+	const size_t size = w->hsize;
+	size_t i;
+
+	w->hsize = size ? 2 * size : 64;
+	w->hkey = xmalloc(w->hsize * sizeof(*w->hkey));
+	w->hval = xmalloc(w->hsize * sizeof(*w->hval));
+	memset(w->hkey, 0xff, w->hsize * sizeof(*w->hkey));
+	w->hcount = 0;
+
+	for (i = 0; i < size; i++)
+		if (key[i] != EMPTY_KEY)
+			ht_put(w, key[i], val[i]);
+	free(key);
+	free(val);
+}
+
+static void ht_put(struct worker *w, uint64_t id, size_t slot)
+{
+	size_t i;
+
+	if (2 * (w->hcount + 1) > w->hsize)
+		ht_grow(w);
+
+	for (i = hash(id, w->hsize); w->hkey[i] != EMPTY_KEY;
+	     i = (i + 1) & (w->hsize - 1))
+		;
+	w->hkey[i] = id;
+	w->hval[i] = slot;
+	w->hcount++;
+}
+
+/* Find the pending event ID, returns its index in the table or -1 */
+static ssize_t ht_find(struct worker *w, uint64_t id)
+{
+	size_t i;
+
+	if (!w->hsize)
+		return -1;
+
+	for (i = hash(id, w->hsize); w->hkey[i] != EMPTY_KEY;
+	     i = (i + 1) & (w->hsize - 1))
+		if (w->hkey[i] == id)
+			return (ssize_t) i;
+	return -1;
+}
+
+/* Remove entry I, shifting back the ones probed past it */
+static void ht_del(struct worker *w, size_t i)
+{
+	const size_t mask = w->hsize - 1;
+	size_t j = i;
+
+	for (;;) {
+		size_t h;
+
+		j = (j + 1) & mask;
+		if (w->hkey[j] == EMPTY_KEY)
+			break;
+		h = hash(w->hkey[j], w->hsize);
+		/* Can the entry at j move to the hole at i? */
+		if ((i <= j) ? (h <= i || h > j) : (h <= i && h > j)) {
+			w->hkey[i] = w->hkey[j];
+			w->hval[i] = w->hval[j];
+			i = j;
+		}
+	}
+	w->hkey[i] = EMPTY_KEY;
+	w->hcount--;
+}
+
+/* Put event E into the calendar of W */
+static void enqueue(struct worker *w, const struct tw_event *e)
+{
+	size_t s;
+
+	if (w->nfree) {
+		s = w->free_slots[--w->nfree];
+	} else {
+		if (w->nslots == w->allocated) {
+			w->allocated = w->allocated ? 2 * w->allocated : 64;
+			w->ev = xrealloc(w->ev, w->allocated * sizeof(*w->ev));
+			w->free_slots = xrealloc(w->free_slots,
+						 w->allocated
+						 * sizeof(size_t));
+		}
+		s = w->nslots++;
+	}
+
+	w->ev[s] = *e;
+	ht_put(w, e->id, s);
+	calq_insert(w->cal, s, e->time, 0);
+}
+
+/* Drop the pending event at table index I */
+static void dequeue(struct worker *w, size_t i)
+{
+	const size_t s = w->hval[i];
+
+	ht_del(w, i);
+	calq_cancel(w->cal, s);
+	w->free_slots[w->nfree++] = s;
+}
+
+static double next_time(struct worker *w)
+{
+	const struct cal_key *k = calq_head_key(w->cal);
+
+	return k ? k->atime : INFINITY;
+}
+
+static void free_worker(struct worker *w)
+{
+	struct tw_msg *m = w->free;
+
+	while (m) {
+		struct tw_msg *next = m->next;
+
+		free(m);
+		m = next;
+	}
+	free(w->batch);
+	calq_free(w->cal);
+	free(w->ev);
+	free(w->free_slots);
+	free(w->hkey);
+	free(w->hval);
+}
+
+/* Throw away the workers of the previous run */
+static void free_workers(struct tw *sim)
+{
+	unsigned int k;
+
+	for (k = 0; sim->w && k < sim->nthreads; k++)
+		free_worker(&sim->w[k]);
+	free(sim->w);
+	sim->w = NULL;
+}
+
+struct tw *tw_new(unsigned int nthreads)
+{
+	struct tw *sim = xcalloc(1, sizeof(*sim));
+
+	sim->nthreads = nthreads ?: 1;
+	sim->window = INFINITY;
+	sim->init.sim = sim;
+	sim->init.cal = calq_new();
+
+	return sim;
+}
+
+void tw_free(struct tw *sim)
+{
+	size_t i;
+
+	if (!sim)
+		return;
+
+	free_workers(sim);
+	free_worker(&sim->init);
+	for (i = 0; i < sim->nlps; i++) {
+		free(sim->lp[i]->done);
+		free(sim->lp[i]->undo);
+		free(sim->lp[i]->ubuf);
+		free(sim->lp[i]->sent);
+		free(sim->lp[i]->later);
+		free(sim->lp[i]);
+	}
+	free(sim->lp);
+	/* Queue nodes of the facilities and stores go with them */
+	for (i = 0; sim->ctx && i < sim->nthreads; i++)
+		sim_free(sim->ctx[i]);
+	free(sim->ctx);
+	free(sim);
+}
+
+/*
+ * Add a logical process running HANDLER over STATE.  Events it sends to
+ * other LPs must be at least LOOKAHEAD in its future; unlike the
+ * conservative engine it may be tiny, it just has to be positive.
+ * Returns id of the LP or -1 when error.
+ */
+ssize_t tw_lp_new(struct tw *sim, tw_handler_t handler, void *state,
+		  double lookahead)
+{
+	struct tw_lp *lp;
+
+	if (sim->running || !handler || !(lookahead > 0.0)
+	    || sim->nlps >= (size_t) 1 << (64 - ID_BITS)) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	lp = xcalloc(1, sizeof(*lp));
+	lp->sim = sim;
+	lp->id = sim->nlps;
+	lp->handler = handler;
+	lp->state = state;
+	lp->lookahead = lookahead;
+	lp->now = -INFINITY;
+
+	sim->lp = xrealloc(sim->lp, (sim->nlps + 1) * sizeof(*sim->lp));
+	sim->lp[sim->nlps++] = lp;
+
+	return (ssize_t) lp->id;
+}
+
+/*
+ * Don't let the LPs run more than WINDOW time units ahead of GVT; they
+ * wait for the next GVT instead.  Keeps rollbacks short when the threads
+ * run at very different speeds.  Returns 0 on success, -1 when error.
+ */
+int tw_set_window(struct tw *sim, double window)
+{
+	if (sim->running || !(window > 0.0)) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	sim->window = window;
+
+	return 0;
+}
+
+static inline uint64_t new_id(struct tw_lp *lp)
+{
+	return ((uint64_t) lp->id << ID_BITS) | lp->counter++;
+}
+
+/* Schedule an initial event for LP DST, before tw_run() */
+int tw_schedule(struct tw *sim, size_t dst, double t, int type,
+		uint64_t u, double d)
+{
+	if (sim->running || dst >= sim->nlps || t < 0.0) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	const struct tw_event e = {
+		.time = t, .id = new_id(sim->lp[dst]), .src = dst, .dst = dst,
+		.type = type, .u = u, .d = d,
+	};
+
+	enqueue(&sim->init, &e);
+
+	return 0;
+}
+
+/*
+ * Remember LEN bytes at ADDR so that a rollback can put them back.  Call
+ * it before changing any state of LP, from its handler only.  Saving the
+ * same thing twice in one event is harmless.
+ */
+void tw_save(struct tw_lp *lp, void *addr, size_t len)
+{
+	if (lp->nundo == lp->aundo) {
+		lp->aundo = lp->aundo ? 2 * lp->aundo : 64;
+		lp->undo = xrealloc(lp->undo, lp->aundo * sizeof(*lp->undo));
+	}
+	if (lp->nubuf + len > lp->aubuf) {
+		lp->aubuf = max(2 * lp->aubuf, lp->nubuf + len);
+		lp->ubuf = xrealloc(lp->ubuf, lp->aubuf);
+	}
+
+	lp->undo[lp->nundo].addr = addr;
+	lp->undo[lp->nundo].len = len;
+	lp->undo[lp->nundo].off = lp->nubuf;
+	lp->nundo++;
+	memcpy(lp->ubuf + lp->nubuf, addr, len);
+	lp->nubuf += len;
+}
+
+static void defer(struct tw_lp *lp, enum deferred_kind kind, void *addr,
+		  size_t len, double t)
+{
+	if (lp->nlater == lp->alater) {
+		lp->alater = lp->alater ? 2 * lp->alater : 64;
+		lp->later = xrealloc(lp->later,
+				     lp->alater * sizeof(*lp->later));
+	}
+
+	lp->later[lp->nlater].kind = kind;
+	lp->later[lp->nlater].addr = addr;
+	lp->later[lp->nlater].len = len;
+	lp->later[lp->nlater].t = t;
+	lp->nlater++;
+}
+
+/*
+ * LEN bytes for the state of LP, from its handler only.  A rollback of
+ * the event frees them again, the state pointing to them is restored by
+ * then.  Free them with tw_dispose().
+ */
+void *tw_alloc(struct tw_lp *lp, size_t len)
+{
+	void *p = arena_alloc(&lp->sim->ctx[lp->worker]->arena, len);
+
+	defer(lp, DEF_ALLOC, p, len, 0.0);
+	return p;
+}
+
+/*
+ * Free ADDR of LEN bytes from tw_alloc() once the event is committed; a
+ * rollback may bring it back until then.
+ */
+void tw_dispose(struct tw_lp *lp, void *addr, size_t len)
+{
+	defer(lp, DEF_DISPOSE, addr, len, 0.0);
+}
+
+/*
+ * save_time() for handlers.  The stats of S see T once the event is
+ * committed, in the order of time, and never if it is rolled back.  S
+ * must belong to LP only.  Returns -1 and sets simerr to GLOB_INVAL if T
+ * is infinite or NaN.
+ */
+int tw_save_time(struct tw_lp *lp, struct stat_t *s, double t)
+{
+	if (unlikely(!isfinite(t))) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	defer(lp, DEF_TIME, s, 0, t);
+	return 0;
+}
+
+static void post(struct worker *w, struct worker *to, const struct tw_event *e,
+		 bool anti)
+{
+	struct tw_msg *m;
+
+	if (likely(w->free != NULL)) {
+		m = w->free;
+		w->free = m->next;
+	} else {
+		m = xmalloc(sizeof(*m));
+	}
+	m->ev = *e;
+	m->anti = anti;
+
+	m->next = __atomic_load_n(&to->inbox, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&to->inbox, &m->next, m, true,
+					    __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+static void rollback(struct worker *w, struct tw_lp *lp, double t);
+
+/* Cancel event S sent by an LP of W */
+static void cancel(struct worker *w, const struct sent *s)
+{
+	struct tw *sim = w->sim;
+	struct tw_lp *to = sim->lp[s->dst];
+	ssize_t i;
+
+	if (to->worker != w->id) {
+		const struct tw_event e = {
+			.time = s->time, .id = s->id, .dst = s->dst,
+		};
+
+		post(w, &sim->w[to->worker], &e, true);
+		w->antimsgs++;
+		w->round_sent++;
+		return;
+	}
+
+	i = ht_find(w, s->id);
+	if (i == -1) {
+		/* Processed already, bring it back to the calendar */
+		rollback(w, to, s->time);
+		i = ht_find(w, s->id);
+	}
+	if (i != -1)
+		dequeue(w, (size_t) i);
+}
+
+/* Undo all events of LP processed at T or later */
+static void rollback(struct worker *w, struct tw_lp *lp, double t)
+{
+	if (!lp->ndone || lp->done[lp->ndone - 1].ev.time < t)
+		return;
+
+	w->rollbacks++;
+	while (lp->ndone && lp->done[lp->ndone - 1].ev.time >= t) {
+		const struct done d = lp->done[--lp->ndone];
+		size_t i;
+
+		for (i = lp->nundo; i-- > d.undo;)
+			memcpy(lp->undo[i].addr, lp->ubuf + lp->undo[i].off,
+			       lp->undo[i].len);
+		if (d.undo < lp->nundo)
+			lp->nubuf = lp->undo[d.undo].off;
+		lp->nundo = d.undo;
+
+		for (i = lp->nsent; i-- > d.sent;)
+			cancel(w, &lp->sent[i]);
+		lp->nsent = d.sent;
+
+		/* Nothing points to what the event allocated anymore */
+		for (i = lp->nlater; i-- > d.later;)
+			if (lp->later[i].kind == DEF_ALLOC)
+				arena_free(&w->ctx->arena, lp->later[i].addr,
+					   lp->later[i].len);
+		lp->nlater = d.later;
+
+		enqueue(w, &d.ev);
+		w->rolled_back++;
+	}
+	lp->now = lp->ndone ? lp->done[lp->ndone - 1].ev.time : -INFINITY;
+}
+
+/*
+ * Send an event from LP to DST at time T; only for handlers, use
+ * tw_schedule() to set up the model.  Sending to itself only needs T not
+ * to be in the past, anything else must respect the lookahead.
+ */
+int tw_send(struct tw_lp *lp, size_t dst, double t, int type,
+	    uint64_t u, double d)
+{
+	struct tw *sim = lp->sim;
+	struct worker *w = &sim->w[lp->worker];
+	struct tw_lp *to;
+
+	if (unlikely(dst >= sim->nlps || t < lp->now
+		     || (dst != lp->id && t < lp->now + lp->lookahead))) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	const struct tw_event e = {
+		.time = t, .id = new_id(lp), .src = lp->id, .dst = dst,
+		.type = type, .u = u, .d = d,
+	};
+
+	if (lp->nsent == lp->asent) {
+		lp->asent = lp->asent ? 2 * lp->asent : 64;
+		lp->sent = xrealloc(lp->sent, lp->asent * sizeof(*lp->sent));
+	}
+	lp->sent[lp->nsent].id = e.id;
+	lp->sent[lp->nsent].dst = dst;
+	lp->sent[lp->nsent].time = t;
+	lp->nsent++;
+
+	/*
+	 * After a rollback the other LPs of our worker may be ahead of us.
+	 * Rolling them back is safe: whatever they cancel is later than
+	 * now + lookahead, so it can't be processed by us yet.
+	 */
+	to = sim->lp[dst];
+	if (to->worker == w->id) {
+		if (to != lp)
+			rollback(w, to, t);
+		enqueue(w, &e);
+	} else {
+		post(w, &sim->w[to->worker], &e, false);
+	}
+
+	return 0;
+}
+
+double tw_now(const struct tw_lp *lp)
+{
+	return lp->now;
+}
+
+size_t tw_lp_id(const struct tw_lp *lp)
+{
+	return lp->id;
+}
+
+void *tw_lp_state(const struct tw_lp *lp)
+{
+	return lp->state;
+}
+
+/* Handle everything other workers sent to W, in send order */
+static void drain(struct worker *w)
+{
+	struct tw_msg *m = __atomic_exchange_n(&w->inbox, NULL,
+					       __ATOMIC_ACQUIRE);
+	size_t n = 0;
+
+	for (; m; m = m->next) {
+		if (n == w->nbatch) {
+			w->nbatch = w->nbatch ? 2 * w->nbatch : 64;
+			w->batch = xrealloc(w->batch,
+					    w->nbatch * sizeof(*w->batch));
+		}
+		w->batch[n++] = m;
+	}
+
+	/* The stack has the newest message on top */
+	while (n--) {
+		m = w->batch[n];
+
+		struct tw_lp *lp = w->sim->lp[m->ev.dst];
+		ssize_t i;
+
+		if (!m->anti) {
+			/* A straggler rolls its receiver back */
+			rollback(w, lp, m->ev.time);
+			enqueue(w, &m->ev);
+		} else {
+			i = ht_find(w, m->ev.id);
+			if (i == -1) {
+				/* Processed already */
+				rollback(w, lp, m->ev.time);
+				i = ht_find(w, m->ev.id);
+			}
+			if (i != -1)
+				dequeue(w, (size_t) i);
+		}
+
+		m->next = w->free;
+		w->free = m;
+	}
+}
+
+/* Execute the earliest event of W */
+static void process(struct worker *w)
+{
+	const size_t s = (size_t) calq_head(w->cal);
+	const struct tw_event e = w->ev[s];
+	struct tw_lp *lp = w->sim->lp[e.dst];
+	ssize_t i = ht_find(w, e.id);
+
+	dequeue(w, (size_t) i);
+
+	if (lp->ndone == lp->adone) {
+		lp->adone = lp->adone ? 2 * lp->adone : 64;
+		lp->done = xrealloc(lp->done, lp->adone * sizeof(*lp->done));
+	}
+	lp->done[lp->ndone].ev = e;
+	lp->done[lp->ndone].undo = lp->nundo;
+	lp->done[lp->ndone].sent = lp->nsent;
+	lp->done[lp->ndone].later = lp->nlater;
+	lp->ndone++;
+
+	lp->now = w->ctx->now = e.time;
+	lp->handler(lp, &e);
+	w->processed++;
+	__atomic_store_n(&w->since_gvt, w->since_gvt + 1, __ATOMIC_RELAXED);
+}
+
+/* Commit the events of LP before GVT and free their logs */
+static void fossil_collect(struct worker *w, struct tw_lp *lp, double gvt)
+{
+	size_t k, undo, sent, later, off, i;
+
+	for (k = 0; k < lp->ndone && lp->done[k].ev.time < gvt; k++)
+		;
+	if (!k)
+		return;
+
+	undo = k < lp->ndone ? lp->done[k].undo : lp->nundo;
+	sent = k < lp->ndone ? lp->done[k].sent : lp->nsent;
+	later = k < lp->ndone ? lp->done[k].later : lp->nlater;
+	off = undo < lp->nundo ? lp->undo[undo].off : lp->nubuf;
+
+	memmove(lp->done, lp->done + k, (lp->ndone - k) * sizeof(*lp->done));
+	lp->ndone -= k;
+	for (i = 0; i < lp->ndone; i++) {
+		lp->done[i].undo -= undo;
+		lp->done[i].sent -= sent;
+		lp->done[i].later -= later;
+	}
+
+	for (i = 0; i < later; i++) {
+		const struct deferred *d = &lp->later[i];
+
+		if (d->kind == DEF_DISPOSE)
+			arena_free(&w->ctx->arena, d->addr, d->len);
+		else if (d->kind == DEF_TIME)
+			save_time(d->addr, d->t);
+	}
+	memmove(lp->later, lp->later + later,
+		(lp->nlater - later) * sizeof(*lp->later));
+	lp->nlater -= later;
+
+	memmove(lp->undo, lp->undo + undo,
+		(lp->nundo - undo) * sizeof(*lp->undo));
+	lp->nundo -= undo;
+	for (i = 0; i < lp->nundo; i++)
+		lp->undo[i].off -= off;
+	memmove(lp->ubuf, lp->ubuf + off, lp->nubuf - off);
+	lp->nubuf -= off;
+
+	memmove(lp->sent, lp->sent + sent,
+		(lp->nsent - sent) * sizeof(*lp->sent));
+	lp->nsent -= sent;
+
+	w->committed += k;
+}
+
+/* All workers together; returns true when the run is over */
+static bool compute_gvt(struct worker *w)
+{
+	struct tw *sim = w->sim;
+	double gvt = INFINITY;
+	unsigned int k;
+	size_t i;
+
+	/* Nobody processes now, flush the messages in flight */
+	for (;;) {
+		uint64_t sent = 0;
+
+		pthread_barrier_wait(&sim->barrier);
+		w->round_sent = 0;
+		drain(w);
+		pthread_barrier_wait(&sim->barrier);
+
+		for (k = 0; k < sim->nthreads; k++)
+			sent += sim->w[k].round_sent;
+		if (!sent)
+			break;
+	}
+
+	w->min_next = next_time(w);
+	pthread_barrier_wait(&sim->barrier);
+
+	for (k = 0; k < sim->nthreads; k++)
+		gvt = min(gvt, sim->w[k].min_next);
+	gvt = min(gvt, sim->end);
+	if (w->id == 0) {
+		sim->gvt = gvt;
+		sim->gvt_rounds++;
+		__atomic_store_n(&sim->gvt_request, false, __ATOMIC_RELAXED);
+	}
+
+	for (i = w->first; i < w->last; i++)
+		fossil_collect(w, sim->lp[i], gvt);
+	__atomic_store_n(&w->since_gvt, 0, __ATOMIC_RELAXED);
+
+	/* Don't let anybody see the request before it is cleared */
+	pthread_barrier_wait(&sim->barrier);
+
+	return gvt >= sim->end;
+}
+
+/*
+ * Is a GVT round worth it to idle W?  Only once the others have moved
+ * on, or nobody can.
+ */
+static bool gvt_due(struct worker *w)
+{
+	struct tw *const sim = w->sim;
+	uint64_t done = 0;
+	bool all_idle = true;
+	unsigned int k;
+
+	for (k = 0; k < sim->nthreads; k++) {
+		done += __atomic_load_n(&sim->w[k].since_gvt, __ATOMIC_RELAXED);
+		all_idle &= __atomic_load_n(&sim->w[k].idle, __ATOMIC_RELAXED)
+			    && !__atomic_load_n(&sim->w[k].inbox,
+						__ATOMIC_RELAXED);
+	}
+	return all_idle || done >= GVT_IDLE;
+}
+
+static void *worker_loop(void *arg)
+{
+	struct worker *w = arg;
+	struct tw *sim = w->sim;
+	struct sim *old = sim_bind(w->ctx);
+	bool idle;
+
+	for (;;) {
+		drain(w);
+
+		if (__atomic_load_n(&sim->gvt_request, __ATOMIC_RELAXED)) {
+			if (compute_gvt(w))
+				break;
+			continue;
+		}
+
+		idle = next_time(w) >= min(sim->end, sim->gvt + sim->window);
+		if (idle != w->idle)
+			__atomic_store_n(&w->idle, idle, __ATOMIC_RELAXED);
+
+		if (!idle) {
+			process(w);
+			if (w->since_gvt >= GVT_INTERVAL)
+				__atomic_store_n(&sim->gvt_request, true,
+						 __ATOMIC_RELAXED);
+		} else if (gvt_due(w)) {
+			__atomic_store_n(&sim->gvt_request, true,
+					 __ATOMIC_RELAXED);
+		} else {
+			/* Leave the CPU to the workers that have work */
+			sched_yield();
+		}
+	}
+
+	sim_bind(old);
+	return NULL;
+}
+
+/*
+ * Run the model until END on the threads given to tw_new().
+ * Returns 0 on success, -1 when error.
+ */
+int tw_run(struct tw *sim, double end)
+{
+	struct timespec t0, t1;
+	unsigned int k;
+	size_t i, s;
+	int e;
+
+	if (sim->running || !sim->nlps) {
+		simerr = GLOB_INVAL;
+		return -1;
+	}
+
+	free_workers(sim);
+
+	if (sim->nthreads > sim->nlps)
+		sim->nthreads = (unsigned int) sim->nlps;
+
+	if (!sim->ctx)
+		sim->ctx = xcalloc(sim->nthreads, sizeof(*sim->ctx));
+	sim->w = xcalloc(sim->nthreads, sizeof(*sim->w));
+	for (k = 0; k < sim->nthreads; k++) {
+		if (!sim->ctx[k] && !(sim->ctx[k] = sim_new()))
+			errx(EXIT_FAILURE, "sim_new: cannot make a simulation");
+		sim->ctx[k]->start = sim->ctx[k]->now = 0.0;
+		sim->ctx[k]->end = end;
+		sim->w[k].ctx = sim->ctx[k];
+		sim->w[k].sim = sim;
+		sim->w[k].id = k;
+		sim->w[k].cal = calq_new();
+		sim->w[k].first = sim->nlps * k / sim->nthreads;
+		sim->w[k].last = sim->nlps * (k + 1) / sim->nthreads;
+		for (i = sim->w[k].first; i < sim->w[k].last; i++)
+			sim->lp[i]->worker = k;
+	}
+
+	/* Hand the initial events over to the workers */
+	while (calq_size(sim->init.cal)) {
+		s = (size_t) calq_head(sim->init.cal);
+		calq_del_head(sim->init.cal);
+		enqueue(&sim->w[sim->lp[sim->init.ev[s].dst]->worker],
+			&sim->init.ev[s]);
+	}
+	free_worker(&sim->init);
+	memset(&sim->init, 0, sizeof(sim->init));
+	sim->init.sim = sim;
+	sim->init.cal = calq_new();
+
+	e = pthread_barrier_init(&sim->barrier, NULL, sim->nthreads);
+	if (unlikely(e))
+		errx(EXIT_FAILURE, "pthread_barrier_init: %s", strerror(e));
+
+	sim->end = end;
+	sim->gvt = 0.0;
+	sim->gvt_rounds = 0;
+	sim->gvt_request = false;
+	sim->running = true;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (k = 1; k < sim->nthreads; k++) {
+		e = pthread_create(&sim->w[k].th, NULL, worker_loop,
+				   &sim->w[k]);
+		if (unlikely(e))
+			errx(EXIT_FAILURE, "pthread_create: %s", strerror(e));
+	}
+	worker_loop(&sim->w[0]);
+	for (k = 1; k < sim->nthreads; k++)
+		pthread_join(sim->w[k].th, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sim->wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	sim->running = false;
+	pthread_barrier_destroy(&sim->barrier);
+
+	return 0;
+}
+
+/* Counters of the last run; call after tw_run() */
+void tw_get_stats(struct tw *sim, struct tw_stats *st)
+{
+	unsigned int k;
+
+	memset(st, 0, sizeof(*st));
+	st->gvt_rounds = sim->gvt_rounds;
+	st->wall = sim->wall;
+	for (k = 0; sim->w && k < sim->nthreads; k++) {
+		st->processed += sim->w[k].processed;
+		st->committed += sim->w[k].committed;
+		st->rolled_back += sim->w[k].rolled_back;
+		st->rollbacks += sim->w[k].rollbacks;
+		st->antimsgs += sim->w[k].antimsgs;
+	}
+	st->efficiency = st->processed
+		? (double) st->committed / st->processed : 1.0;
+}
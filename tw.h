@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _TW_H_
+#define _TW_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Optimistic (Time Warp) parallel engine.  Like the conservative one
+ * the model is split into logical processes exchanging timestamped
+ * events, but LPs don't wait for each other: they run ahead and roll
+ * back when an event arrives in their past.
+ *
+ * Handlers must be deterministic and must call tw_save() on every piece
+ * of LP state (servers, RNG state, ...) before they change it; that is
+ * what a rollback restores.  Facilities, stores and stats of an LP are
+ * left to tw_seize() and the rest below, which save them themselves.
+ * Their customers have no process; they are numbers the model gives out,
+ * handed back when they get what they waited for.
+ */
+struct tw;
+struct tw_lp;
+struct facility_t;
+struct store_t;
+struct stat_t;
+
+struct tw_event {
+	double time;		/* Time of the event */
+	uint64_t id;		/* Unique, for annihilation */
+	size_t src;		/* Sending LP */
+	size_t dst;		/* Receiving LP */
+	int type;		/* Model defined */
+	uint64_t u;		/* Payload */
+	double d;
+};
+
+typedef void (*tw_handler_t)(struct tw_lp *, const struct tw_event *);
+
+/* Counters of a run */
+struct tw_stats {
+	uint64_t processed;	/* Events executed, rolled back ones too */
+	uint64_t committed;	/* Events below GVT, i.e. for real */
+	uint64_t rolled_back;	/* Events undone */
+	uint64_t rollbacks;	/* Stragglers and anti-messages hitting
+				   processed events */
+	uint64_t antimsgs;	/* Anti-messages sent */
+	uint64_t gvt_rounds;	/* GVT computations */
+	double efficiency;	/* committed / processed */
+	double wall;		/* Seconds spent in tw_run() */
+};
+
+extern struct tw *tw_new(unsigned int);
+extern void tw_free(struct tw *);
+extern ssize_t tw_lp_new(struct tw *, tw_handler_t, void *, double);
+extern int tw_set_window(struct tw *, double);
+extern int tw_schedule(struct tw *, size_t, double, int, uint64_t, double);
+extern int tw_run(struct tw *, double);
+extern void tw_get_stats(struct tw *, struct tw_stats *);
+
+/* Called from handlers */
+extern int tw_send(struct tw_lp *, size_t, double, int, uint64_t, double);
+extern void tw_save(struct tw_lp *, void *, size_t);
+extern void *tw_alloc(struct tw_lp *, size_t);
+extern void tw_dispose(struct tw_lp *, void *, size_t);
+extern int tw_save_time(struct tw_lp *, struct stat_t *, double);
+extern double tw_now(const struct tw_lp *);
+extern size_t tw_lp_id(const struct tw_lp *);
+extern void *tw_lp_state(const struct tw_lp *);
+
+/* Save an lvalue before changing it */
+#define TW_SAVE(lp, var) tw_save((lp), &(var), sizeof(var))
+
+/* Facilities and stores of an LP, see tw_res.c */
+extern bool tw_seize(struct tw_lp *, struct facility_t *, size_t);
+extern ssize_t tw_release(struct tw_lp *, struct facility_t *);
+extern bool tw_enter(struct tw_lp *, struct store_t *, size_t, unsigned int);
+extern ssize_t tw_leave(struct tw_lp *, struct store_t *, size_t,
+			unsigned int);
+
+#endif /* _TW_H_ */
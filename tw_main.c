@@ -0,0 +1,211 @@
+/*
+ * main.c on the Time Warp engine.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The facility of main.c: customers seize it, save their wait into its
+ * stats, are served Exponential(1.25) and release it.  Here every LP has
+ * such a facility, -f of them, and a served customer goes on to a random
+ * one after -l time units instead of quitting, so that the LPs have
+ * something to roll back.  The customers of main.c come all at once and
+ * every other one has a higher priority; here they come at random in
+ * the first time unit and are served in FIFO order.
+ *
+ * The model is run with 1, 2, 4, ... threads up to -t; the waits must be
+ * the same every time.  The stats of the first facility are printed as
+ * main.c prints them.
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "error.h"
+#include "facility.h"
+#include "rng.h"
+#include "stats.h"
+#include "system.h"
+#include "tw.h"
+
+#define SERVICE		1.25	/* Mean service time */
+
+enum { ARRIVE, DEPART };
+
+/* A facility of main.c with its LP */
+struct counter {
+	struct facility_t fac;
+	struct rng rng;		/* Saved before every draw */
+	double *arrived;	/* Arrival of every customer */
+} __attribute__ ((aligned(64)));
+
+static size_t nfacs = 8;
+static const unsigned int sewers = 10;	/* Customers per facility */
+static double transit = 0.1;	/* Lookahead */
+
+/* Customer C has got the facility of S, serve it */
+static void serve(struct tw_lp *lp, struct counter *s, size_t c)
+{
+	tw_save_time(lp, s->fac.stats, tw_now(lp) - s->arrived[c]);
+	TW_SAVE(lp, s->rng);
+	tw_send(lp, tw_lp_id(lp),
+		tw_now(lp) + rng_exponential(&s->rng, SERVICE), DEPART, c,
+		0.0);
+}
+
+static void counter(struct tw_lp *lp, const struct tw_event *e)
+{
+	struct counter *s = tw_lp_state(lp);
+	const size_t c = (size_t) e->u;
+	ssize_t next;
+	size_t to;
+
+	switch (e->type) {
+	case ARRIVE:
+		TW_SAVE(lp, s->arrived[c]);
+		s->arrived[c] = tw_now(lp);
+		if (tw_seize(lp, &s->fac, c))
+			serve(lp, s, c);
+		break;
+	case DEPART:
+		next = tw_release(lp, &s->fac);
+		if (next != -1)
+			serve(lp, s, (size_t) next);
+		TW_SAVE(lp, s->rng);
+		to = (size_t) (rng_random(&s->rng) * nfacs);
+		tw_send(lp, to, tw_now(lp) + transit, ARRIVE, c, 0.0);
+		break;
+	}
+}
+
+/*
+ * Build and run the facilities on NTHREADS.  Returns the number of
+ * waits saved and their sum in SUM.  The stats of the first facility go
+ * to FIRST unless it is NULL.
+ */
+static size_t run(unsigned int nthreads, double end, double *sum,
+		  struct tw_stats *st, struct stat_t *first)
+{
+	struct tw *sim = tw_new(nthreads);
+	struct counter *s = xcalloc(nfacs, sizeof(*s));
+	const size_t ncustomers = nfacs * sewers;
+	char name[32];
+	size_t i, c, n = 0;
+
+	for (i = 0; i < nfacs; i++) {
+		fac_constructor(&s[i].fac);
+		snprintf(name, sizeof(name), "Facility %zu", i);
+		fac_set_name(&s[i].fac, name);
+		stats_keep_times(s[i].fac.stats, true);
+		rng_seed(&s[i].rng, i + 1);
+		s[i].arrived = xcalloc(ncustomers, sizeof(*s[i].arrived));
+		if (tw_lp_new(sim, counter, &s[i], transit) == -1)
+			psimerr("tw_lp_new");
+		for (c = 0; c < sewers; c++)
+			tw_schedule(sim, i, rng_random(&s[i].rng), ARRIVE,
+				    i * sewers + c, 0.0);
+	}
+
+	if (tw_run(sim, end) == -1)
+		psimerr("tw_run");
+	tw_get_stats(sim, st);
+
+	if (first)
+		stats_merge(first, s[0].fac.stats);
+
+	*sum = 0.0;
+	for (i = 0; i < nfacs; i++) {
+		n += times_cnt(s[i].fac.stats);
+		*sum += times_sum(s[i].fac.stats);
+		fac_destructor(&s[i].fac);
+		free(s[i].arrived);
+	}
+	free(s);
+	tw_free(sim);
+
+	return n;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-f facilities] "
+		"[-e end_time] [-l lookahead]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_threads = 4, t;
+	double end = 1000.0, sum1 = 0.0;
+	struct stat_t first = { .keep_times = true };
+	size_t n1 = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:f:e:l:")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			nfacs = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			end = strtod(optarg, NULL);
+			break;
+		case 'l':
+			transit = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!nfacs || !max_threads || !(transit > 0.0))
+		usage(argv[0]);
+
+	printf("%zu facilities, %u customers each, lookahead %g, "
+	       "end time %g\n", nfacs, sewers, transit, end);
+	printf("%8s %8s %10s %11s %10s %8s %9s\n", "threads", "waits",
+	       "mean wait", "processed", "rollbacks", "effic.", "wall [s]");
+
+	for (t = 1; t <= max_threads; t *= 2) {
+		struct tw_stats st;
+		double sum;
+		const size_t n = run(t, end, &sum, &st,
+				     t == 1 ? &first : NULL);
+
+		if (t == 1) {
+			n1 = n;
+			sum1 = sum;
+		} else if (n != n1 || sum != sum1) {
+			errx(EXIT_FAILURE, "%u threads saved %zu waits, "
+			     "1 thread %zu", t, n, n1);
+		}
+
+		printf("%8u %8zu %10.4f %11llu %10llu %8.3f %9.3f\n", t, n,
+		       n ? sum / n : 0.0, (unsigned long long) st.processed,
+		       (unsigned long long) st.rollbacks, st.efficiency,
+		       st.wall);
+	}
+
+	printf("\033[1;32mStats for Facility 0\033[0m\n");
+	print_stats(&first, sewers / 2 - 1, 1);
+	free_times(&first);
+
+	return EXIT_SUCCESS;
+}
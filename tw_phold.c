@@ -0,0 +1,230 @@
+/*
+ * Closed queueing network with tiny lookahead on the Time Warp engine.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * PHOLD-like model: every station is one LP with a FIFO queue and a
+ * single server, a served customer goes to a random station and gets
+ * there after -l time units.  The lookahead is far too small for the
+ * conservative engine, here the stations just run ahead and roll back.
+ * -W limits how far they may run ahead of GVT.
+ * The model is run with 1, 2, 4, ... threads up to -t; the number of
+ * served customers and the total busy time must be the same every time.
+ */
+
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "error.h"
+#include "system.h"
+#include "tw.h"
+
+#define SERVICE		1.0	/* Mean service time */
+
+enum { ARRIVE, DEPART };
+
+/* What a rollback has to restore, saved as a whole */
+struct station_state {
+	uint64_t rng;
+	size_t qhead, qlen;
+	uint64_t served;
+	double busy_since;
+	double busy;		/* Total busy time */
+};
+
+struct station {
+	struct station_state st;
+	uint64_t *queue;	/* Ring of all customers there are */
+} __attribute__ ((aligned(64)));
+
+static size_t nstations = 64;
+static size_t ncustomers = 8;	/* Per station */
+static double transit = 0.01;	/* Lookahead */
+static double window = INFINITY;	/* Optimism limit */
+
+static double uniform(struct station_state *s)
+{
+	s->rng ^= s->rng << 13;
+	s->rng ^= s->rng >> 7;
+	s->rng ^= s->rng << 17;
+	return ((s->rng >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static void start_service(struct tw_lp *lp, struct station_state *s,
+			  uint64_t c)
+{
+	s->busy_since = tw_now(lp);
+	tw_send(lp, tw_lp_id(lp), tw_now(lp) - SERVICE * log(uniform(s)),
+		DEPART, c, 0.0);
+}
+
+static void station(struct tw_lp *lp, const struct tw_event *e)
+{
+	struct station *st = tw_lp_state(lp);
+	struct station_state *s = &st->st;
+	const size_t size = nstations * ncustomers;
+	size_t next;
+
+	TW_SAVE(lp, *s);
+
+	switch (e->type) {
+	case ARRIVE:
+		if (s->busy_since >= 0.0 || s->qlen) {
+			const size_t tail = (s->qhead + s->qlen++) % size;
+
+			TW_SAVE(lp, st->queue[tail]);
+			st->queue[tail] = e->u;
+		} else {
+			start_service(lp, s, e->u);
+		}
+		break;
+	case DEPART:
+		s->served++;
+		s->busy += tw_now(lp) - s->busy_since;
+		s->busy_since = -1.0;
+		next = (size_t) (uniform(s) * nstations);
+		tw_send(lp, next, tw_now(lp) + transit, ARRIVE, e->u, 0.0);
+		if (s->qlen) {
+			const uint64_t c = st->queue[s->qhead];
+
+			s->qhead = (s->qhead + 1) % size;
+			s->qlen--;
+			start_service(lp, s, c);
+		}
+		break;
+	}
+}
+
+/* Build and run the network on NTHREADS, returns customers served */
+static uint64_t run(unsigned int nthreads, double end, double *busy,
+		    struct tw_stats *st)
+{
+	struct tw *sim = tw_new(nthreads);
+	struct station *s = xcalloc(nstations, sizeof(*s));
+	uint64_t served = 0;
+	size_t i, c;
+
+	if (isfinite(window) && tw_set_window(sim, window) == -1)
+		psimerr("tw_set_window");
+
+	*busy = 0.0;
+	for (i = 0; i < nstations; i++) {
+		s[i].st.rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+		s[i].st.busy_since = -1.0;
+		s[i].queue = xmalloc(nstations * ncustomers
+				     * sizeof(*s[i].queue));
+		if (tw_lp_new(sim, station, &s[i], transit) == -1)
+			psimerr("tw_lp_new");
+		for (c = 0; c < ncustomers; c++)
+			tw_schedule(sim, i, uniform(&s[i].st), ARRIVE,
+				    i * ncustomers + c, 0.0);
+	}
+
+	if (tw_run(sim, end) == -1)
+		psimerr("tw_run");
+	tw_get_stats(sim, st);
+
+	for (i = 0; i < nstations; i++) {
+		served += s[i].st.served;
+		*busy += s[i].st.busy;
+		free(s[i].queue);
+	}
+	free(s);
+	tw_free(sim);
+
+	return served;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-s stations] "
+		"[-c customers] [-e end_time] [-l lookahead] "
+		"[-W window]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max_threads = 8, t;
+	double end = 1000.0, wall1 = 0.0, busy1 = 0.0;
+	uint64_t served1 = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:c:e:l:W:")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			nstations = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			ncustomers = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			end = strtod(optarg, NULL);
+			break;
+		case 'l':
+			transit = strtod(optarg, NULL);
+			break;
+		case 'W':
+			window = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!nstations || !ncustomers || !max_threads || !(transit > 0.0))
+		usage(argv[0]);
+
+	printf("%zu stations, %zu customers each, lookahead %g, "
+	       "end time %g\n", nstations, ncustomers, transit, end);
+	printf("%8s %11s %11s %10s %9s %7s %8s %9s %8s\n", "threads",
+	       "processed", "committed", "rollbacks", "antimsgs", "GVTs",
+	       "effic.", "wall [s]", "speedup");
+
+	for (t = 1; t <= max_threads; t *= 2) {
+		struct tw_stats st;
+		double busy;
+		const uint64_t served = run(t, end, &busy, &st);
+
+		if (t == 1) {
+			served1 = served;
+			busy1 = busy;
+			wall1 = st.wall;
+		} else if (served != served1 || busy != busy1) {
+			errx(EXIT_FAILURE, "%u threads served %llu customers, "
+			     "1 thread %llu", t, (unsigned long long) served,
+			     (unsigned long long) served1);
+		}
+
+		printf("%8u %11llu %11llu %10llu %9llu %7llu %8.3f %9.3f "
+		       "%8.2f\n", t, (unsigned long long) st.processed,
+		       (unsigned long long) st.committed,
+		       (unsigned long long) st.rollbacks,
+		       (unsigned long long) st.antimsgs,
+		       (unsigned long long) st.gvt_rounds, st.efficiency,
+		       st.wall, wall1 / st.wall);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+/*
+ * Facilities and stores on the Time Warp engine.
+ *
+ * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * The same facility_t and store_t as for processes, with the semantics
+ * of Seize(), Release(), Enter() and Leave(), but every field is saved
+ * with tw_save() before it changes.  Queue and log nodes come from
+ * tw_alloc() and go to tw_dispose(), so that a rollback can link them
+ * back.  There are no processes to activate: whoever gets the facility
+ * or the capacity from the queue is returned, and the model sends it an
+ * event.  Customers have no priority, the queues are FIFO.
+ *
+ * A facility or a store belongs to one LP, which alone may use it.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "facility.h"
+#include "queue.h"
+#include "stats.h"
+#include "store.h"
+#include "tw.h"
+
+/* Append WHO to the end of QUEUE */
+static void queue_in(struct tw_lp *lp, struct pq_t **queue, size_t who,
+		     unsigned int attr)
+{
+	struct pq_t *new = tw_alloc(lp, sizeof(*new));
+	struct pq_t **link = queue;
+
+	new->next = NULL;
+	new->idx = who;
+	new->attr = attr;
+
+	while (*link)
+		link = &(*link)->next;
+	tw_save(lp, link, sizeof(*link));
+	*link = new;
+}
+
+/* Remove the node LINK points to */
+static void queue_unlink(struct tw_lp *lp, struct pq_t **link)
+{
+	struct pq_t *del = *link;
+
+	tw_save(lp, link, sizeof(*link));
+	*link = del->next;
+	tw_dispose(lp, del, sizeof(*del));
+}
+
+/* WHO holds CAPACITY more of STORE */
+static void log_add(struct tw_lp *lp, struct store_t *store, size_t who,
+		    unsigned int capacity)
+{
+	struct log_t **link;
+	struct log_t *new;
+
+	for (link = &store->log; *link; link = &(*link)->next)
+		if ((*link)->idx == who) {
+			TW_SAVE(lp, (*link)->capacity);
+			(*link)->capacity += capacity;
+			return;
+		}
+
+	new = tw_alloc(lp, sizeof(*new));
+	new->next = NULL;
+	new->idx = who;
+	new->capacity = capacity;
+	tw_save(lp, link, sizeof(*link));
+	*link = new;
+}
+
+/* WHO gives CAPACITY of STORE back, it must hold that much */
+static void log_del(struct tw_lp *lp, struct store_t *store, size_t who,
+		    unsigned int capacity)
+{
+	struct log_t **link;
+	struct log_t *del;
+
+	for (link = &store->log; (*link)->idx != who; link = &(*link)->next)
+		;
+
+	del = *link;
+	if (capacity < del->capacity) {
+		TW_SAVE(lp, del->capacity);
+		del->capacity -= capacity;
+		return;
+	}
+
+	tw_save(lp, link, sizeof(*link));
+	*link = del->next;
+	tw_dispose(lp, del, sizeof(*del));
+}
+
+/*
+ * Customer WHO of LP asks for FAC.  Returns true if it got it, false if
+ * it was queued; tw_release() then hands FAC over to it.
+ */
+bool tw_seize(struct tw_lp *lp, struct facility_t *fac, size_t who)
+{
+	if (!fac->busy) {
+		TW_SAVE(lp, fac->busy);
+		TW_SAVE(lp, fac->idx);
+		TW_SAVE(lp, fac->util);
+		fac->idx = (ssize_t) who;
+		fac->busy = true;
+		tstat_set(&fac->util, 1.0);
+		return true;
+	}
+
+	queue_in(lp, &fac->queue, who, 0);
+	TW_SAVE(lp, fac->qlen);
+	tstat_add(&fac->qlen, 1.0);
+	return false;
+}
+
+/*
+ * The customer holding FAC releases it.  Returns the first one of the
+ * queue, which holds FAC now and waits for the event of the model, or -1
+ * if FAC is free.
+ */
+ssize_t tw_release(struct tw_lp *lp, struct facility_t *fac)
+{
+	TW_SAVE(lp, fac->idx);
+
+	if (fac->queue) {
+		fac->idx = (ssize_t) fac->queue->idx;
+		queue_unlink(lp, &fac->queue);
+		TW_SAVE(lp, fac->qlen);
+		tstat_add(&fac->qlen, -1.0);
+		return fac->idx;
+	}
+
+	TW_SAVE(lp, fac->busy);
+	TW_SAVE(lp, fac->util);
+	fac->idx = (ssize_t) - 1;
+	fac->busy = false;
+	tstat_set(&fac->util, 0.0);
+	return -1;
+}
+
+/* WHO takes CAPACITY of STORE */
+static void take(struct tw_lp *lp, struct store_t *store, size_t who,
+		 unsigned int capacity)
+{
+	TW_SAVE(lp, store->free_capacity);
+	TW_SAVE(lp, store->used);
+	store->free_capacity -= capacity;
+	tstat_add(&store->used, capacity);
+	log_add(lp, store, who, capacity);
+}
+
+/*
+ * Customer WHO of LP asks for CAPACITY of STORE.  Returns true if it got
+ * it, false if it was queued; tw_leave() then grants it.
+ */
+bool tw_enter(struct tw_lp *lp, struct store_t *store, size_t who,
+	      unsigned int capacity)
+{
+	assert(capacity <= store->capacity);
+
+	if (!store->queue && store->free_capacity >= capacity) {
+		take(lp, store, who, capacity);
+		return true;
+	}
+
+	queue_in(lp, &store->queue, who, capacity);
+	TW_SAVE(lp, store->qlen);
+	tstat_add(&store->qlen, 1.0);
+	return false;
+}
+
+/*
+ * Customer WHO gives CAPACITY of STORE back.  Returns the first one of
+ * the queue that fits into the free capacity now and got it, or -1.
+ */
+ssize_t tw_leave(struct tw_lp *lp, struct store_t *store, size_t who,
+		 unsigned int capacity)
+{
+	struct pq_t **link;
+	unsigned int granted;
+	size_t next;
+
+	assert((int) capacity <= log_process_capacity(&store->log, who));
+
+	TW_SAVE(lp, store->free_capacity);
+	TW_SAVE(lp, store->used);
+	store->free_capacity += capacity;
+	tstat_add(&store->used, -(double) capacity);
+	log_del(lp, store, who, capacity);
+
+	for (link = &store->queue; *link; link = &(*link)->next)
+		if ((*link)->attr <= store->free_capacity)
+			break;
+	if (!*link)
+		return -1;
+
+	next = (*link)->idx;
+	granted = (*link)->attr;
+	queue_unlink(lp, link);
+	take(lp, store, next, granted);
+	TW_SAVE(lp, store->qlen);
+	tstat_add(&store->qlen, -1.0);
+	return (ssize_t) next;
+}
@@ -1,5 +1,5 @@
 /*
- * Check malloc routines.
+ * Check malloc routines and the simulation arena.
  *
  * Copyright (C) 2010, Marek Polacek <xpolac06@stud.fit.vutbr.cz>
  *
@@ -20,14 +20,44 @@
 #include <err.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include "system.h"
 
+/*
+ * An arena hands out small nodes (calendar entries, queue and log items)
+ * from big chunks.  Every size class has its own free list, so once the
+ * simulation reaches its steady state, nodes are only recycled and
+ * malloc() isn't called at all.  Nothing is returned to libc until
+ * arena_release() drops all the chunks at once.
+ *
+ * An arena has no lock.  It belongs to what owns the nodes: every
+ * calendar has one, and every simulation one for its queues and logs.
+ * Those are only touched by one thread at a time.
+ */
+#define ARENA_CHUNK	(64 * 1024)	/* Bytes taken from malloc() at once */
+
+/* Chunk header, the nodes follow */
+struct arena_chunk {
+	struct arena_chunk *next;
+	char pad[ARENA_ALIGN - sizeof(struct arena_chunk *)];
+};
+
+/* Free node, the link lives in the node itself */
+struct arena_node {
+	struct arena_node *next;
+};
+
+static struct alloc_stats stats;
+
+#define count(field) __atomic_fetch_add(&stats.field, 1, __ATOMIC_RELAXED)
+
 /* Allocate N bytes of memory dynamically, with error checking */
 void *xmalloc(size_t n)
 {
 	void *p;
 
+	count(mallocs);
 	p = malloc(n);
 	if (!p)
 		errx(EXIT_FAILURE, "memory exhausted");
@@ -39,6 +69,7 @@ void *xcalloc(size_t n, size_t s)
 {
 	void *p;
 
+	count(mallocs);
 	p = calloc(n, s);
 	if (!p)
 		errx(EXIT_FAILURE, "memory exhausted");
@@ -49,8 +80,96 @@ void *xcalloc(size_t n, size_t s)
    with error checking */
 void *xrealloc(void *p, size_t n)
 {
+	count(reallocs);
 	p = realloc(p, n);
 	if (!p)
 		errx(EXIT_FAILURE, "memory exhausted");
 	return p;
 }
+
+static inline size_t size_class(size_t n)
+{
+	return (n + ARENA_ALIGN - 1) / ARENA_ALIGN - 1;
+}
+
+/* Allocate N bytes from arena A.  The memory is not cleared. */
+void *arena_alloc(struct arena *a, size_t n)
+{
+	const size_t c = size_class(n ?: 1);
+	const size_t sz = (c + 1) * ARENA_ALIGN;
+	void *p;
+
+	if (unlikely(n > ARENA_MAX))
+		return xmalloc(n);
+
+	if (likely(a->free[c] != NULL)) {
+		/* Recycle a freed node */
+		p = a->free[c];
+		a->free[c] = a->free[c]->next;
+		return p;
+	}
+
+	if (unlikely(a->bump + sz > a->end)) {
+		/* The rest of the chunk is wasted, it's tiny */
+		struct arena_chunk *ch = xmalloc(ARENA_CHUNK);
+
+		ch->next = a->chunks;
+		a->chunks = ch;
+		a->bump = (char *)(ch + 1);
+		a->end = (char *)ch + ARENA_CHUNK;
+	}
+	p = a->bump;
+	a->bump += sz;
+
+	return p;
+}
+
+/* Allocate N zeroed bytes from arena A */
+void *arena_zalloc(struct arena *a, size_t n)
+{
+	return memset(arena_alloc(a, n), 0, n);
+}
+
+/* Return node P of N bytes to the free list of arena A */
+void arena_free(struct arena *a, void *p, size_t n)
+{
+	struct arena_node *f = p;
+	const size_t c = size_class(n ?: 1);
+
+	if (!p)
+		return;
+
+	if (unlikely(n > ARENA_MAX)) {
+		free(p);
+		return;
+	}
+
+	f->next = a->free[c];
+	a->free[c] = f;
+}
+
+/*
+ * Throw away everything allocated from arena A.  This is the teardown
+ * of a calendar or a simulation: nobody has to walk lists to free them
+ * node by node.  Nodes bigger than ARENA_MAX came from malloc() and are
+ * not taken back.
+ */
+void arena_release(struct arena *a)
+{
+	struct arena_chunk *ch = a->chunks;
+
+	while (ch) {
+		struct arena_chunk *next = ch->next;
+
+		free(ch);
+		ch = next;
+	}
+	memset(a, 0, sizeof(*a));
+}
+
+/* Copy allocation counters into S */
+void alloc_stats_get(struct alloc_stats *s)
+{
+	s->mallocs = __atomic_load_n(&stats.mallocs, __ATOMIC_RELAXED);
+	s->reallocs = __atomic_load_n(&stats.reallocs, __ATOMIC_RELAXED);
+}